@@ -1,52 +1,637 @@
 #ifndef _WIDGET_H_
 #define _WIDGET_H_
 
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <unordered_set>
 
+#include "arena.h"
+#include "civil.h"
+#include "compressed.h"
 #include "memory.h"
+#include "mutation.h"
+#include "observer.h"
+#include "seqlock.h"
+#include "subtree_lock.h"
+#include "text_cache.h"
 
-class Widget {
+//small plain properties that worker threads read without locking the tree
+struct WidgetProperties
+{
+    float x = 0.0f;
+    float y = 0.0f;
+    float width = 0.0f;
+    float height = 0.0f;
+    uint32_t flags = 0;
+    int64_t date = 0;           //seconds since the epoch, used by date bound widgets
+};
+
+//built with MY_COMPRESSED_CHILDREN, widgets live in the compressed heap and hold their children
+//through 4 byte MyCompressedPtr instead of MyUniquePtr, which halves the child arrays of large
+//trees; arenas are not used for widgets then. both pointers have get() and release(), and a widget
+//handed out as MyUniquePtr<Widget> is still freed into the right heap by Widget's operator delete.
+//the parent link shrinks from a 16 byte MyWeakPtr to a 4 byte MyCompressedRef, which does not
+//notice the parent going away
+class Widget;
+#ifdef MY_COMPRESSED_CHILDREN
+using WidgetChildPtr = MyCompressedPtr<Widget>;
+using WidgetParentRef = MyCompressedRef<Widget>;
+#else
+using WidgetChildPtr = MyUniquePtr<Widget>;
+using WidgetParentRef = MyWeakPtr<Widget>;
+#endif
+
+namespace detail
+{
+    //widget object bytes allocated minus freed on this thread, a build is measured by its growth
+    inline size_t& widget_object_bytes() noexcept {
+        static thread_local size_t bytes = 0;
+        return bytes;
+    }
+} // namespace detail
+
+//observable so other systems can hold MyUniqueObserver<Widget> to children owned through MyUniquePtr
+class Widget : public MyObservable {
 protected:
-    MyWeakPtr<Widget> parent;
-    std::vector<MyUniquePtr<Widget>> children;
+    WidgetParentRef parent;
+    std::vector<WidgetChildPtr> children;
+    //widget whose children hold this one; lock managers walk it from other threads
+    std::atomic<Widget*> owner{ nullptr };
+    SeqLocked<WidgetProperties> properties;
+
+private:
+    friend class SubtreeLockManager;
+    //one lock node per SubtreeLockManager that locked this widget, freed with the widget
+    mutable std::atomic<SubtreeLockNode*> lockNodes{ nullptr };
 
 public:
     Widget() noexcept = default;
+#ifdef MY_COMPRESSED_CHILDREN
+    Widget(const MySharedPtr<Widget>& parent) noexcept : parent(parent.get()) {
+#else
     Widget(const MySharedPtr<Widget>& parent) noexcept : parent(parent) {
+#endif
         parent->addChild(this);
     };
-    virtual ~Widget() = default;
+    virtual ~Widget() {
+        expireObservers();
+        if (MutationFeed* feed = MutationFeed::active())
+            feed->widgetDestroyed(this);
+        SubtreeLockManager::widgetDestroyed(this);
+    }
+
+#ifdef MY_COMPRESSED_CHILDREN
+    //allocated from the compressed heap so children can refer to it by offset; compressed_delete
+    //and make_my_compressed go through these operators so the object bytes stay counted
+    static constexpr bool compressed_allocation = true;
+    static void* operator new(size_t size) {
+        void* memory = CompressedHeap::instance().allocate(size);
+        detail::widget_object_bytes() += size;
+        return memory;
+    }
+    static void operator delete(void* ptr, size_t size) noexcept {
+        detail::widget_object_bytes() -= size;
+        CompressedHeap::instance().deallocate(ptr);
+    }
+#else
+    //allocated from the current thread's arena when one is active
+    static void* operator new(size_t size) {
+        void* memory = arena_allocate(size);
+        detail::widget_object_bytes() += size;
+        return memory;
+    }
+    static void operator delete(void* ptr, size_t size) noexcept {
+        detail::widget_object_bytes() -= size;
+        arena_deallocate(ptr, size);
+    }
+#endif
 
     virtual std::string getType() const = 0;
 
-    const MyWeakPtr<Widget>& getParent() const {
+protected:
+    //called by removeChild after child left this widget
+    virtual void onChildRemoved(Widget* /*child*/) {}
+
+    //reports a property change to the active mutation feed
+    void notifyPropertyChanged(const std::string& key, const void* data, size_t size) {
+        if (MutationFeed* feed = MutationFeed::active())
+            feed->propertyChanged(this, key, data, size);
+    }
+
+public:
+    //type specific state for snapshots, empty by default
+    virtual void writeState(std::vector<char>& /*out*/) const {}
+    virtual void readState(const char* /*data*/, size_t /*size*/) {}
+
+    const WidgetParentRef& getParent() const {
         return parent;
     }
 
+    Widget* getOwner() const noexcept {
+        return owner.load(std::memory_order_acquire);
+    }
+
+    //consistent copy of the properties, safe from any thread and never blocks
+    WidgetProperties getProperties() const noexcept {
+        return properties.load();
+    }
+    //UI thread only
+    void setProperties(const WidgetProperties& value) {
+        properties.store(value);
+        notifyPropertyChanged("properties", &value, sizeof(value));
+    }
+
     void addChild(Widget* child) {
+        child->owner.store(this, std::memory_order_release);
         children.emplace_back(std::move(child));
+        if (MutationFeed* feed = MutationFeed::active())
+            feed->childAdded(this, child);
     }
 
-    const std::vector<MyUniquePtr<Widget>>& getChildren() const {
+    //detaches child and hands its ownership to the caller, empty if child is not ours
+    MyUniquePtr<Widget> removeChild(Widget* child) {
+        for (size_t i = 0; i < children.size(); ++i) {
+            if (children[i].get() != child)
+                continue;
+            MyUniquePtr<Widget> removed(children[i].release());
+            children.erase(children.begin() + i);
+            child->owner.store(nullptr, std::memory_order_release);
+            if (MutationFeed* feed = MutationFeed::active())
+                feed->childRemoved(this, child);
+            onChildRemoved(child);
+            return removed;
+        }
+        return MyUniquePtr<Widget>();
+    }
+
+    const std::vector<WidgetChildPtr>& getChildren() const {
         return children;
     }
+
+    //heap memory the widget owns besides its own object, for memory accounting; widgets with
+    //containers of their own add them to the value of their base class
+    virtual size_t heapBytes() const noexcept {
+        return children.capacity() * sizeof(WidgetChildPtr);
+    }
+    //heapBytes() of this widget and everything below it
+    size_t subtreeHeapBytes() const noexcept {
+        size_t bytes = 0;
+        std::vector<const Widget*> stack{ this };
+        while (!stack.empty()) {
+            const Widget* widget = stack.back();
+            stack.pop_back();
+            bytes += widget->heapBytes();
+            for (const auto& child : widget->getChildren())
+                stack.push_back(child.get());
+        }
+        return bytes;
+    }
+
+    //runs build on this thread and measures what its result takes: the widget objects allocated
+    //meanwhile plus the heap bytes the widgets report, or the growth of the current arena if that
+    //is larger because a widget keeps unreported objects there. only counters of this thread and
+    //its arena are read, allocations of other threads do not end up in the result
+    template<typename F>
+    static MyUniquePtr<Widget> buildMeasured(F&& build, size_t& bytes) {
+        size_t objects = detail::widget_object_bytes();
+        HugePageArena* arena = detail::current_arena();
+        size_t live = arena ? arena->liveBytes() : 0;
+        MyUniquePtr<Widget> content = build();
+        bytes = 0;
+        if (content) {
+            size_t grown = arena ? arena->liveBytes() : 0;
+            bytes = std::max(detail::widget_object_bytes() - objects + content->subtreeHeapBytes(),
+                grown > live ? grown - live : 0);
+        }
+        return content;
+    }
 };
 
 class TabWidget : public Widget {
 public:
+    //creates the content of one tab; may run on a worker thread with the mutation feed suppressed,
+    //so it must only build the new subtree and not touch the live tree
+    using ContentBuilder = std::function<MyUniquePtr<Widget>()>;
+    static constexpr size_t NO_TAB = static_cast<size_t>(-1);
+
+private:
+    struct Tab
+    {
+        std::string title;
+        ContentBuilder build;
+        Widget* content = nullptr;          //child holding the built content
+        MyUniquePtr<HugePageArena> arena;   //arena the content was built in, if any, retired with it
+        size_t bytes = 0;                   //memory the content took when it was built
+        uint64_t lastActive = 0;            //activation count when the tab was last activated
+    };
+    std::vector<Tab> tabs;
+    mutable std::vector<uint32_t> titleIds; //titles interned in the last cache measured with
+    mutable uint64_t titleGeneration = 0;   //generation of the cache the ids belong to, 0 for none
+    size_t active = NO_TAB;
+    uint64_t activations = 0;
+
+    //attaches content; the feed reports the whole subtree, which was built while nobody recorded it
+    void attach(size_t index, Widget* content) {
+        addChild(content);
+        tabs[index].content = content;
+    }
+
+protected:
+    //content taken out with removeChild may outlive the TabWidget, so its arena goes with it
+    void onChildRemoved(Widget* child) override {
+        for (Tab& tab : tabs) {
+            if (tab.content != child)
+                continue;
+            tab.content = nullptr;
+            tab.bytes = 0;
+            HugePageArena::retire(tab.arena.release());
+        }
+    }
+
+public:
+    TabWidget() noexcept = default;
     TabWidget(const MySharedPtr<Widget>& parent) : Widget(parent) {};
+    //contents may live in arenas, so they go first; the arenas are retired rather than destroyed
+    //in case something allocated from them is still alive elsewhere
+    ~TabWidget() {
+        children.clear();
+        for (Tab& tab : tabs)
+            HugePageArena::retire(tab.arena.release());
+    }
     std::string getType() const override {
         return "TabWidget";
     }
+    size_t heapBytes() const noexcept override {
+        size_t bytes = Widget::heapBytes() + tabs.capacity() * sizeof(Tab) + titleIds.capacity() * sizeof(uint32_t);
+        for (const Tab& tab : tabs)
+            bytes += tab.title.capacity();
+        return bytes;
+    }
+
+    //appends a tab whose content is built on first activation; returns its index
+    size_t addTab(std::string title, ContentBuilder build) {
+        titleGeneration = 0;
+        tabs.emplace_back();
+        tabs.back().title = std::move(title);
+        tabs.back().build = std::move(build);
+        return tabs.size() - 1;
+    }
+    void setTabTitle(size_t index, std::string title) {
+        titleGeneration = 0;
+        tabs[index].title = std::move(title);
+    }
+
+    size_t tabCount() const noexcept {
+        return tabs.size();
+    }
+    size_t activeTab() const noexcept {
+        return active;
+    }
+    const std::string& tabTitle(size_t index) const {
+        return tabs[index].title;
+    }
+    const ContentBuilder& tabBuilder(size_t index) const {
+        return tabs[index].build;
+    }
+    //metrics of every title for laying out the tab strip, shaping only titles the cache lacks; the
+    //titles are interned again only when they changed or the cache started a new generation
+    void measureTitles(TextShapingCache& cache, const FontKey& font, std::vector<TextMetrics>& out) const {
+        if (titleGeneration != cache.generation()) {
+            titleIds.clear();
+            for (const Tab& tab : tabs)
+                titleIds.push_back(cache.intern(tab.title));
+            titleGeneration = cache.generation();
+        }
+        out.resize(titleIds.size());
+        cache.measure(titleIds.data(), titleIds.size(), font, out.data());
+    }
+    bool isBuilt(size_t index) const {
+        return tabs[index].content != nullptr;
+    }
+    Widget* tabContent(size_t index) const {
+        return tabs[index].content;
+    }
+
+    //installs content built elsewhere in one step, arena is the arena it was allocated from if any
+    //and bytes the memory it takes as measured by Widget::buildMeasured, 0 to take the arena's live
+    //bytes; false if the tab already has content, content and arena then stay with the caller
+    bool install(size_t index, MyUniquePtr<Widget>& content, MyUniquePtr<HugePageArena>& arena, size_t bytes = 0) {
+        if (tabs[index].content || !content)
+            return false;
+        tabs[index].bytes = bytes ? bytes : arena ? arena->liveBytes() : 0;
+        tabs[index].arena = std::move(arena);
+        attach(index, content.release());
+        return true;
+    }
+
+    //makes index the active tab, building its content on this thread unless it is already there
+    Widget* activate(size_t index) {
+        if (!tabs[index].content) {
+            size_t bytes;
+            MyUniquePtr<Widget> content = buildMeasured(tabs[index].build, bytes);
+            if (content) {
+                tabs[index].bytes = bytes;
+                attach(index, content.release());
+            }
+        }
+        active = index;
+        tabs[index].lastActive = ++activations;
+        return tabs[index].content;
+    }
+
+    //destroys the content of an inactive tab, which is built again on its next activation;
+    //returns the bytes the content took
+    size_t unload(size_t index) {
+        Tab& tab = tabs[index];
+        if (!tab.content || index == active)
+            return 0;
+        size_t bytes = tab.bytes;
+        removeChild(tab.content).reset();
+        return bytes;
+    }
+    //unloads inactive tabs, least recently active first, until bytes were freed
+    size_t unloadInactive(size_t bytes) {
+        std::vector<std::pair<uint64_t, size_t>> order;
+        for (size_t i = 0; i < tabs.size(); ++i) {
+            if (tabs[i].content && i != active)
+                order.emplace_back(tabs[i].lastActive, i);
+        }
+        std::sort(order.begin(), order.end());
+        size_t freed = 0;
+        for (size_t i = 0; i < order.size() && freed < bytes; ++i)
+            freed += unload(order[i].second);
+        return freed;
+    }
+    //memory held by the contents of tabs other than the active one
+    size_t inactiveBytes() const noexcept {
+        size_t bytes = 0;
+        for (size_t i = 0; i < tabs.size(); ++i) {
+            if (tabs[i].content && i != active)
+                bytes += tabs[i].bytes;
+        }
+        return bytes;
+    }
+};
+
+//one calendar entry, its strings live in the text pool of the batch or calendar holding it
+struct CalendarEvent
+{
+    int64_t start = 0;          //seconds since the epoch, UTC
+    int64_t end = 0;
+    uint64_t summary = 0;       //offsets into the text pool
+    uint64_t uid = 0;
+    uint32_t summaryLength = 0;
+    uint32_t uidLength = 0;
+    bool allDay = false;
+};
+
+//events collected away from the widget and appended to it in one step
+struct CalendarEventBatch
+{
+    std::vector<CalendarEvent> events;
+    std::vector<char> text;
+
+    uint64_t addText(std::string_view value) {
+        uint64_t offset = text.size();
+        text.insert(text.end(), value.begin(), value.end());
+        return offset;
+    }
+    void clear() noexcept {
+        events.clear();
+        text.clear();
+    }
 };
 
 class CalendarWidget : public Widget {
+private:
+    std::vector<CalendarEvent> events;
+    std::vector<char> eventText;
+
 public:
+    CalendarWidget() noexcept = default;
     CalendarWidget(const MySharedPtr<Widget>& parent) : Widget(parent) {};
     std::string getType() const override {
         return "CalendarWidget";
     }
+    size_t heapBytes() const noexcept override {
+        return Widget::heapBytes() + events.capacity() * sizeof(CalendarEvent) + eventText.capacity();
+    }
+
+    //grid of the month containing the date property
+    MonthGrid monthGrid(int32_t firstWeekday = 1) const {
+        int64_t date = getProperties().date;
+        int64_t days = (date >= 0 ? date : date - 86399) / 86400;
+        int32_t year, month, day, weekday;
+        civil_from_days(static_cast<int32_t>(days), year, month, day, weekday);
+        return month_grid(year, month, firstWeekday);
+    }
+
+    //appends every event of batch, rebasing its strings into the calendar's pool
+    void addEvents(const CalendarEventBatch& batch) {
+        uint64_t base = eventText.size();
+        eventText.insert(eventText.end(), batch.text.begin(), batch.text.end());
+        events.reserve(events.size() + batch.events.size());
+        for (CalendarEvent event : batch.events) {
+            event.summary += base;
+            event.uid += base;
+            events.push_back(event);
+        }
+        uint64_t count = events.size();
+        notifyPropertyChanged("events", &count, sizeof(count));
+    }
+    void clearEvents() {
+        events.clear();
+        eventText.clear();
+        uint64_t count = 0;
+        notifyPropertyChanged("events", &count, sizeof(count));
+    }
+
+    size_t eventCount() const noexcept {
+        return events.size();
+    }
+    const CalendarEvent& event(size_t index) const {
+        return events[index];
+    }
+    std::string_view eventSummary(size_t index) const {
+        return std::string_view(eventText.data() + events[index].summary, events[index].summaryLength);
+    }
+    std::string_view eventUid(size_t index) const {
+        return std::string_view(eventText.data() + events[index].uid, events[index].uidLength);
+    }
 };
 
+//SubtreeLockManager and MutationFeed members that need the complete Widget
+inline std::atomic<SubtreeLockNode*>& SubtreeLockManager::nodesOf(const Widget* widget) noexcept {
+    return widget->lockNodes;
+}
+
+inline SubtreeLockManager::Observed SubtreeLockManager::observe(const Widget* widget) const noexcept {
+    Observed seen;
+    if (const SubtreeLockNode* n = find(widget)) {
+        uint64_t word = n->state.load(std::memory_order_acquire);
+        seen.stable = SubtreeLockNode::unwritten(word);
+        seen.target = word / SubtreeLockNode::VERSION;
+    }
+    for (const Widget* w = widget->getOwner(); w; w = w->getOwner()) {
+        seen.widgets += reinterpret_cast<uintptr_t>(w);
+        ++seen.depth;
+        if (const SubtreeLockNode* n = find(w)) {
+            seen.stable = seen.stable && (n->state.load(std::memory_order_acquire) & SubtreeLockNode::EXCLUSIVE) == 0;
+            seen.versions += n->selfVersion.load(std::memory_order_acquire);
+        }
+    }
+    return seen;
+}
+
+inline std::vector<const Widget*> SubtreeLockManager::chain(const Widget* widget) {
+    std::vector<const Widget*> widgets;
+    for (const Widget* w = widget; w; w = w->getOwner())
+        widgets.push_back(w);
+    std::reverse(widgets.begin(), widgets.end());
+    return widgets;
+}
+
+
+inline void MutationFeed::recordStart(NodeState& state, const Widget* parent) {
+    //ancestors that did not change this frame sit where they sat at frame start; the first one
+    //that did change recorded its own start position already
+    state.attachedAtStart = false;
+    for (const Widget* widget = parent; widget; widget = widget->getOwner()) {
+        state.startChain.push_back(widget);
+        if (widget == root) {
+            state.attachedAtStart = true;
+            return;
+        }
+        auto it = nodes.find(widget);
+        if (it != nodes.end() && it->second.structural) {
+            state.attachedAtStart = it->second.attachedAtStart;
+            if (state.attachedAtStart)
+                state.startChain.insert(state.startChain.end(), it->second.startChain.begin(), it->second.startChain.end());
+            break;
+        }
+    }
+    if (!state.attachedAtStart)
+        state.startChain.clear();
+}
+
+inline std::vector<uint8_t> MutationFeed::encode() {
+    std::lock_guard<std::mutex> lock(recordMutex);
+    std::vector<uint8_t> records;
+    uint64_t count = 0;
+
+    //depth below the root now, false when the widget is not in the tree
+    auto reachable = [this](const Widget* widget, size_t& depth) {
+        depth = 0;
+        for (; widget; widget = widget->getOwner(), ++depth) {
+            if (widget == root)
+                return true;
+        }
+        return false;
+    };
+
+    //nodes that were in the tree at frame start and are not anymore
+    std::unordered_set<const Widget*> removed;
+    for (const Removal& removal : pendingRemovals)
+        removed.insert(removal.node);
+    std::vector<std::pair<size_t, std::pair<uint64_t, const Widget*>>> attached;
+    for (const auto& entry : nodes) {
+        const NodeState& state = entry.second;
+        if (!state.structural)
+            continue;
+        size_t depth;
+        if (reachable(entry.first, depth))
+            attached.push_back({ depth, { state.sequence, entry.first } });
+        else if (state.attachedAtStart)
+            removed.insert(entry.first);
+    }
+    auto underRemoved = [&removed](const std::vector<const Widget*>& startChain) {
+        for (const Widget* ancestor : startChain) {
+            if (removed.count(ancestor))
+                return true;
+        }
+        return false;
+    };
+
+    //removals, leaving out nodes that go with a removed ancestor
+    auto putRemoved = [&](const Widget* widget, const std::vector<const Widget*>& startChain) {
+        if (underRemoved(startChain))
+            return;
+        records.push_back(static_cast<uint8_t>(MutationKind::Removed));
+        putVarint(records, id(widget));
+        putVarint(records, id(startChain.empty() ? nullptr : startChain.front()));
+        ++count;
+    };
+    for (const Removal& removal : pendingRemovals)
+        putRemoved(removal.node, removal.startChain);
+    for (const auto& entry : nodes) {
+        if (entry.second.structural && entry.second.attachedAtStart && removed.count(entry.first))
+            putRemoved(entry.first, entry.second.startChain);
+    }
+
+    //additions and moves, parents first and siblings in append order. a node the mirror still has
+    //after the removals is moved with its subtree, any other node is added together with every
+    //descendant the mirror cannot have seen
+    std::sort(attached.begin(), attached.end());
+    std::unordered_set<const Widget*> emitted;
+    auto inMirror = [&](const Widget* widget) -> const NodeState* {
+        auto it = nodes.find(widget);
+        if (it == nodes.end() || !it->second.structural || !it->second.attachedAtStart || underRemoved(it->second.startChain))
+            return nullptr;
+        return &it->second;
+    };
+    std::vector<const Widget*> stack;
+    for (const auto& entry : attached) {
+        if (emitted.count(entry.second.second))
+            continue;
+        stack.assign(1, entry.second.second);
+        while (!stack.empty()) {
+            const Widget* widget = stack.back();
+            stack.pop_back();
+            emitted.insert(widget);
+            if (const NodeState* state = inMirror(widget)) {
+                records.push_back(static_cast<uint8_t>(MutationKind::Reparented));
+                putVarint(records, id(widget));
+                putVarint(records, id(state->startChain.front()));
+                putVarint(records, id(widget->getOwner()));
+                ++count;
+                continue;
+            }
+            std::string type = widget->getType();
+            records.push_back(static_cast<uint8_t>(MutationKind::Added));
+            putVarint(records, id(widget));
+            putVarint(records, id(widget->getOwner()));
+            putBytes(records, type.data(), type.size());
+            ++count;
+            const auto& children = widget->getChildren();
+            for (size_t i = children.size(); i-- > 0;)
+                stack.push_back(children[i].get());
+        }
+    }
+
+    for (const auto& entry : nodes) {
+        size_t depth;
+        if (entry.second.properties.empty() || !reachable(entry.first, depth))
+            continue;
+        for (const auto& property : entry.second.properties) {
+            records.push_back(static_cast<uint8_t>(MutationKind::Property));
+            putVarint(records, id(entry.first));
+            putBytes(records, property.first.data(), property.first.size());
+            putBytes(records, property.second.data(), property.second.size());
+            ++count;
+        }
+    }
+    nodes.clear();
+    pendingRemovals.clear();
+
+    std::vector<uint8_t> batch;
+    batch.reserve(records.size() + 10);
+    putVarint(batch, count);
+    batch.insert(batch.end(), records.begin(), records.end());
+    return batch;
+}
+
 #endif 
\ No newline at end of file
@@ -0,0 +1,309 @@
+#ifndef _ANIMATION_H_
+#define _ANIMATION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "Widget.h"
+
+enum class Easing : int32_t
+{
+    Linear = 0,
+    EaseIn = 1,         //quadratic
+    EaseOut = 2,        //quadratic
+    EaseInOut = 3       //quadratic in, quadratic out
+};
+
+//animatable fields of WidgetProperties
+enum class AnimatedProperty : uint8_t
+{
+    X = 0,
+    Y = 1,
+    Width = 2,
+    Height = 3
+};
+
+//stable handle of a track, stays valid until the track finishes or is cancelled
+struct AnimationHandle
+{
+    uint32_t index;
+    uint32_t generation;
+};
+
+//active property animations stored as structure of arrays, evaluated in SIMD batches and written
+//back through Widget::setProperties, one SeqLocked store per animated widget and frame, so worker
+//threads reading the properties never see a half written frame. UI thread only
+class AnimationSystem
+{
+private:
+    static constexpr uint32_t NONE = 0xffffffffu;
+
+    //a widget with running tracks and the properties being assembled for it this frame
+    struct Target
+    {
+        Widget* widget;
+        uint32_t tracks;
+        uint64_t frame;
+        WidgetProperties pending;
+    };
+
+    //dense track arrays, index i of each describes one track
+    std::vector<float> from;
+    std::vector<float> delta;           //to - from
+    std::vector<float> start;
+    std::vector<float> end;             //start + duration, the track finishes at end
+    std::vector<float> invDuration;
+    std::vector<int32_t> easing;
+    std::vector<uint32_t> targetOf;     //dense index to target index
+    std::vector<AnimatedProperty> field;
+    std::vector<uint32_t> handleOf;     //dense index to handle index
+
+    std::vector<Target> targets;
+    std::vector<uint32_t> freeTargets;
+    std::unordered_map<const Widget*, uint32_t> targetIndex;
+    std::vector<uint32_t> touched;      //targets written this frame
+    uint64_t frame = 0;
+
+    //handle table
+    std::vector<uint32_t> denseOf;
+    std::vector<uint32_t> generations;
+    std::vector<uint32_t> freeHandles;
+
+    std::vector<float> values;          //per frame results
+    std::vector<uint8_t> finished;
+
+    static float& fieldOf(WidgetProperties& properties, AnimatedProperty which) noexcept {
+        switch (which) {
+        case AnimatedProperty::Y:
+            return properties.y;
+        case AnimatedProperty::Width:
+            return properties.width;
+        case AnimatedProperty::Height:
+            return properties.height;
+        default:
+            return properties.x;
+        }
+    }
+
+    uint32_t acquireTarget(Widget* widget) {
+        auto it = targetIndex.find(widget);
+        if (it != targetIndex.end()) {
+            ++targets[it->second].tracks;
+            return it->second;
+        }
+        uint32_t index;
+        if (!freeTargets.empty()) {
+            index = freeTargets.back();
+            freeTargets.pop_back();
+        }
+        else {
+            index = static_cast<uint32_t>(targets.size());
+            targets.emplace_back();
+        }
+        targets[index] = Target{ widget, 1, 0, WidgetProperties() };
+        targetIndex.emplace(widget, index);
+        return index;
+    }
+    void releaseTarget(uint32_t index) {
+        if (--targets[index].tracks != 0)
+            return;
+        targetIndex.erase(targets[index].widget);
+        targets[index].widget = nullptr;
+        freeTargets.push_back(index);
+    }
+
+    //swaps the last track into slot i
+    void removeDense(uint32_t i) {
+        uint32_t last = static_cast<uint32_t>(from.size() - 1);
+        uint32_t handle = handleOf[i];
+        releaseTarget(targetOf[i]);
+        if (i != last) {
+            from[i] = from[last];
+            delta[i] = delta[last];
+            start[i] = start[last];
+            end[i] = end[last];
+            invDuration[i] = invDuration[last];
+            easing[i] = easing[last];
+            targetOf[i] = targetOf[last];
+            field[i] = field[last];
+            handleOf[i] = handleOf[last];
+            denseOf[handleOf[i]] = i;
+        }
+        from.pop_back();
+        delta.pop_back();
+        start.pop_back();
+        end.pop_back();
+        invDuration.pop_back();
+        easing.pop_back();
+        targetOf.pop_back();
+        field.pop_back();
+        handleOf.pop_back();
+        denseOf[handle] = NONE;
+        ++generations[handle];
+        freeHandles.push_back(handle);
+    }
+
+    static float easeScalar(float t, int32_t kind) noexcept {
+        switch (static_cast<Easing>(kind)) {
+        case Easing::EaseIn:
+            return t * t;
+        case Easing::EaseOut:
+            return t * (2.0f - t);
+        case Easing::EaseInOut:
+            return t < 0.5f ? 2.0f * t * t : -1.0f + (4.0f - 2.0f * t) * t;
+        default:
+            return t;
+        }
+    }
+
+    //evaluates tracks [i, count) into values and finished; a track at or past its end gets its
+    //final value, which also finishes zero length tracks in the frame they start
+    void evaluate(size_t i, size_t count, float now) noexcept {
+#if defined(__AVX2__)
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 two = _mm256_set1_ps(2.0f);
+        const __m256 four = _mm256_set1_ps(4.0f);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 nowVec = _mm256_set1_ps(now);
+        for (; i + 8 <= count; i += 8) {
+            __m256 raw = _mm256_mul_ps(_mm256_sub_ps(nowVec, _mm256_loadu_ps(&start[i])), _mm256_loadu_ps(&invDuration[i]));
+            __m256 done = _mm256_cmp_ps(nowVec, _mm256_loadu_ps(&end[i]), _CMP_GE_OQ);
+            __m256 t = _mm256_blendv_ps(_mm256_min_ps(_mm256_max_ps(raw, zero), one), one, done);
+            __m256i kind = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&easing[i]));
+            __m256 easeIn = _mm256_mul_ps(t, t);
+            __m256 easeOut = _mm256_mul_ps(t, _mm256_sub_ps(two, t));
+            __m256 inOutLow = _mm256_mul_ps(two, easeIn);
+            __m256 inOutHigh = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(four, _mm256_mul_ps(two, t)), t), one);
+            __m256 inOut = _mm256_blendv_ps(inOutHigh, inOutLow, _mm256_cmp_ps(t, half, _CMP_LT_OQ));
+            __m256 eased = t;
+            eased = _mm256_blendv_ps(eased, easeIn, _mm256_castsi256_ps(_mm256_cmpeq_epi32(kind, _mm256_set1_epi32(1))));
+            eased = _mm256_blendv_ps(eased, easeOut, _mm256_castsi256_ps(_mm256_cmpeq_epi32(kind, _mm256_set1_epi32(2))));
+            eased = _mm256_blendv_ps(eased, inOut, _mm256_castsi256_ps(_mm256_cmpeq_epi32(kind, _mm256_set1_epi32(3))));
+            __m256 value = _mm256_add_ps(_mm256_loadu_ps(&from[i]), _mm256_mul_ps(_mm256_loadu_ps(&delta[i]), eased));
+            _mm256_storeu_ps(&values[i], value);
+            unsigned doneBits = static_cast<unsigned>(_mm256_movemask_ps(done));
+            for (unsigned lane = 0; lane < 8; ++lane)
+                finished[i + lane] = (doneBits >> lane) & 1;
+        }
+#elif defined(__SSE2__)
+        //blends written as and/andnot/or so plain SSE2 is enough
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 two = _mm_set1_ps(2.0f);
+        const __m128 four = _mm_set1_ps(4.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 nowVec = _mm_set1_ps(now);
+        auto select = [](__m128 mask, __m128 a, __m128 b) {
+            return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+        };
+        for (; i + 4 <= count; i += 4) {
+            __m128 raw = _mm_mul_ps(_mm_sub_ps(nowVec, _mm_loadu_ps(&start[i])), _mm_loadu_ps(&invDuration[i]));
+            __m128 done = _mm_cmpge_ps(nowVec, _mm_loadu_ps(&end[i]));
+            __m128 t = select(done, one, _mm_min_ps(_mm_max_ps(raw, zero), one));
+            __m128i kind = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&easing[i]));
+            __m128 easeIn = _mm_mul_ps(t, t);
+            __m128 easeOut = _mm_mul_ps(t, _mm_sub_ps(two, t));
+            __m128 inOutLow = _mm_mul_ps(two, easeIn);
+            __m128 inOutHigh = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(four, _mm_mul_ps(two, t)), t), one);
+            __m128 inOut = select(_mm_cmplt_ps(t, half), inOutLow, inOutHigh);
+            __m128 eased = t;
+            eased = select(_mm_castsi128_ps(_mm_cmpeq_epi32(kind, _mm_set1_epi32(1))), easeIn, eased);
+            eased = select(_mm_castsi128_ps(_mm_cmpeq_epi32(kind, _mm_set1_epi32(2))), easeOut, eased);
+            eased = select(_mm_castsi128_ps(_mm_cmpeq_epi32(kind, _mm_set1_epi32(3))), inOut, eased);
+            __m128 value = _mm_add_ps(_mm_loadu_ps(&from[i]), _mm_mul_ps(_mm_loadu_ps(&delta[i]), eased));
+            _mm_storeu_ps(&values[i], value);
+            unsigned doneBits = static_cast<unsigned>(_mm_movemask_ps(done));
+            for (unsigned lane = 0; lane < 4; ++lane)
+                finished[i + lane] = (doneBits >> lane) & 1;
+        }
+#endif
+        for (; i < count; ++i) {
+            float raw = (now - start[i]) * invDuration[i];
+            bool done = now >= end[i];
+            float t = done ? 1.0f : (raw < 0.0f ? 0.0f : (raw > 1.0f ? 1.0f : raw));
+            values[i] = from[i] + delta[i] * easeScalar(t, easing[i]);
+            finished[i] = done;
+        }
+    }
+
+public:
+    AnimationSystem() = default;
+    AnimationSystem(const AnimationSystem& other) = delete;
+    AnimationSystem& operator=(const AnimationSystem& other) = delete;
+
+    //animates one property of widget from fromValue to toValue, the widget must outlive the track
+    AnimationHandle add(Widget* widget, AnimatedProperty property, float fromValue, float toValue, float startTime, float duration,
+        Easing curve = Easing::Linear) {
+        uint32_t handle;
+        if (!freeHandles.empty()) {
+            handle = freeHandles.back();
+            freeHandles.pop_back();
+        }
+        else {
+            handle = static_cast<uint32_t>(denseOf.size());
+            denseOf.push_back(NONE);
+            generations.push_back(0);
+        }
+        denseOf[handle] = static_cast<uint32_t>(from.size());
+        from.push_back(fromValue);
+        delta.push_back(toValue - fromValue);
+        start.push_back(startTime);
+        end.push_back(duration > 0.0f ? startTime + duration : startTime);
+        invDuration.push_back(duration > 0.0f ? 1.0f / duration : 1e30f);
+        easing.push_back(static_cast<int32_t>(curve));
+        targetOf.push_back(acquireTarget(widget));
+        field.push_back(property);
+        handleOf.push_back(handle);
+        return AnimationHandle{ handle, generations[handle] };
+    }
+
+    bool isActive(AnimationHandle handle) const noexcept {
+        return handle.index < denseOf.size() && generations[handle.index] == handle.generation && denseOf[handle.index] != NONE;
+    }
+
+    //stops a track in O(1), the property keeps its last written value
+    void cancel(AnimationHandle handle) {
+        if (isActive(handle))
+            removeDense(denseOf[handle.index]);
+    }
+
+    //evaluates every track at now, writes the results to their widgets and drops finished tracks;
+    //returns the number of tracks still running
+    size_t update(float now) {
+        size_t count = from.size();
+        values.resize(count);
+        finished.resize(count);
+        evaluate(0, count, now);
+        ++frame;
+        touched.clear();
+        for (size_t i = 0; i < count; ++i) {
+            Target& target = targets[targetOf[i]];
+            if (target.frame != frame) {
+                target.frame = frame;
+                target.pending = target.widget->getProperties();
+                touched.push_back(targetOf[i]);
+            }
+            fieldOf(target.pending, field[i]) = values[i];
+        }
+        for (uint32_t index : touched)
+            targets[index].widget->setProperties(targets[index].pending);
+        for (size_t i = count; i-- > 0;) {
+            if (finished[i])
+                removeDense(static_cast<uint32_t>(i));
+        }
+        return from.size();
+    }
+
+    size_t size() const noexcept {
+        return from.size();
+    }
+};
+
+#endif
@@ -0,0 +1,420 @@
+#ifndef _ARCHIVE_H_
+#define _ARCHIVE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "memory.h"
+
+//sharing preserving serialisation of object graphs held by MySharedPtr, MyWeakPtr and MyUniquePtr.
+//a shared object is written once, at the first strong pointer reaching it, and every other pointer
+//to the same control block is written as a reference, so loading rebuilds exactly one control block
+//per object, cycles included. a weak pointer to an object loaded before it is linked right away,
+//one to an object loaded later is linked by finish(); one whose object was not reached by any
+//archived strong pointer loads expired.
+//
+//types take part through one member used in both directions:
+//    template<typename Archive> void serialize(Archive& archive) { archive(a, b, children); }
+//objects are created with new T() while loading, so archived types need a default constructor, and
+//pointers are archived by their static type
+
+namespace detail
+{
+    constexpr uint32_t archive_magic = 0x4352414d;     //"MARC"
+    constexpr uint32_t archive_version = 1;
+
+    //open addressing map from control block address to object id
+    class ArchiveIdMap
+    {
+    private:
+        struct Slot
+        {
+            uintptr_t key;
+            uint32_t id;
+            bool written;
+        };
+        std::vector<Slot> slots;
+        size_t count = 0;
+
+        static size_t hash(uintptr_t key) noexcept {
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdull;
+            key ^= key >> 33;
+            return static_cast<size_t>(key);
+        }
+        void grow() {
+            std::vector<Slot> old = std::move(slots);
+            slots.assign(old.empty() ? 64 : old.size() * 2, Slot{ 0, 0, false });
+            count = 0;
+            for (const Slot& slot : old) {
+                if (slot.key)
+                    *find(slot.key, true) = slot;
+            }
+        }
+
+    public:
+        //slot of key, inserted with key set when insert is true, nullptr if absent otherwise
+        Slot* find(uintptr_t key, bool insert) {
+            if (insert && (count + 1) * 4 > slots.size() * 3)
+                grow();
+            if (slots.empty())
+                return nullptr;
+            size_t mask = slots.size() - 1;
+            for (size_t i = hash(key) & mask;; i = (i + 1) & mask) {
+                if (slots[i].key == key)
+                    return &slots[i];
+                if (!slots[i].key) {
+                    if (!insert)
+                        return nullptr;
+                    slots[i].key = key;
+                    ++count;
+                    return &slots[i];
+                }
+            }
+        }
+        size_t size() const noexcept {
+            return count;
+        }
+    };
+
+    class ArchiveBufferWriter
+    {
+    private:
+        std::vector<char>& out;
+    public:
+        explicit ArchiveBufferWriter(std::vector<char>& out) noexcept : out(out) {};
+        void write(const void* data, size_t size) {
+            const char* bytes = static_cast<const char*>(data);
+            out.insert(out.end(), bytes, bytes + size);
+        }
+    };
+
+    class ArchiveStreamWriter
+    {
+    private:
+        std::ostream& out;
+    public:
+        explicit ArchiveStreamWriter(std::ostream& out) noexcept : out(out) {};
+        void write(const void* data, size_t size) {
+            if (!out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size)))
+                throw std::runtime_error("archive: write failed");
+        }
+    };
+
+    class ArchiveBufferReader
+    {
+    private:
+        const char* cursor;
+        const char* end;
+    public:
+        ArchiveBufferReader(const std::vector<char>& in) noexcept : cursor(in.data()), end(in.data() + in.size()) {};
+        ArchiveBufferReader(const char* data, size_t size) noexcept : cursor(data), end(data + size) {};
+        void read(void* data, size_t size) {
+            if (static_cast<size_t>(end - cursor) < size)
+                throw std::runtime_error("archive: truncated");
+            std::memcpy(data, cursor, size);
+            cursor += size;
+        }
+    };
+
+    class ArchiveStreamReader
+    {
+    private:
+        std::istream& in;
+    public:
+        explicit ArchiveStreamReader(std::istream& in) noexcept : in(in) {};
+        void read(void* data, size_t size) {
+            if (!in.read(static_cast<char*>(data), static_cast<std::streamsize>(size)))
+                throw std::runtime_error("archive: truncated");
+        }
+    };
+
+    template<typename T, typename = void>
+    struct has_serialize : std::false_type {};
+    template<typename T>
+    struct has_serialize<T, std::void_t<decltype(std::declval<T&>().serialize(std::declval<int&>()))>> : std::true_type {};
+} // namespace detail
+
+template<typename Writer>
+class OutputArchive
+{
+private:
+    Writer writer;
+    detail::ArchiveIdMap ids;
+    uint32_t nextId = 0;
+
+    void putVarint(uint64_t value) {
+        char bytes[10];
+        size_t size = 0;
+        while (value >= 0x80) {
+            bytes[size++] = static_cast<char>(value | 0x80);
+            value >>= 7;
+        }
+        bytes[size++] = static_cast<char>(value);
+        writer.write(bytes, size);
+    }
+
+    template<typename T>
+    std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value> save(const T& value) {
+        writer.write(&value, sizeof(T));
+    }
+    void save(const std::string& value) {
+        putVarint(value.size());
+        writer.write(value.data(), value.size());
+    }
+    template<typename T>
+    void save(const std::vector<T>& values) {
+        putVarint(values.size());
+        for (const T& value : values)
+            save(value);
+    }
+    template<typename T>
+    std::enable_if_t<detail::has_serialize<T>::value> save(const T& value) {
+        const_cast<T&>(value).serialize(*this);
+    }
+
+    //strong pointers: 0 for null, id * 2 + 1 followed by the object the first time, id * 2 + 2 after
+    template<typename T>
+    void save(const MySharedPtr<T>& pointer) {
+        if (!pointer.get()) {
+            putVarint(0);
+            return;
+        }
+        uint32_t id;
+        bool first;
+        {
+            auto* slot = ids.find(reinterpret_cast<uintptr_t>(pointer.getCB()), true);
+            if (slot->id == 0)
+                slot->id = ++nextId;
+            id = slot->id;
+            first = !slot->written;
+            slot->written = true;
+        }
+        if (!first) {
+            putVarint(static_cast<uint64_t>(id) * 2 + 2);
+            return;
+        }
+        putVarint(static_cast<uint64_t>(id) * 2 + 1);
+        save(*pointer);
+    }
+    //weak pointers: 0 for empty or expired, otherwise the id
+    template<typename T>
+    void save(const MyWeakPtr<T>& pointer) {
+        if (pointer.expired()) {
+            putVarint(0);
+            return;
+        }
+        auto* slot = ids.find(reinterpret_cast<uintptr_t>(pointer.getCB()), true);
+        if (slot->id == 0)
+            slot->id = ++nextId;
+        putVarint(slot->id);
+    }
+    //unique pointers own their object, no identity is tracked
+    template<typename T>
+    void save(const MyUniquePtr<T>& pointer) {
+        putVarint(pointer ? 1 : 0);
+        if (pointer)
+            save(*pointer);
+    }
+
+public:
+    template<typename Target>
+    explicit OutputArchive(Target& target) : writer(target) {
+        uint32_t header[2] = { detail::archive_magic, detail::archive_version };
+        writer.write(header, sizeof(header));
+    }
+
+    OutputArchive(const OutputArchive& other) = delete;
+    OutputArchive& operator=(const OutputArchive& other) = delete;
+
+    template<typename... Ts>
+    void operator()(const Ts&... values) {
+        (save(values), ...);
+    }
+
+    //distinct shared objects seen so far
+    size_t objectCount() const noexcept {
+        return nextId;
+    }
+};
+
+template<typename Reader>
+class InputArchive
+{
+private:
+    //one strong reference per loaded object keeps it alive until weak pointers are resolved
+    struct Object
+    {
+        void* shared = nullptr;             //MySharedPtr<T>*
+        void (*destroy)(void*) = nullptr;
+    };
+    struct WeakFixup
+    {
+        uint32_t id;
+        void* target;                       //MyWeakPtr<T>*
+        void (*assign)(void* target, void* shared);
+    };
+
+    Reader reader;
+    std::vector<Object> objects;            //by id - 1
+    std::vector<WeakFixup> fixups;          //weak pointers to objects not loaded yet when they were read
+
+    void release() noexcept {
+        for (Object& object : objects) {
+            if (object.shared)
+                object.destroy(object.shared);
+        }
+        objects.clear();
+    }
+
+    uint64_t getVarint() {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            unsigned char byte;
+            reader.read(&byte, 1);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw std::runtime_error("archive: bad varint");
+    }
+    size_t getSize() {
+        uint64_t size = getVarint();
+        if (size > (uint64_t(1) << 40))
+            throw std::runtime_error("archive: bad size");
+        return static_cast<size_t>(size);
+    }
+    //ids are handed out densely while saving, so a new one is at most one past the highest seen
+    Object& objectAt(uint64_t id) {
+        if (id == 0 || id > objects.size() + 1)
+            throw std::runtime_error("archive: bad object id");
+        if (id == objects.size() + 1)
+            objects.emplace_back();
+        return objects[static_cast<size_t>(id - 1)];
+    }
+
+    template<typename T>
+    std::enable_if_t<std::is_arithmetic<T>::value || std::is_enum<T>::value> load(T& value) {
+        reader.read(&value, sizeof(T));
+    }
+    void load(std::string& value) {
+        value.resize(getSize());
+        if (!value.empty())
+            reader.read(&value[0], value.size());
+    }
+    //sized up front and loaded in place, weak pointers inside the elements wait for finish() at
+    //their final address
+    template<typename T>
+    void load(std::vector<T>& values) {
+        size_t size = getSize();
+        values.clear();
+        values.resize(size);
+        for (T& value : values)
+            load(value);
+    }
+    template<typename T>
+    std::enable_if_t<detail::has_serialize<T>::value> load(T& value) {
+        value.serialize(*this);
+    }
+
+    //pointers are reset first, so whatever the default constructor put there is released
+    template<typename T>
+    void load(MySharedPtr<T>& pointer) {
+        pointer.reset();
+        uint64_t tag = getVarint();
+        if (tag == 0)
+            return;
+        Object& object = objectAt((tag - 1) / 2);
+        if (tag % 2 == 0) {
+            if (!object.shared)
+                throw std::runtime_error("archive: reference to an object not loaded yet");
+            pointer = *static_cast<MySharedPtr<T>*>(object.shared);
+            return;
+        }
+        if (object.shared)
+            throw std::runtime_error("archive: object defined twice");
+        //registered before its contents are loaded so cycles back to it resolve
+        MySharedPtr<T>* shared = new MySharedPtr<T>(new T());
+        object.shared = shared;
+        object.destroy = [](void* held) { delete static_cast<MySharedPtr<T>*>(held); };
+        pointer = *shared;
+        load(*pointer);
+    }
+    template<typename T>
+    void load(MyWeakPtr<T>& pointer) {
+        pointer.reset();
+        uint64_t id = getVarint();
+        if (id == 0)
+            return;
+        if (const Object& object = objectAt(id); object.shared) {
+            pointer = *static_cast<MySharedPtr<T>*>(object.shared);
+            return;
+        }
+        fixups.push_back(WeakFixup{ static_cast<uint32_t>(id), &pointer, [](void* target, void* shared) {
+            MyWeakPtr<T>& weak = *static_cast<MyWeakPtr<T>*>(target);
+            weak.reset();
+            weak = *static_cast<MySharedPtr<T>*>(shared);
+        } });
+    }
+    template<typename T>
+    void load(MyUniquePtr<T>& pointer) {
+        if (getVarint() == 0) {
+            pointer.reset();
+            return;
+        }
+        pointer.reset(new T());
+        load(*pointer);
+    }
+
+public:
+    template<typename Source>
+    explicit InputArchive(Source& source) : reader(source) {
+        uint32_t header[2];
+        reader.read(header, sizeof(header));
+        if (header[0] != detail::archive_magic)
+            throw std::runtime_error("archive: bad magic");
+        if (header[1] != detail::archive_version)
+            throw std::runtime_error("archive: unsupported version");
+    }
+
+    InputArchive(const InputArchive& other) = delete;
+    InputArchive& operator=(const InputArchive& other) = delete;
+
+    //drops the archive's own references without linking pending weak pointers, their targets may
+    //already be gone; call finish() while the loaded values are still in place
+    ~InputArchive() {
+        fixups.clear();
+        release();
+    }
+
+    template<typename... Ts>
+    void operator()(Ts&... values) {
+        (load(values), ...);
+    }
+
+    //links the weak pointers to objects loaded after them and drops the archive's own references;
+    //the loaded values must not have moved since they were loaded
+    void finish() {
+        for (const WeakFixup& fixup : fixups) {
+            const Object& object = objects[fixup.id - 1];
+            if (object.shared)
+                fixup.assign(fixup.target, object.shared);
+        }
+        fixups.clear();
+        release();
+    }
+};
+
+using BinaryOutputArchive = OutputArchive<detail::ArchiveBufferWriter>;
+using StreamOutputArchive = OutputArchive<detail::ArchiveStreamWriter>;
+using BinaryInputArchive = InputArchive<detail::ArchiveBufferReader>;
+using StreamInputArchive = InputArchive<detail::ArchiveStreamReader>;
+
+#endif
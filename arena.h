@@ -0,0 +1,380 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "fork_locks.h"
+
+class HugePageArena;
+
+//arena region, one or more 2 MiB chunks reserved in a single mapping
+struct ArenaRegion
+{
+    HugePageArena* arena;
+    char* base;
+    size_t size;
+    size_t used;            //bump offset
+    size_t live;            //bytes held by live allocations
+    bool resident;          //false once the pages were handed back to the OS
+    std::chrono::steady_clock::time_point idleSince;    //when live dropped to zero
+};
+
+//two-level radix table mapping 2 MiB chunks to their region,
+//lets deallocation find the owning arena without locking
+class ArenaPageMap
+{
+private:
+    static constexpr size_t CHUNK_SHIFT = 21;
+    static constexpr size_t LEAF_BITS = 14;
+    static constexpr size_t ROOT_BITS = 48 - CHUNK_SHIFT - LEAF_BITS;
+
+    using Slot = std::atomic<ArenaRegion*>;
+
+    std::atomic<Slot*> root[size_t(1) << ROOT_BITS];
+    std::mutex growMutex;
+
+    ArenaPageMap() {
+        for (auto& leaf : root)
+            leaf.store(nullptr, std::memory_order_relaxed);
+        ForkLocks::instance().add(growMutex);
+    }
+public:
+    ArenaPageMap(const ArenaPageMap& other) = delete;
+    ArenaPageMap& operator=(const ArenaPageMap& other) = delete;
+
+    static ArenaPageMap& instance() {
+        static ArenaPageMap* map = new ArenaPageMap();    //never destroyed, widgets may outlive statics
+        return *map;
+    }
+
+    void assign(const void* chunk, ArenaRegion* region) {
+        uintptr_t index = reinterpret_cast<uintptr_t>(chunk) >> CHUNK_SHIFT;
+        size_t hi = index >> LEAF_BITS;
+        size_t lo = index & ((size_t(1) << LEAF_BITS) - 1);
+        Slot* leaf = root[hi].load(std::memory_order_acquire);
+        if (!leaf) {
+            std::lock_guard<std::mutex> lock(growMutex);
+            leaf = root[hi].load(std::memory_order_relaxed);
+            if (!leaf) {
+                leaf = new Slot[size_t(1) << LEAF_BITS]();
+                root[hi].store(leaf, std::memory_order_release);
+            }
+        }
+        leaf[lo].store(region, std::memory_order_release);
+    }
+
+    ArenaRegion* find(const void* ptr) const noexcept {
+        uintptr_t index = reinterpret_cast<uintptr_t>(ptr) >> CHUNK_SHIFT;
+        size_t hi = index >> LEAF_BITS;
+        if (hi >= (size_t(1) << ROOT_BITS))
+            return nullptr;
+        Slot* leaf = root[hi].load(std::memory_order_acquire);
+        if (!leaf)
+            return nullptr;
+        return leaf[index & ((size_t(1) << LEAF_BITS) - 1)].load(std::memory_order_acquire);
+    }
+};
+
+//arena reserving 2 MiB aligned regions advised with MADV_HUGEPAGE,
+//objects are bump allocated and a region is reused once all of its objects are freed
+class HugePageArena
+{
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+private:
+    std::deque<ArenaRegion> regions;        //deque keeps region addresses stable
+    std::vector<ArenaRegion*> emptyRegions;
+    ArenaRegion* current;
+    size_t regionSize;
+    size_t reserved;
+    size_t live;
+    bool retired;           //destroyed by the deallocation that frees the last object
+    mutable std::mutex mutex;
+    uint64_t forkHook;
+
+    static size_t alignUp(size_t value, size_t align) noexcept {
+        return (value + align - 1) & ~(align - 1);
+    }
+
+    //maps size bytes at a 2 MiB boundary by over-reserving and trimming both ends
+    static char* mapAligned(size_t size) noexcept {
+        size_t span = size + HUGE_PAGE_SIZE;
+        void* raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED)
+            return nullptr;
+        uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t aligned = alignUp(start, HUGE_PAGE_SIZE);
+        if (aligned != start)
+            munmap(raw, aligned - start);
+        if (span - (aligned - start) != size)
+            munmap(reinterpret_cast<void*>(aligned + size), span - (aligned - start) - size);
+#ifdef MADV_HUGEPAGE
+        madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+#endif
+        return reinterpret_cast<char*>(aligned);
+    }
+
+    ArenaRegion* newRegion(size_t size) {
+        char* base = mapAligned(size);
+        if (!base)
+            throw std::bad_alloc();
+        regions.push_back(ArenaRegion{ this, base, size, 0, 0, true, {} });
+        ArenaRegion* region = &regions.back();
+        for (size_t offset = 0; offset < size; offset += HUGE_PAGE_SIZE)
+            ArenaPageMap::instance().assign(base + offset, region);
+        reserved += size;
+        return region;
+    }
+
+    void* bump(ArenaRegion* region, size_t size, size_t align) noexcept {
+        size_t offset = alignUp(region->used, align);
+        if (offset + size > region->size)
+            return nullptr;
+        region->used = offset + size;
+        region->live += size;
+        region->resident = true;
+        live += size;
+        return region->base + offset;
+    }
+
+public:
+    //constructor and destructor
+    explicit HugePageArena(size_t regionSize = HUGE_PAGE_SIZE)
+        : current(nullptr), regionSize(alignUp(regionSize ? regionSize : HUGE_PAGE_SIZE, HUGE_PAGE_SIZE)), reserved(0), live(0), retired(false) {
+        //new regions are entered in the page map under this arena's lock, so the map registers first
+        ArenaPageMap::instance();
+        forkHook = ForkLocks::instance().add(mutex);
+    }
+
+    HugePageArena(const HugePageArena& other) = delete;
+    HugePageArena& operator=(const HugePageArena& other) = delete;
+    HugePageArena(HugePageArena&& other) = delete;
+    HugePageArena& operator=(HugePageArena&& other) = delete;
+
+    //the arena must outlive every object allocated from it, see retire() when it cannot
+    ~HugePageArena() {
+        ForkLocks::instance().remove(forkHook);
+        for (ArenaRegion& region : regions) {
+            for (size_t offset = 0; offset < region.size; offset += HUGE_PAGE_SIZE)
+                ArenaPageMap::instance().assign(region.base + offset, nullptr);
+            munmap(region.base, region.size);
+        }
+    }
+
+    //allocation
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        if (size == 0)
+            size = 1;
+        std::lock_guard<std::mutex> lock(mutex);
+        if (size + align > regionSize) {
+            ArenaRegion* region = newRegion(alignUp(size + align, HUGE_PAGE_SIZE));
+            return bump(region, size, align);
+        }
+        if (current) {
+            if (void* ptr = bump(current, size, align))
+                return ptr;
+        }
+        if (!emptyRegions.empty()) {
+            current = emptyRegions.back();
+            emptyRegions.pop_back();
+        }
+        else {
+            current = newRegion(regionSize);
+        }
+        return bump(current, size, align);
+    }
+
+    void deallocate(ArenaRegion* region, size_t size) noexcept {
+        if (size == 0)
+            size = 1;
+        bool last;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            region->live -= size;
+            live -= size;
+            last = retired && live == 0;
+            if (region->live == 0) {
+                region->used = 0;
+                region->idleSince = std::chrono::steady_clock::now();
+                if (region != current)
+                    emptyRegions.push_back(region);
+            }
+        }
+        if (last)
+            delete this;
+    }
+
+    //gives up ownership of a heap allocated arena whose objects may outlive the owner: it is
+    //destroyed right away when no object is left, otherwise by the deallocation of the last one.
+    //nothing may be allocated from it afterwards
+    static void retire(HugePageArena* arena) noexcept {
+        if (!arena)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(arena->mutex);
+            if (arena->live != 0) {
+                arena->retired = true;
+                return;
+            }
+        }
+        delete arena;
+    }
+
+    //returns fully free regions idle for at least minIdle to the OS with MADV_DONTNEED,
+    //stops once maxBytes were released; the address range stays reserved for reuse
+    size_t trim(size_t maxBytes = SIZE_MAX, std::chrono::steady_clock::duration minIdle = {}) noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        size_t released = 0;
+        for (ArenaRegion& region : regions) {
+            if (released >= maxBytes)
+                break;
+            if (region.live != 0 || !region.resident || now - region.idleSince < minIdle)
+                continue;
+            if (madvise(region.base, region.size, MADV_DONTNEED) != 0)
+                continue;
+            region.resident = false;
+            released += region.size;
+        }
+        return released;
+    }
+
+    //bytes held by fully free regions that trim() could release
+    size_t trimmableBytes() const noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t bytes = 0;
+        for (const ArenaRegion& region : regions) {
+            if (region.live == 0 && region.resident)
+                bytes += region.size;
+        }
+        return bytes;
+    }
+
+    bool owns(const void* ptr) const noexcept {
+        ArenaRegion* region = ArenaPageMap::instance().find(ptr);
+        return region && region->arena == this;
+    }
+
+    //statistics
+    size_t reservedBytes() const noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        return reserved;
+    }
+    size_t liveBytes() const noexcept {
+        std::lock_guard<std::mutex> lock(mutex);
+        return live;
+    }
+
+    //bytes of arena memory currently backed by transparent huge pages,
+    //taken from AnonHugePages in /proc/self/smaps and prorated when the kernel merged mappings
+    size_t hugePageBytes() const {
+        std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const ArenaRegion& region : regions) {
+                uintptr_t start = reinterpret_cast<uintptr_t>(region.base);
+                ranges.emplace_back(start, start + region.size);
+            }
+        }
+        std::ifstream smaps("/proc/self/smaps");
+        std::string line;
+        uintptr_t vmaStart = 0, vmaEnd = 0;
+        size_t total = 0;
+        while (std::getline(smaps, line)) {
+            unsigned long long start, end, kb;
+            //mapping headers start with the address range, attribute lines with a "Name:" key;
+            //headers contain ':' too, in the device field, but only after the first space
+            size_t space = line.find(' ');
+            bool header = space != std::string::npos && line.find(':') > space;
+            if (header && std::sscanf(line.c_str(), "%llx-%llx ", &start, &end) == 2) {
+                vmaStart = static_cast<uintptr_t>(start);
+                vmaEnd = static_cast<uintptr_t>(end);
+            }
+            else if (std::sscanf(line.c_str(), "AnonHugePages: %llu kB", &kb) == 1 && kb != 0 && vmaEnd > vmaStart) {
+                size_t overlap = 0;
+                for (const auto& range : ranges) {
+                    uintptr_t lo = range.first > vmaStart ? range.first : vmaStart;
+                    uintptr_t hi = range.second < vmaEnd ? range.second : vmaEnd;
+                    if (lo < hi)
+                        overlap += hi - lo;
+                }
+                size_t vmaSize = vmaEnd - vmaStart;
+                size_t huge = static_cast<size_t>(kb) * 1024;
+                if (overlap >= vmaSize)
+                    total += huge;
+                else if (overlap)
+                    total += static_cast<size_t>(static_cast<double>(huge) * (static_cast<double>(overlap) / static_cast<double>(vmaSize)));
+            }
+        }
+        return total;
+    }
+};
+
+namespace detail
+{
+    inline HugePageArena*& current_arena() noexcept {
+        static thread_local HugePageArena* arena = nullptr;
+        return arena;
+    }
+} // namespace detail
+
+//routes widget and control block allocations of the current thread into an arena
+class ArenaScope
+{
+private:
+    HugePageArena* previous;
+public:
+    explicit ArenaScope(HugePageArena& arena) noexcept : previous(detail::current_arena()) {
+        detail::current_arena() = &arena;
+    }
+    ArenaScope(const ArenaScope& other) = delete;
+    ArenaScope& operator=(const ArenaScope& other) = delete;
+    ~ArenaScope() {
+        detail::current_arena() = previous;
+    }
+};
+
+//resident set size of the process in bytes, 0 if /proc is unavailable
+inline size_t resident_set_bytes() noexcept {
+    std::FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (!statm)
+        return 0;
+    unsigned long long total = 0, resident = 0;
+    int read = std::fscanf(statm, "%llu %llu", &total, &resident);
+    std::fclose(statm);
+    if (read != 2)
+        return 0;
+    return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+//allocation hooks used by class level operator new/delete
+inline void* arena_allocate(size_t size) {
+    if (HugePageArena* arena = detail::current_arena())
+        return arena->allocate(size);
+    return ::operator new(size);
+}
+inline void arena_deallocate(void* ptr, size_t size) noexcept {
+    if (!ptr)
+        return;
+    if (ArenaRegion* region = ArenaPageMap::instance().find(ptr)) {
+        region->arena->deallocate(region, size);
+        return;
+    }
+    ::operator delete(ptr);
+}
+
+#endif
@@ -0,0 +1,437 @@
+#ifndef _AUTOSAVE_H_
+#define _AUTOSAVE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define WIDGET_AUTOSAVE_URING 1
+#endif
+
+#include "channel.h"
+#include "memory.h"
+#include "pipeline.h"
+#include "snapshot.h"
+#include "Widget.h"
+
+struct AutosaveMetrics
+{
+    uint64_t saves = 0;         //snapshots handed to the writer
+    uint64_t skipped = 0;       //save() calls that found both buffers in flight
+    uint64_t written = 0;       //snapshots durably renamed into place
+    uint64_t failed = 0;
+    uint64_t bytes = 0;
+    StageMetrics write;         //hand over to the directory fsync after the rename
+    size_t queueDepth = 0;      //buffers in flight right now
+    bool usingUring = false;
+};
+
+namespace detail
+{
+#if defined(WIDGET_AUTOSAVE_URING)
+    //minimal io_uring on raw syscalls: one submitting and reaping thread, no SQ polling
+    class Uring
+    {
+    private:
+        int fd = -1;
+        unsigned entries = 0;
+        void* sqRing = MAP_FAILED;
+        size_t sqRingSize = 0;
+        void* cqRing = MAP_FAILED;
+        size_t cqRingSize = 0;
+        io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        size_t sqesSize = 0;
+
+        unsigned* sqHead = nullptr;
+        unsigned* sqTail = nullptr;
+        unsigned* sqMask = nullptr;
+        unsigned* sqArray = nullptr;
+        unsigned* cqHead = nullptr;
+        unsigned* cqTail = nullptr;
+        unsigned* cqMask = nullptr;
+        io_uring_cqe* cqes = nullptr;
+        unsigned tail = 0;          //local tail, published by submit()
+        unsigned queued = 0;
+
+        template<typename P>
+        static P* at(void* base, uint32_t offset) noexcept {
+            return reinterpret_cast<P*>(static_cast<char*>(base) + offset);
+        }
+
+    public:
+        Uring() = default;
+        Uring(const Uring& other) = delete;
+        Uring& operator=(const Uring& other) = delete;
+
+        ~Uring() {
+            if (sqes != MAP_FAILED)
+                munmap(sqes, sqesSize);
+            if (cqRing != MAP_FAILED && cqRing != sqRing)
+                munmap(cqRing, cqRingSize);
+            if (sqRing != MAP_FAILED)
+                munmap(sqRing, sqRingSize);
+            if (fd >= 0)
+                close(fd);
+        }
+
+        //false when the kernel or a seccomp policy does not offer io_uring
+        bool init(unsigned count) noexcept {
+            io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+            fd = static_cast<int>(syscall(__NR_io_uring_setup, count, &params));
+            if (fd < 0)
+                return false;
+            entries = params.sq_entries;
+            sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (single)
+                sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+            sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+            if (sqRing == MAP_FAILED)
+                return false;
+            cqRing = single ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED)
+                return false;
+            sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+            sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+            if (sqes == MAP_FAILED)
+                return false;
+            sqHead = at<unsigned>(sqRing, params.sq_off.head);
+            sqTail = at<unsigned>(sqRing, params.sq_off.tail);
+            sqMask = at<unsigned>(sqRing, params.sq_off.ring_mask);
+            sqArray = at<unsigned>(sqRing, params.sq_off.array);
+            cqHead = at<unsigned>(cqRing, params.cq_off.head);
+            cqTail = at<unsigned>(cqRing, params.cq_off.tail);
+            cqMask = at<unsigned>(cqRing, params.cq_off.ring_mask);
+            cqes = at<io_uring_cqe>(cqRing, params.cq_off.cqes);
+            tail = *sqTail;
+            return true;
+        }
+
+        unsigned capacity() const noexcept {
+            return entries;
+        }
+
+        //zeroed entry for the next operation, nullptr when the submission queue is full
+        io_uring_sqe* next() noexcept {
+            unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+            if (tail - head >= entries)
+                return nullptr;
+            unsigned index = tail & *sqMask;
+            io_uring_sqe* sqe = &sqes[index];
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqArray[index] = index;
+            ++tail;
+            ++queued;
+            return sqe;
+        }
+
+        //submits the queued entries and waits until at least wait completions are available
+        int submit(unsigned wait) noexcept {
+            __atomic_store_n(sqTail, tail, __ATOMIC_RELEASE);
+            unsigned count = queued;
+            queued = 0;
+            int result;
+            do {
+                result = static_cast<int>(syscall(__NR_io_uring_enter, fd, count, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+            } while (result < 0 && errno == EINTR);
+            return result;
+        }
+
+        bool reap(io_uring_cqe& out) noexcept {
+            unsigned head = *cqHead;
+            if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+                return false;
+            out = cqes[head & *cqMask];
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+    };
+#endif
+
+    inline bool write_fully(int fd, const char* data, size_t size, size_t offset) noexcept {
+        while (offset < size) {
+            ssize_t written = pwrite(fd, data + offset, size - offset, static_cast<off_t>(offset));
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return false;
+            offset += static_cast<size_t>(written);
+        }
+        return true;
+    }
+} // namespace detail
+
+//crash safe autosave of a widget tree that never blocks the UI thread on the disk. save() serialises
+//into one of two page aligned buffers and hands it to a writer thread, which writes it to path.tmp,
+//fsyncs it, renames it over path and fsyncs the directory, in that order, through one linked
+//io_uring chain; without io_uring the same writer thread does the steps with blocking calls. there
+//is deliberately one writer and no pool: each rename must land after the previous one. while both
+//buffers are in flight save() skips and returns false, the next call saves the newer tree
+class AutosaveWriter
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Buffer
+    {
+        char* data = nullptr;
+        size_t capacity = 0;
+        size_t size = 0;
+        std::atomic<bool> busy{ false };
+        Clock::time_point queued;
+    };
+
+    struct Job
+    {
+        Buffer* buffer;
+    };
+
+    std::string path;
+    std::string tmpPath;
+    int directory;
+    Buffer buffers[2];
+    SpscChannel<Job> jobs;
+    std::thread writer;
+#if defined(WIDGET_AUTOSAVE_URING)
+    detail::Uring ring;
+#endif
+    std::atomic<bool> uring{ false };   //cleared by the writer when the ring cannot be trusted anymore
+
+    //UI thread counters and writer thread counters, read by metrics()
+    std::atomic<uint64_t> saves{ 0 }, skipped{ 0 }, written{ 0 }, failed{ 0 }, bytes{ 0 };
+    std::atomic<uint64_t> writeCount{ 0 }, writeTotalNs{ 0 }, writeMaxNs{ 0 };
+
+    static void reserve(Buffer& buffer, size_t size) {
+        if (size <= buffer.capacity)
+            return;
+        size_t capacity = std::max<size_t>(size, buffer.capacity * 2);
+        capacity = (capacity + 4095) & ~size_t(4095);
+        void* data = nullptr;
+        if (posix_memalign(&data, 4096, capacity) != 0)
+            throw std::bad_alloc();
+        std::free(buffer.data);
+        buffer.data = static_cast<char*>(data);
+        buffer.capacity = capacity;
+    }
+
+    //blocking steps from offset on, also used to finish a chain the ring could not complete
+    bool finishBlocking(int fd, const Buffer& buffer, size_t offset, bool renamed) noexcept {
+        if (!renamed) {
+            if (!detail::write_fully(fd, buffer.data, buffer.size, offset) || fsync(fd) != 0)
+                return false;
+            if (rename(tmpPath.c_str(), path.c_str()) != 0)
+                return false;
+        }
+        return fsync(directory) == 0;
+    }
+
+#if defined(WIDGET_AUTOSAVE_URING)
+    //write chunks, fsync, renameat and directory fsync as one linked chain; any failure cancels the
+    //rest of the chain, which is then finished with blocking calls from the first incomplete step
+    bool writeUring(int fd, const Buffer& buffer) noexcept {
+        const size_t maxChunk = size_t(1) << 30;
+        size_t chunk = std::max<size_t>(size_t(64) << 20, (buffer.size + ring.capacity() - 4) / (ring.capacity() - 3));
+        if (chunk > maxChunk)
+            return finishBlocking(fd, buffer, 0, false);
+        std::vector<size_t> lengths;
+        for (size_t offset = 0; offset < buffer.size; offset += chunk)
+            lengths.push_back(std::min(chunk, buffer.size - offset));
+
+        unsigned operations = 0;
+        size_t offset = 0;
+        for (size_t length : lengths) {
+            io_uring_sqe* sqe = ring.next();
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(buffer.data + offset);
+            sqe->len = static_cast<uint32_t>(length);
+            sqe->off = offset;
+            sqe->flags = IOSQE_IO_LINK;
+            sqe->user_data = operations++;
+            offset += length;
+        }
+        io_uring_sqe* sqe = ring.next();
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = fd;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = operations++;
+        sqe = ring.next();
+        sqe->opcode = IORING_OP_RENAMEAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(tmpPath.c_str());
+        sqe->len = static_cast<uint32_t>(AT_FDCWD);
+        sqe->off = reinterpret_cast<uint64_t>(path.c_str());
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = operations++;
+        sqe = ring.next();
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = directory;
+        sqe->user_data = operations++;
+
+        //entries the kernel did not take stay in the submission queue, the ring is not used again so
+        //a later submit cannot pick them up
+        int submitted = ring.submit(operations);
+        if (submitted < 0) {
+            uring.store(false, std::memory_order_relaxed);
+            return finishBlocking(fd, buffer, 0, false);
+        }
+        if (static_cast<unsigned>(submitted) < operations)
+            uring.store(false, std::memory_order_relaxed);
+        //the kernel reads the buffer until the last submitted operation completes, so the buffer
+        //stays busy until then even if waiting fails
+        std::vector<int32_t> results(operations, -ECANCELED);
+        for (unsigned reaped = 0; reaped < static_cast<unsigned>(submitted);) {
+            io_uring_cqe cqe;
+            if (!ring.reap(cqe)) {
+                if (ring.submit(1) < 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (cqe.user_data < operations)
+                results[cqe.user_data] = cqe.res;
+            ++reaped;
+        }
+
+        //first incomplete step, short writes break the link like errors do
+        size_t done = 0;
+        for (size_t i = 0; i < lengths.size(); ++i) {
+            if (results[i] < 0 || static_cast<size_t>(results[i]) != lengths[i])
+                return finishBlocking(fd, buffer, done + std::max<int32_t>(results[i], 0), false);
+            done += lengths[i];
+        }
+        size_t fsyncResult = lengths.size();
+        if (results[fsyncResult] < 0)
+            return finishBlocking(fd, buffer, buffer.size, false);
+        if (results[fsyncResult + 1] < 0) {
+            //kernels before 5.11 reject IORING_OP_RENAMEAT
+            return rename(tmpPath.c_str(), path.c_str()) == 0 && fsync(directory) == 0;
+        }
+        return results[fsyncResult + 2] >= 0 || fsync(directory) == 0;
+    }
+#endif
+
+    void run() {
+        while (MyUniquePtr<Job> job = jobs.pop()) {
+            Buffer& buffer = *job->buffer;
+            bool ok = false;
+            int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd >= 0) {
+#if defined(WIDGET_AUTOSAVE_URING)
+                ok = uring.load(std::memory_order_relaxed) ? writeUring(fd, buffer) : finishBlocking(fd, buffer, 0, false);
+#else
+                ok = finishBlocking(fd, buffer, 0, false);
+#endif
+                close(fd);
+            }
+            if (ok) {
+                written.fetch_add(1, std::memory_order_relaxed);
+                bytes.fetch_add(buffer.size, std::memory_order_relaxed);
+            }
+            else {
+                failed.fetch_add(1, std::memory_order_relaxed);
+            }
+            uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - buffer.queued).count());
+            writeCount.fetch_add(1, std::memory_order_relaxed);
+            writeTotalNs.fetch_add(ns, std::memory_order_relaxed);
+            uint64_t seen = writeMaxNs.load(std::memory_order_relaxed);
+            while (ns > seen && !writeMaxNs.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {}
+            buffer.busy.store(false, std::memory_order_release);
+        }
+    }
+
+public:
+    //constructor, throws when the directory of path cannot be opened
+    explicit AutosaveWriter(std::string target, bool useUring = true)
+        : path(std::move(target)), tmpPath(path + ".tmp"), jobs(2) {
+        size_t slash = path.rfind('/');
+        std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        directory = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (directory < 0)
+            throw std::runtime_error("autosave: cannot open directory " + dir);
+#if defined(WIDGET_AUTOSAVE_URING)
+        uring = useUring && ring.init(64) && ring.capacity() >= 8;
+#else
+        (void)useUring;
+#endif
+        writer = std::thread(&AutosaveWriter::run, this);
+    }
+
+    AutosaveWriter(const AutosaveWriter& other) = delete;
+    AutosaveWriter& operator=(const AutosaveWriter& other) = delete;
+
+    //waits for the saves in flight
+    ~AutosaveWriter() {
+        jobs.close();
+        writer.join();
+        close(directory);
+        for (Buffer& buffer : buffers)
+            std::free(buffer.data);
+    }
+
+    //UI thread: serialises root straight into a free buffer and queues the write; false if both
+    //buffers are still in flight
+    bool save(const Widget& root) {
+        Buffer* buffer = nullptr;
+        for (Buffer& candidate : buffers) {
+            if (!candidate.busy.load(std::memory_order_acquire)) {
+                buffer = &candidate;
+                break;
+            }
+        }
+        if (!buffer) {
+            skipped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        buffer->size = save_snapshot_into(root, [buffer](size_t size) {
+            reserve(*buffer, size);
+            return buffer->data;
+        });
+        buffer->queued = Clock::now();
+        buffer->busy.store(true, std::memory_order_relaxed);
+        //two buffers and two slots, this never waits
+        jobs.push(MyUniquePtr<Job>(new Job{ buffer }));
+        saves.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    size_t queueDepth() const noexcept {
+        size_t depth = 0;
+        for (const Buffer& buffer : buffers)
+            depth += buffer.busy.load(std::memory_order_acquire);
+        return depth;
+    }
+
+    AutosaveMetrics metrics() const noexcept {
+        AutosaveMetrics result;
+        result.saves = saves.load(std::memory_order_relaxed);
+        result.skipped = skipped.load(std::memory_order_relaxed);
+        result.written = written.load(std::memory_order_relaxed);
+        result.failed = failed.load(std::memory_order_relaxed);
+        result.bytes = bytes.load(std::memory_order_relaxed);
+        result.write.count = writeCount.load(std::memory_order_relaxed);
+        result.write.totalNs = writeTotalNs.load(std::memory_order_relaxed);
+        result.write.maxNs = writeMaxNs.load(std::memory_order_relaxed);
+        result.queueDepth = queueDepth();
+        result.usingUring = uring.load(std::memory_order_relaxed);
+        return result;
+    }
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Widget.h"
+
+//depth first traversal of a tree of 2^21 widgets built breadth first, so siblings sit together in
+//memory and a traversal jumps between distant levels: widgets allocated from a HugePageArena
+//against the same tree with widgets from malloc. reports time per widget and, where the kernel
+//lets us count them, dTLB load misses per widget
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t WIDGETS = size_t(1) << 21;
+constexpr size_t FANOUT = 8;
+constexpr int ROUNDS = 10;
+
+struct Box : Widget
+{
+    std::string getType() const override {
+        return "Box";
+    }
+};
+
+//dTLB load misses of this thread in user space, unavailable when perf events are not permitted
+class DtlbCounter
+{
+private:
+    int fd;
+public:
+    DtlbCounter() {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~DtlbCounter() {
+        if (fd >= 0)
+            close(fd);
+    }
+    bool available() const noexcept {
+        return fd >= 0;
+    }
+    void start() {
+        if (fd < 0)
+            return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    uint64_t stop() {
+        uint64_t count = 0;
+        if (fd < 0)
+            return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count))
+            return 0;
+        return count;
+    }
+};
+
+static MyUniquePtr<Widget> buildTree() {
+    MyUniquePtr<Widget> root(new Box());
+    std::vector<Widget*> level{ root.get() };
+    size_t count = 1;
+    for (size_t next = 0; count < WIDGETS; ++next) {
+        for (size_t i = 0; i < FANOUT && count < WIDGETS; ++i, ++count) {
+            Widget* child = new Box();
+            WidgetProperties properties;
+            properties.x = float(count % 1000);
+            child->setProperties(properties);
+            level[next]->addChild(child);
+            level.push_back(child);
+        }
+    }
+    return root;
+}
+
+static double traverse(const Widget* root) {
+    double sum = 0.0;
+    std::vector<const Widget*> stack{ root };
+    while (!stack.empty()) {
+        const Widget* widget = stack.back();
+        stack.pop_back();
+        sum += widget->getProperties().x;
+        for (const auto& child : widget->getChildren())
+            stack.push_back(child.get());
+    }
+    return sum;
+}
+
+struct Result
+{
+    double ns;
+    double misses;
+};
+
+static Result measure(const Widget* root, DtlbCounter& counter, double& checksum) {
+    checksum += traverse(root);     //warm up
+    counter.start();
+    auto started = Clock::now();
+    for (int round = 0; round < ROUNDS; ++round)
+        checksum += traverse(root);
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - started).count();
+    uint64_t misses = counter.stop();
+    return Result{ ns / (double(ROUNDS) * WIDGETS), double(misses) / (double(ROUNDS) * WIDGETS) };
+}
+
+int main() {
+#ifdef MY_COMPRESSED_CHILDREN
+    std::printf("widgets live in the compressed heap in this build, arenas are not used\n");
+    return 0;
+#else
+    DtlbCounter counter;
+    double checksum = 0.0;
+
+    MyUniquePtr<Widget> heapTree = buildTree();
+    Result heap = measure(heapTree.get(), counter, checksum);
+    heapTree.reset();
+
+    HugePageArena arena(size_t(64) << 20);
+    MyUniquePtr<Widget> arenaTree;
+    {
+        ArenaScope scope(arena);
+        arenaTree = buildTree();
+    }
+    Result huge = measure(arenaTree.get(), counter, checksum);
+    size_t hugeBytes = arena.hugePageBytes();
+    size_t reserved = arena.reservedBytes();
+    arenaTree.reset();
+
+    std::printf("%zu widgets, fanout %zu, depth first over a breadth first build\n", WIDGETS, FANOUT);
+    std::printf("arena: %zu MiB reserved, %zu MiB on huge pages\n", reserved >> 20, hugeBytes >> 20);
+    if (counter.available()) {
+        std::printf("malloc  %7.2f ns/widget %7.4f dTLB misses/widget\n", heap.ns, heap.misses);
+        std::printf("arena   %7.2f ns/widget %7.4f dTLB misses/widget\n", huge.ns, huge.misses);
+    }
+    else {
+        std::printf("dTLB counters not available (perf_event_paranoid or no PMU)\n");
+        std::printf("malloc  %7.2f ns/widget\n", heap.ns);
+        std::printf("arena   %7.2f ns/widget\n", huge.ns);
+    }
+    std::printf("checksum %f\n", checksum);
+    return 0;
+#endif
+}
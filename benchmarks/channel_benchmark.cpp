@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "channel.h"
+
+//cost per item of moving MyUniquePtr ownership between threads: SpscChannel and MpmcChannel one
+//item and 16 items at a time, against a bounded std::deque behind a mutex and two condition
+//variables, with one producer and one consumer and with four of each
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t ITEMS = 1000000;
+constexpr size_t CAPACITY = 1024;
+constexpr size_t BATCH = 16;
+
+struct Item
+{
+    uint64_t value;
+};
+using ItemPtr = MyUniquePtr<Item>;
+
+//the baseline, with the channels' push, pop and close semantics
+class MutexQueue
+{
+private:
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::deque<ItemPtr> items;
+    size_t capacity;
+    bool closed = false;
+
+public:
+    explicit MutexQueue(size_t capacity) : capacity(capacity) {}
+
+    size_t pushBatch(ItemPtr* batch, size_t count) {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (size_t i = 0; i < count; ++i) {
+            notFull.wait(lock, [&] { return items.size() < capacity || closed; });
+            if (closed)
+                return i;
+            items.push_back(std::move(batch[i]));
+        }
+        lock.unlock();
+        notEmpty.notify_all();
+        return count;
+    }
+    size_t popBatch(ItemPtr* out, size_t max) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [&] { return !items.empty() || closed; });
+        size_t n = 0;
+        while (n < max && !items.empty()) {
+            out[n++] = std::move(items.front());
+            items.pop_front();
+        }
+        lock.unlock();
+        notFull.notify_all();
+        return n;
+    }
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+};
+
+//nanoseconds per item through queue with producers and as many consumers, batch items at a time
+template<typename Queue>
+static double run(size_t producers, size_t batch, uint64_t& checksum) {
+    Queue queue(CAPACITY);
+    std::vector<std::vector<ItemPtr>> sources(producers);
+    for (size_t p = 0; p < producers; ++p) {
+        for (size_t i = p; i < ITEMS; i += producers)
+            sources[p].emplace_back(new Item{ i });
+    }
+    std::vector<uint64_t> sums(producers, 0);
+    auto started = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < producers; ++c) {
+        threads.emplace_back([&, c] {
+            ItemPtr out[BATCH];
+            while (size_t n = queue.popBatch(out, batch)) {
+                for (size_t i = 0; i < n; ++i)
+                    sums[c] += out[i]->value;
+            }
+        });
+    }
+    std::vector<std::thread> producing;
+    for (size_t p = 0; p < producers; ++p) {
+        producing.emplace_back([&, p] {
+            std::vector<ItemPtr>& items = sources[p];
+            for (size_t i = 0; i < items.size(); i += batch)
+                queue.pushBatch(items.data() + i, std::min(batch, items.size() - i));
+        });
+    }
+    for (std::thread& thread : producing)
+        thread.join();
+    queue.close();
+    for (std::thread& thread : threads)
+        thread.join();
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - started).count() / ITEMS;
+    for (uint64_t sum : sums)
+        checksum += sum;
+    return ns;
+}
+
+int main() {
+    uint64_t checksum = 0;
+    std::printf("%zu items, capacity %zu, %u hardware threads, ns per item\n", ITEMS, CAPACITY,
+        std::thread::hardware_concurrency());
+    std::printf("                    1:1 single  1:1 batch  4:4 single  4:4 batch\n");
+    std::printf("mutex + deque       %10.1f %10.1f %11.1f %10.1f\n",
+        run<MutexQueue>(1, 1, checksum), run<MutexQueue>(1, BATCH, checksum),
+        run<MutexQueue>(4, 1, checksum), run<MutexQueue>(4, BATCH, checksum));
+    std::printf("SpscChannel         %10.1f %10.1f\n",
+        run<SpscChannel<Item>>(1, 1, checksum), run<SpscChannel<Item>>(1, BATCH, checksum));
+    std::printf("MpmcChannel         %10.1f %10.1f %11.1f %10.1f\n",
+        run<MpmcChannel<Item>>(1, 1, checksum), run<MpmcChannel<Item>>(1, BATCH, checksum),
+        run<MpmcChannel<Item>>(4, 1, checksum), run<MpmcChannel<Item>>(4, BATCH, checksum));
+    std::printf("checksum %llu\n", static_cast<unsigned long long>(checksum));
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "civil.h"
+
+//throughput of the date conversions behind calendar views: the scalar conversion one day at a
+//time against the batch entry points, which run the widest vector path the build enables, and
+//month_grids for a year of calendar pages. build with -march=native to get the SIMD paths
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t DAYS = 1 << 16;
+constexpr int ROUNDS = 400;
+constexpr size_t GRIDS = 12;
+constexpr int GRID_ROUNDS = 20000;
+
+#if defined(__AVX2__)
+static const char* const PATH = "avx2";
+#elif defined(__SSE4_1__)
+static const char* const PATH = "sse4.1";
+#else
+static const char* const PATH = "scalar";
+#endif
+
+static double elapsed_ns(Clock::time_point since) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - since).count();
+}
+
+int main() {
+    //two centuries around the epoch, the range calendar views actually show
+    std::vector<int32_t> days(DAYS), year(DAYS), month(DAYS), day(DAYS), weekday(DAYS), back(DAYS);
+    uint32_t state = 2463534242u;
+    for (int32_t& value : days) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        value = static_cast<int32_t>(state % 73049) - 36524;
+    }
+    uint64_t checksum = 0;
+
+    auto started = Clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (size_t i = 0; i < DAYS; ++i)
+            civil_from_days(days[i], year[i], month[i], day[i], weekday[i]);
+        checksum += static_cast<uint32_t>(year[round % DAYS]);
+        asm volatile("" : : "r"(year.data()) : "memory");
+    }
+    double scalarFrom = elapsed_ns(started) / (double(ROUNDS) * DAYS);
+
+    started = Clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        for (size_t i = 0; i < DAYS; ++i)
+            back[i] = days_from_civil(year[i], month[i], day[i]);
+        checksum += static_cast<uint32_t>(back[round % DAYS]);
+        asm volatile("" : : "r"(back.data()) : "memory");
+    }
+    double scalarTo = elapsed_ns(started) / (double(ROUNDS) * DAYS);
+
+    started = Clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        civil_from_days(days.data(), year.data(), month.data(), day.data(), weekday.data(), days.size());
+        checksum += static_cast<uint32_t>(year[round % DAYS]);
+        asm volatile("" : : "r"(year.data()) : "memory");
+    }
+    double batchFrom = elapsed_ns(started) / (double(ROUNDS) * DAYS);
+
+    started = Clock::now();
+    for (int round = 0; round < ROUNDS; ++round) {
+        days_from_civil(year.data(), month.data(), day.data(), back.data(), back.size());
+        checksum += static_cast<uint32_t>(back[round % DAYS]);
+        asm volatile("" : : "r"(back.data()) : "memory");
+    }
+    double batchTo = elapsed_ns(started) / (double(ROUNDS) * DAYS);
+
+    std::vector<MonthGrid> grids(GRIDS);
+    started = Clock::now();
+    for (int round = 0; round < GRID_ROUNDS; ++round) {
+        month_grids(2000 + round % 50, 1, GRIDS, grids.data());
+        checksum += static_cast<uint32_t>(grids[round % GRIDS].cellDay[round % MonthGrid::CELLS]);
+        asm volatile("" : : "r"(grids.data()) : "memory");
+    }
+    double gridYear = elapsed_ns(started) / GRID_ROUNDS;
+
+    std::printf("batch path %s, %zu days per batch\n", PATH, DAYS);
+    std::printf("scalar civil_from_days %9.3f ns/day\n", scalarFrom);
+    std::printf("batch civil_from_days  %9.3f ns/day (%.2fx)\n", batchFrom, scalarFrom / batchFrom);
+    std::printf("scalar days_from_civil %9.3f ns/day\n", scalarTo);
+    std::printf("batch days_from_civil  %9.3f ns/day (%.2fx)\n", batchTo, scalarTo / batchTo);
+    std::printf("month_grids, one year  %9.3f us\n", gridYear / 1000);
+    std::printf("checksum %llu\n", static_cast<unsigned long long>(checksum));
+    return 0;
+}
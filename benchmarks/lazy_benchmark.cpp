@@ -0,0 +1,95 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "lazy.h"
+
+//cold start: an application owning RESOURCES expensive tables of which the first frame needs
+//only USED_AT_START. eager construction pays for all of them before the first frame, lazy
+//construction pays for the ones actually used, on first use. the hot path compares get() with
+//dereferencing an eagerly built object
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int RESOURCES = 16;
+constexpr int USED_AT_START = 2;
+constexpr int HOT_ITERATIONS = 50000000;
+
+struct GlyphTable
+{
+    std::vector<uint32_t> advances;
+
+    GlyphTable() : advances(1 << 18) {
+        uint32_t state = 2463534242u;
+        for (uint32_t& advance : advances) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            advance = state % 97;
+        }
+    }
+};
+
+static double elapsed_ms(Clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+int main() {
+    //eager: everything before the first frame
+    auto started = Clock::now();
+    std::vector<std::unique_ptr<GlyphTable>> eager;
+    for (int i = 0; i < RESOURCES; ++i)
+        eager.push_back(std::make_unique<GlyphTable>());
+    double eagerStartup = elapsed_ms(started);
+
+    //lazy: startup only creates the wrappers, the first frame builds what it touches
+    started = Clock::now();
+    std::vector<std::unique_ptr<MyLazyShared<GlyphTable>>> lazy;
+    for (int i = 0; i < RESOURCES; ++i)
+        lazy.push_back(std::make_unique<MyLazyShared<GlyphTable>>());
+    double lazyStartup = elapsed_ms(started);
+    started = Clock::now();
+    uint64_t checksum = 0;
+    for (int i = 0; i < USED_AT_START; ++i)
+        checksum += lazy[i]->get().advances[7];
+    double lazyFirstUse = elapsed_ms(started);
+    uint64_t deferredNs = 0;
+    for (const auto& resource : lazy)
+        deferredNs += resource->constructionTimeNs();
+
+    //hot path once built
+    GlyphTable* direct = eager[0].get();
+    started = Clock::now();
+    for (int i = 0; i < HOT_ITERATIONS; ++i) {
+        checksum += direct->advances[i & 1023];
+        asm volatile("" : : "r"(direct) : "memory");
+    }
+    double directNs = elapsed_ms(started) * 1e6 / HOT_ITERATIONS;
+    MyLazyShared<GlyphTable>& hot = *lazy[0];
+    started = Clock::now();
+    for (int i = 0; i < HOT_ITERATIONS; ++i) {
+        checksum += hot.get().advances[i & 1023];
+        asm volatile("" : : : "memory");
+    }
+    double getNs = elapsed_ms(started) * 1e6 / HOT_ITERATIONS;
+    constexpr int SHARED_ITERATIONS = HOT_ITERATIONS / 10;
+    started = Clock::now();
+    for (int i = 0; i < SHARED_ITERATIONS; ++i) {
+        MyLazyShared<GlyphTable>::Pointer owner = hot.shared();
+        checksum += owner->advances[i & 1023];
+    }
+    double sharedNs = elapsed_ms(started) * 1e6 / SHARED_ITERATIONS;
+
+    std::printf("resources %d, used by the first frame %d\n", RESOURCES, USED_AT_START);
+    std::printf("eager startup          %9.3f ms\n", eagerStartup);
+    std::printf("lazy startup           %9.3f ms\n", lazyStartup);
+    std::printf("lazy first use         %9.3f ms (construction %.3f ms)\n", lazyFirstUse, deferredNs / 1e6);
+    std::printf("deferred past startup  %9.3f ms\n", eagerStartup - lazyStartup - lazyFirstUse);
+    std::printf("hot direct deref       %9.3f ns\n", directNs);
+    std::printf("hot get()              %9.3f ns\n", getNs);
+    std::printf("hot shared() copy      %9.3f ns\n", sharedNs);
+    std::printf("checksum %llu\n", static_cast<unsigned long long>(checksum));
+    return 0;
+}
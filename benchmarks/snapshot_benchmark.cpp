@@ -0,0 +1,71 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "snapshot.h"
+
+//load_snapshot scaling with the number of decoding threads, for a tree of about 10^6 widgets in
+//many mid sized subtrees; every load decodes, links and frees the whole tree
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int GROUPS = 1000;
+constexpr int ITEMS = 500;
+constexpr int ROUNDS = 3;
+
+struct Item : Widget
+{
+    int32_t value = 0;
+    std::string getType() const override {
+        return "Item";
+    }
+    void writeState(std::vector<char>& out) const override {
+        detail::put<int32_t>(out, value);
+    }
+    void readState(const char* data, size_t size) override {
+        if (size == sizeof(value))
+            std::memcpy(&value, data, sizeof(value));
+    }
+};
+
+int main() {
+    WidgetFactory factory;
+    factory.registerType<Item>("Item");
+    std::vector<char> snapshot;
+    {
+        Item root;
+        for (int g = 0; g < GROUPS; ++g) {
+            Widget* group = new Item();
+            root.addChild(group);
+            for (int i = 0; i < ITEMS; ++i) {
+                Item* item = new Item();
+                item->value = i;
+                group->addChild(item);
+                item->addChild(new Item());
+            }
+        }
+        snapshot = save_snapshot(root);
+    }
+
+    unsigned hardware = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    std::printf("%d widgets, %zu snapshot bytes\n", GROUPS * (2 * ITEMS + 1) + 1, snapshot.size());
+    double single = 0.0;
+    for (unsigned threads = 1; threads <= 2 * hardware; threads *= 2) {
+        double best = 0.0;
+        for (int round = 0; round < ROUNDS; ++round) {
+            auto started = Clock::now();
+            WidgetDocument document = load_snapshot(snapshot, threads, factory);
+            double ms = std::chrono::duration<double, std::milli>(Clock::now() - started).count();
+            if (round == 0 || ms < best)
+                best = ms;
+        }
+        if (threads == 1)
+            single = best;
+        std::printf("%3u threads %9.2f ms %6.2fx\n", threads, best, single / best);
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Widget.h"
+
+//contention of SubtreeLockManager::lockWrite: 1 to 32 writer threads, each locking leaves of its own
+//subtree under a shared root, plus the same with one optimistic reader per writer on the writer's
+//group. every writer takes intention locks on the shared root, so this is where they would meet
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int MAX_THREADS = 32;
+constexpr int LEAVES = 16;
+constexpr int LOCKS_PER_THREAD = 200000;
+
+struct Box : Widget
+{
+    std::string getType() const override {
+        return "Box";
+    }
+};
+
+//million write guards per second with threads writers and as many optimistic readers when readers
+static double run(SubtreeLockManager& locks, std::vector<Widget*>& groups, int threads, bool readers, uint64_t& checksum) {
+    std::atomic<int> ready{ 0 };
+    std::atomic<bool> go{ false };
+    std::atomic<int> writing{ threads };
+    std::atomic<uint64_t> sum{ 0 };
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            const std::vector<WidgetChildPtr>& leaves = groups[t]->getChildren();
+            ready.fetch_add(1);
+            while (!go.load(std::memory_order_acquire))
+                std::this_thread::yield();
+            for (int i = 0; i < LOCKS_PER_THREAD; ++i) {
+                SubtreeLockManager::Guard guard = locks.lockWrite(leaves[i % LEAVES].get());
+                asm volatile("" : : "r"(&guard) : "memory");
+            }
+            writing.fetch_sub(1);
+        });
+        if (readers) {
+            workers.emplace_back([&, t] {
+                ready.fetch_add(1);
+                while (!go.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+                uint64_t local = 0;
+                while (writing.load(std::memory_order_relaxed) != 0)
+                    locks.readOptimistic(groups[t], [&] { ++local; });
+                sum.fetch_add(local);
+            });
+        }
+    }
+    while (ready.load() != int(workers.size()))
+        std::this_thread::yield();
+    auto started = Clock::now();
+    go.store(true, std::memory_order_release);
+    for (std::thread& worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+    checksum += sum.load();
+    return double(threads) * LOCKS_PER_THREAD / seconds / 1e6;
+}
+
+int main() {
+    Box root;
+    std::vector<Widget*> groups;
+    for (int t = 0; t < MAX_THREADS; ++t) {
+        Widget* group = new Box();
+        root.addChild(group);
+        for (int i = 0; i < LEAVES; ++i)
+            group->addChild(new Box());
+        groups.push_back(group);
+    }
+    SubtreeLockManager locks;
+    uint64_t checksum = 0;
+
+    std::printf("%d write guards per thread on disjoint subtrees, %u hardware threads\n", LOCKS_PER_THREAD,
+        std::thread::hardware_concurrency());
+    std::printf("writers   Mlocks/s   with readers\n");
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        double alone = run(locks, groups, threads, false, checksum);
+        double read = run(locks, groups, threads, true, checksum);
+        std::printf("%7d %10.2f %14.2f\n", threads, alone, read);
+    }
+    std::printf("checksum %llu\n", static_cast<unsigned long long>(checksum));
+    return 0;
+}
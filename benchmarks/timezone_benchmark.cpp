@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "timezone.h"
+
+//cost of showing a calendar in several zones: 10^5 event times converted to local time in each of
+//10 zones, one binary search per event against the batch conversion that reuses the transition
+//window, for events in time order as a calendar keeps them and in random order
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t EVENTS = 100000;
+constexpr int ROUNDS = 20;
+
+static const char* const ZONES[] = {
+    "America/New_York", "America/Los_Angeles", "America/Sao_Paulo", "Europe/London", "Europe/Berlin",
+    "Asia/Kolkata", "Asia/Tokyo", "Australia/Sydney", "Pacific/Auckland", "Africa/Cairo"
+};
+
+static double elapsed_ns(Clock::time_point since) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - since).count();
+}
+
+int main() {
+    std::vector<const TimeZone*> zones;
+    for (const char* name : ZONES) {
+        if (const TimeZone* zone = TimeZoneDb::system().get(name))
+            zones.push_back(zone);
+        else
+            std::printf("%s not available\n", name);
+    }
+    if (zones.empty())
+        return 0;
+
+    //ten years of events from 2020
+    std::vector<int64_t> random(EVENTS), local(EVENTS);
+    uint32_t state = 2463534242u;
+    for (int64_t& t : random) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        t = 1577836800 + int64_t(state % (3653u * 24)) * 3600;
+    }
+    std::vector<int64_t> sorted = random;
+    std::sort(sorted.begin(), sorted.end());
+    uint64_t checksum = 0;
+    const double conversions = double(ROUNDS) * EVENTS * zones.size();
+
+    auto run = [&](const std::vector<int64_t>& times, bool batched) {
+        auto started = Clock::now();
+        for (int round = 0; round < ROUNDS; ++round) {
+            for (const TimeZone* zone : zones) {
+                if (batched) {
+                    zone->toLocal(times.data(), local.data(), EVENTS);
+                }
+                else {
+                    for (size_t i = 0; i < EVENTS; ++i)
+                        local[i] = zone->toLocal(times[i]);
+                }
+                checksum += static_cast<uint64_t>(local[round % EVENTS]);
+                asm volatile("" : : "r"(local.data()) : "memory");
+            }
+        }
+        return elapsed_ns(started) / conversions;
+    };
+
+    double scalarSorted = run(sorted, false);
+    double batchSorted = run(sorted, true);
+    double scalarRandom = run(random, false);
+    double batchRandom = run(random, true);
+
+    std::printf("%zu events x %zu zones\n", EVENTS, zones.size());
+    std::printf("sorted, per event   %8.3f ns\n", scalarSorted);
+    std::printf("sorted, batched     %8.3f ns (%.2fx)\n", batchSorted, scalarSorted / batchSorted);
+    std::printf("random, per event   %8.3f ns\n", scalarRandom);
+    std::printf("random, batched     %8.3f ns (%.2fx)\n", batchRandom, scalarRandom / batchRandom);
+    std::printf("checksum %llu\n", static_cast<unsigned long long>(checksum));
+    return 0;
+}
@@ -0,0 +1,231 @@
+#ifndef _BINDING_H_
+#define _BINDING_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+class BindingGraph;
+
+//node of the dependency graph between model signals and widget properties.
+//set() pushes Dirty to direct observers and Check further down; reads pull,
+//recomputing only when a source actually changed, so each frame is glitch free
+class BindingNode
+{
+    friend class BindingGraph;
+    template<typename T> friend class Signal;
+    template<typename T> friend class Computed;
+    friend class Effect;
+
+protected:
+    enum class State : uint8_t { Clean, Check, Dirty };
+
+    BindingGraph& graph;
+    std::vector<BindingNode*> sources;
+    std::vector<BindingNode*> observers;
+    State state;
+    unsigned height;            //longest path from a signal, orders effects topologically
+    bool isEffect;
+    bool queued;
+
+    BindingNode(BindingGraph& graph, State state, bool isEffect) noexcept
+        : graph(graph), state(state), height(0), isEffect(isEffect), queued(false) {};
+
+    //recomputes the value, true if it changed
+    virtual bool recompute() {
+        return false;
+    }
+
+    void markObservers(State mark);
+    void updateIfNecessary();
+    void trackRead();
+    void clearSources() noexcept {
+        for (BindingNode* source : sources) {
+            auto& list = source->observers;
+            list.erase(std::remove(list.begin(), list.end(), this), list.end());
+        }
+        sources.clear();
+    }
+
+public:
+    BindingNode(const BindingNode& other) = delete;
+    BindingNode& operator=(const BindingNode& other) = delete;
+
+    virtual ~BindingNode();
+};
+
+//owns the per-frame batch of pending effects
+class BindingGraph
+{
+    friend class BindingNode;
+
+private:
+    std::vector<BindingNode*> pending;      //effects reached by invalidation this frame
+    BindingNode* evaluating;                //node whose function is running, collects reads
+    size_t recomputations;
+
+public:
+    BindingGraph() noexcept : evaluating(nullptr), recomputations(0) {};
+    BindingGraph(const BindingGraph& other) = delete;
+    BindingGraph& operator=(const BindingGraph& other) = delete;
+
+    //runs the effects affected by this frame's changes, lowest height first
+    void commit() {
+        while (!pending.empty()) {
+            std::vector<BindingNode*> batch;
+            batch.swap(pending);
+            std::sort(batch.begin(), batch.end(),
+                [](const BindingNode* a, const BindingNode* b) { return a->height < b->height; });
+            for (BindingNode* node : batch) {
+                node->queued = false;
+                node->updateIfNecessary();
+            }
+        }
+    }
+
+    size_t pendingEffects() const noexcept {
+        return pending.size();
+    }
+    //number of Computed and Effect evaluations so far
+    size_t recomputeCount() const noexcept {
+        return recomputations;
+    }
+};
+
+inline BindingNode::~BindingNode() {
+    clearSources();
+    for (BindingNode* observer : observers) {
+        auto& list = observer->sources;
+        list.erase(std::remove(list.begin(), list.end(), this), list.end());
+    }
+    if (queued) {
+        auto& list = graph.pending;
+        list.erase(std::remove(list.begin(), list.end(), this), list.end());
+    }
+}
+
+inline void BindingNode::markObservers(State mark) {
+    for (BindingNode* observer : observers) {
+        if (observer->state >= mark)
+            continue;
+        bool wasClean = observer->state == State::Clean;
+        observer->state = mark;
+        if (observer->isEffect && !observer->queued) {
+            observer->queued = true;
+            graph.pending.push_back(observer);
+        }
+        if (wasClean)
+            observer->markObservers(State::Check);
+    }
+}
+
+inline void BindingNode::updateIfNecessary() {
+    if (state == State::Check) {
+        for (size_t i = 0; i < sources.size() && state == State::Check; ++i)
+            sources[i]->updateIfNecessary();
+    }
+    if (state == State::Dirty) {
+        //the reader is restored when recompute throws too; the node then stays Dirty
+        struct Evaluating
+        {
+            BindingGraph& graph;
+            BindingNode* previous;
+            ~Evaluating() {
+                graph.evaluating = previous;
+            }
+        } evaluating{ graph, graph.evaluating };
+        graph.evaluating = this;
+        clearSources();
+        bool changed = recompute();
+        ++graph.recomputations;
+        height = 0;
+        for (BindingNode* source : sources)
+            height = std::max(height, source->height + 1);
+        state = State::Clean;
+        if (changed) {
+            for (BindingNode* observer : observers)
+                observer->state = State::Dirty;
+        }
+        return;
+    }
+    state = State::Clean;
+}
+
+inline void BindingNode::trackRead() {
+    BindingNode* reader = graph.evaluating;
+    if (!reader || std::find(reader->sources.begin(), reader->sources.end(), this) != reader->sources.end())
+        return;
+    reader->sources.push_back(this);
+    observers.push_back(reader);
+}
+
+
+//model value, writes invalidate everything derived from it
+template<typename T>
+class Signal : public BindingNode
+{
+private:
+    T value;
+public:
+    Signal(BindingGraph& graph, T initial) : BindingNode(graph, State::Clean, false), value(std::move(initial)) {};
+
+    const T& get() {
+        trackRead();
+        return value;
+    }
+    void set(T newValue) {
+        if (value == newValue)
+            return;
+        value = std::move(newValue);
+        markObservers(State::Dirty);
+    }
+};
+
+//derived value, recomputed lazily from the signals and computeds it read last time
+template<typename T>
+class Computed : public BindingNode
+{
+private:
+    std::function<T()> compute;
+    T value;
+
+    bool recompute() override {
+        T next = compute();
+        if (next == value)
+            return false;
+        value = std::move(next);
+        return true;
+    }
+public:
+    Computed(BindingGraph& graph, std::function<T()> compute)
+        : BindingNode(graph, State::Dirty, false), compute(std::move(compute)), value() {};
+
+    const T& get() {
+        updateIfNecessary();
+        trackRead();
+        return value;
+    }
+};
+
+//sink writing derived values into widget properties, runs on commit() when a source changed
+class Effect : public BindingNode
+{
+private:
+    std::function<void()> apply;
+
+    bool recompute() override {
+        apply();
+        return false;
+    }
+public:
+    //the effect runs once right away to record its dependencies
+    Effect(BindingGraph& graph, std::function<void()> apply)
+        : BindingNode(graph, State::Dirty, true), apply(std::move(apply)) {
+        updateIfNecessary();
+    }
+};
+
+#endif
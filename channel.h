@@ -0,0 +1,306 @@
+#ifndef _CHANNEL_H_
+#define _CHANNEL_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <new>
+#include <thread>
+
+#include "memory.h"
+
+namespace detail
+{
+    constexpr size_t cache_line_size = 64;
+
+    inline size_t round_up_pow2(size_t value) noexcept {
+        size_t result = 2;
+        while (result < value)
+            result <<= 1;
+        return result;
+    }
+
+    //spins a few rounds, then yields the time slice, then sleeps so idle waiters stay off the CPU
+    class Backoff
+    {
+    private:
+        unsigned rounds = 0;
+    public:
+        void pause() noexcept {
+            if (rounds < 64) {
+                ++rounds;
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+            }
+            else if (rounds < 256) {
+                ++rounds;
+                std::this_thread::yield();
+            }
+            else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    };
+} // namespace detail
+
+
+//single producer single consumer bounded channel moving MyUniquePtr ownership between threads
+template<typename T, typename Deleter = default_delete<T>>
+class SpscChannel
+{
+private:
+    using Pointer = MyUniquePtr<T, Deleter>;
+
+    T** slots;
+    size_t mask;
+    std::atomic<bool> closed;
+
+    alignas(detail::cache_line_size) std::atomic<size_t> head;     //next slot to pop, written by consumer
+    size_t cachedTail;                                              //consumer's view of tail
+    alignas(detail::cache_line_size) std::atomic<size_t> tail;     //next slot to push, written by producer
+    size_t cachedHead;                                              //producer's view of head
+
+public:
+    //constructor and destructor, capacity is rounded up to a power of two
+    explicit SpscChannel(size_t capacity)
+        : slots(new T*[detail::round_up_pow2(capacity)]), mask(detail::round_up_pow2(capacity) - 1), closed(false),
+        head(0), cachedTail(0), tail(0), cachedHead(0) {};
+
+    SpscChannel(const SpscChannel& other) = delete;
+    SpscChannel& operator=(const SpscChannel& other) = delete;
+
+    //destroys whatever is still queued
+    ~SpscChannel() {
+        Deleter deleter;
+        for (size_t i = head.load(std::memory_order_relaxed); i != tail.load(std::memory_order_relaxed); ++i)
+            deleter(slots[i & mask]);
+        delete[] slots;
+    }
+
+    size_t capacity() const noexcept {
+        return mask + 1;
+    }
+
+    //producer side, the item is left untouched when the channel is full
+    size_t tryPushBatch(Pointer* items, size_t count) noexcept {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t + count - cachedHead > mask + 1)
+            cachedHead = head.load(std::memory_order_acquire);
+        size_t free = mask + 1 - (t - cachedHead);
+        size_t n = count < free ? count : free;
+        for (size_t i = 0; i < n; ++i)
+            slots[(t + i) & mask] = items[i].release();
+        if (n)
+            tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+    bool tryPush(Pointer&& item) noexcept {
+        return tryPushBatch(&item, 1) == 1;
+    }
+    //waits for room and returns how many items went in, fewer only when the channel was closed
+    //while waiting; the rest are left untouched
+    size_t pushBatch(Pointer* items, size_t count) noexcept {
+        detail::Backoff backoff;
+        size_t pushed = 0;
+        for (;;) {
+            pushed += tryPushBatch(items + pushed, count - pushed);
+            if (pushed == count || closed.load(std::memory_order_acquire))
+                return pushed;
+            backoff.pause();
+        }
+    }
+    //false when the channel was closed before the item fit, the item is then kept
+    bool push(Pointer&& item) noexcept {
+        return pushBatch(&item, 1) == 1;
+    }
+
+    //consumer side
+    size_t tryPopBatch(Pointer* out, size_t max) noexcept {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (cachedTail - h < max)
+            cachedTail = tail.load(std::memory_order_acquire);
+        size_t available = cachedTail - h;
+        size_t n = max < available ? max : available;
+        for (size_t i = 0; i < n; ++i)
+            out[i].reset(slots[(h + i) & mask]);
+        if (n)
+            head.store(h + n, std::memory_order_release);
+        return n;
+    }
+    Pointer tryPop() noexcept {
+        Pointer item;
+        tryPopBatch(&item, 1);
+        return item;
+    }
+    //waits for at least one item, returns 0 once the channel is closed and drained
+    size_t popBatch(Pointer* out, size_t max) noexcept {
+        detail::Backoff backoff;
+        for (;;) {
+            if (size_t n = tryPopBatch(out, max))
+                return n;
+            if (closed.load(std::memory_order_acquire))
+                return tryPopBatch(out, max);
+            backoff.pause();
+        }
+    }
+    Pointer pop() noexcept {
+        Pointer item;
+        popBatch(&item, 1);
+        return item;
+    }
+
+    //wakes blocked consumers once the remaining items are drained
+    void close() noexcept {
+        closed.store(true, std::memory_order_release);
+    }
+    bool isClosed() const noexcept {
+        return closed.load(std::memory_order_acquire);
+    }
+};
+
+
+//multi producer multi consumer bounded channel, a sequence numbered ring
+//where each slot tells whether it is ready for the current lap
+template<typename T, typename Deleter = default_delete<T>>
+class MpmcChannel
+{
+private:
+    using Pointer = MyUniquePtr<T, Deleter>;
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T* value;
+    };
+
+    Cell* cells;
+    size_t mask;
+    std::atomic<bool> closed;
+
+    alignas(detail::cache_line_size) std::atomic<size_t> enqueuePos;
+    alignas(detail::cache_line_size) std::atomic<size_t> dequeuePos;
+
+    //claims up to count consecutive cells whose sequence equals pos + i + offset
+    size_t claim(std::atomic<size_t>& position, size_t count, size_t offset, size_t& start) noexcept {
+        size_t pos = position.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t n = 0;
+            while (n < count && n <= mask) {
+                size_t sequence = cells[(pos + n) & mask].sequence.load(std::memory_order_acquire);
+                if (sequence != pos + n + offset)
+                    break;
+                ++n;
+            }
+            if (n == 0) {
+                size_t sequence = cells[pos & mask].sequence.load(std::memory_order_acquire);
+                if (static_cast<ptrdiff_t>(sequence - (pos + offset)) < 0)
+                    return 0;       //full or empty
+                pos = position.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (position.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) {
+                start = pos;
+                return n;
+            }
+        }
+    }
+
+public:
+    //constructor and destructor, capacity is rounded up to a power of two
+    explicit MpmcChannel(size_t capacity)
+        : cells(new Cell[detail::round_up_pow2(capacity)]), mask(detail::round_up_pow2(capacity) - 1), closed(false),
+        enqueuePos(0), dequeuePos(0) {
+        for (size_t i = 0; i <= mask; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpmcChannel(const MpmcChannel& other) = delete;
+    MpmcChannel& operator=(const MpmcChannel& other) = delete;
+
+    //destroys whatever is still queued
+    ~MpmcChannel() {
+        Deleter deleter;
+        for (size_t i = dequeuePos.load(std::memory_order_relaxed); i != enqueuePos.load(std::memory_order_relaxed); ++i)
+            deleter(cells[i & mask].value);
+        delete[] cells;
+    }
+
+    size_t capacity() const noexcept {
+        return mask + 1;
+    }
+
+    //producer side, items that did not fit are left untouched
+    size_t tryPushBatch(Pointer* items, size_t count) noexcept {
+        size_t start = 0;
+        size_t n = claim(enqueuePos, count, 0, start);
+        for (size_t i = 0; i < n; ++i) {
+            Cell& cell = cells[(start + i) & mask];
+            cell.value = items[i].release();
+            cell.sequence.store(start + i + 1, std::memory_order_release);
+        }
+        return n;
+    }
+    bool tryPush(Pointer&& item) noexcept {
+        return tryPushBatch(&item, 1) == 1;
+    }
+    //waits for room and returns how many items went in, fewer only when the channel was closed
+    //while waiting; the rest are left untouched
+    size_t pushBatch(Pointer* items, size_t count) noexcept {
+        detail::Backoff backoff;
+        size_t pushed = 0;
+        for (;;) {
+            pushed += tryPushBatch(items + pushed, count - pushed);
+            if (pushed == count || closed.load(std::memory_order_acquire))
+                return pushed;
+            backoff.pause();
+        }
+    }
+    //false when the channel was closed before the item fit, the item is then kept
+    bool push(Pointer&& item) noexcept {
+        return pushBatch(&item, 1) == 1;
+    }
+
+    //consumer side
+    size_t tryPopBatch(Pointer* out, size_t max) noexcept {
+        size_t start = 0;
+        size_t n = claim(dequeuePos, max, 1, start);
+        for (size_t i = 0; i < n; ++i) {
+            Cell& cell = cells[(start + i) & mask];
+            out[i].reset(cell.value);
+            cell.sequence.store(start + i + mask + 1, std::memory_order_release);
+        }
+        return n;
+    }
+    Pointer tryPop() noexcept {
+        Pointer item;
+        tryPopBatch(&item, 1);
+        return item;
+    }
+    //waits for at least one item, returns 0 once the channel is closed and drained
+    size_t popBatch(Pointer* out, size_t max) noexcept {
+        detail::Backoff backoff;
+        for (;;) {
+            if (size_t n = tryPopBatch(out, max))
+                return n;
+            if (closed.load(std::memory_order_acquire))
+                return tryPopBatch(out, max);
+            backoff.pause();
+        }
+    }
+    Pointer pop() noexcept {
+        Pointer item;
+        popBatch(&item, 1);
+        return item;
+    }
+
+    //wakes blocked consumers once the remaining items are drained
+    void close() noexcept {
+        closed.store(true, std::memory_order_release);
+    }
+    bool isClosed() const noexcept {
+        return closed.load(std::memory_order_acquire);
+    }
+};
+
+#endif
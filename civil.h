@@ -0,0 +1,221 @@
+#ifndef _CIVIL_H_
+#define _CIVIL_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+//proleptic Gregorian calendar conversions between days since 1970-01-01 and year/month/day.
+//day counts are int32, so every date within roughly 5.8 million years of the epoch is supported.
+//months are 1 to 12, days 1 to 31 and weekdays 0 (Sunday) to 6
+
+//days since the epoch of y-m-d
+inline int32_t days_from_civil(int32_t year, int32_t month, int32_t day) noexcept {
+    int64_t y = static_cast<int64_t>(year) - (month <= 2);
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return static_cast<int32_t>(era * 146097 + doe - 719468);
+}
+
+//y-m-d and weekday of a day count
+inline void civil_from_days(int32_t days, int32_t& year, int32_t& month, int32_t& day, int32_t& weekday) noexcept {
+    int64_t z = static_cast<int64_t>(days) + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    day = static_cast<int32_t>(doy - (153 * mp + 2) / 5 + 1);
+    month = static_cast<int32_t>(mp < 10 ? mp + 3 : mp - 9);
+    year = static_cast<int32_t>(yoe + era * 400 + (month <= 2));
+    int64_t w = (static_cast<int64_t>(days) + 4) % 7;          //1970-01-01 was a Thursday
+    weekday = static_cast<int32_t>(w < 0 ? w + 7 : w);
+}
+
+namespace detail
+{
+    //the kernels below evaluate the same formulas in double lanes. every intermediate is an exact
+    //integer well below 2^53, and floor((x + 0.5) / d) computed as a multiply by the rounded
+    //reciprocal stays at least 0.5 / d away from the next integer, so the floors are exact
+#if defined(__AVX2__)
+    inline __m256d civil_floordiv(__m256d x, double divisor) noexcept {
+        return _mm256_floor_pd(_mm256_mul_pd(_mm256_add_pd(x, _mm256_set1_pd(0.5)), _mm256_set1_pd(1.0 / divisor)));
+    }
+#elif defined(__SSE4_1__)
+    inline __m128d civil_floordiv(__m128d x, double divisor) noexcept {
+        return _mm_floor_pd(_mm_mul_pd(_mm_add_pd(x, _mm_set1_pd(0.5)), _mm_set1_pd(1.0 / divisor)));
+    }
+#endif
+} // namespace detail
+
+//batched civil_from_days over count day counts; any output pointer may be null
+inline void civil_from_days(const int32_t* days, int32_t* year, int32_t* month, int32_t* day, int32_t* weekday, size_t count) noexcept {
+    size_t i = 0;
+#if defined(__AVX2__)
+    using detail::civil_floordiv;
+    const __m256d one = _mm256_set1_pd(1.0);
+    for (; i + 4 <= count; i += 4) {
+        __m256d input = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(days + i)));
+        __m256d z = _mm256_add_pd(input, _mm256_set1_pd(719468.0));
+        __m256d era = civil_floordiv(z, 146097.0);
+        __m256d doe = _mm256_sub_pd(z, _mm256_mul_pd(era, _mm256_set1_pd(146097.0)));
+        __m256d yoe = _mm256_add_pd(_mm256_sub_pd(doe, civil_floordiv(doe, 1460.0)), civil_floordiv(doe, 36524.0));
+        yoe = civil_floordiv(_mm256_sub_pd(yoe, civil_floordiv(doe, 146096.0)), 365.0);
+        __m256d doy = _mm256_sub_pd(doe, _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(yoe, _mm256_set1_pd(365.0)),
+            civil_floordiv(yoe, 4.0)), civil_floordiv(yoe, 100.0)));
+        __m256d mp = civil_floordiv(_mm256_add_pd(_mm256_mul_pd(doy, _mm256_set1_pd(5.0)), _mm256_set1_pd(2.0)), 153.0);
+        __m256d d = _mm256_add_pd(_mm256_sub_pd(doy, civil_floordiv(_mm256_add_pd(_mm256_mul_pd(mp, _mm256_set1_pd(153.0)),
+            _mm256_set1_pd(2.0)), 5.0)), one);
+        __m256d early = _mm256_cmp_pd(mp, _mm256_set1_pd(10.0), _CMP_LT_OQ);        //March to December
+        __m256d m = _mm256_blendv_pd(_mm256_sub_pd(mp, _mm256_set1_pd(9.0)), _mm256_add_pd(mp, _mm256_set1_pd(3.0)), early);
+        __m256d y = _mm256_add_pd(_mm256_add_pd(yoe, _mm256_mul_pd(era, _mm256_set1_pd(400.0))), _mm256_andnot_pd(early, one));
+        __m256d w = _mm256_add_pd(input, _mm256_set1_pd(4.0));
+        w = _mm256_sub_pd(w, _mm256_mul_pd(civil_floordiv(w, 7.0), _mm256_set1_pd(7.0)));
+        if (year)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(year + i), _mm256_cvtpd_epi32(y));
+        if (month)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(month + i), _mm256_cvtpd_epi32(m));
+        if (day)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(day + i), _mm256_cvtpd_epi32(d));
+        if (weekday)
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(weekday + i), _mm256_cvtpd_epi32(w));
+    }
+#elif defined(__SSE4_1__)
+    using detail::civil_floordiv;
+    const __m128d one = _mm_set1_pd(1.0);
+    for (; i + 2 <= count; i += 2) {
+        __m128d input = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(days + i)));
+        __m128d z = _mm_add_pd(input, _mm_set1_pd(719468.0));
+        __m128d era = civil_floordiv(z, 146097.0);
+        __m128d doe = _mm_sub_pd(z, _mm_mul_pd(era, _mm_set1_pd(146097.0)));
+        __m128d yoe = _mm_add_pd(_mm_sub_pd(doe, civil_floordiv(doe, 1460.0)), civil_floordiv(doe, 36524.0));
+        yoe = civil_floordiv(_mm_sub_pd(yoe, civil_floordiv(doe, 146096.0)), 365.0);
+        __m128d doy = _mm_sub_pd(doe, _mm_sub_pd(_mm_add_pd(_mm_mul_pd(yoe, _mm_set1_pd(365.0)),
+            civil_floordiv(yoe, 4.0)), civil_floordiv(yoe, 100.0)));
+        __m128d mp = civil_floordiv(_mm_add_pd(_mm_mul_pd(doy, _mm_set1_pd(5.0)), _mm_set1_pd(2.0)), 153.0);
+        __m128d d = _mm_add_pd(_mm_sub_pd(doy, civil_floordiv(_mm_add_pd(_mm_mul_pd(mp, _mm_set1_pd(153.0)),
+            _mm_set1_pd(2.0)), 5.0)), one);
+        __m128d early = _mm_cmplt_pd(mp, _mm_set1_pd(10.0));
+        __m128d m = _mm_blendv_pd(_mm_sub_pd(mp, _mm_set1_pd(9.0)), _mm_add_pd(mp, _mm_set1_pd(3.0)), early);
+        __m128d y = _mm_add_pd(_mm_add_pd(yoe, _mm_mul_pd(era, _mm_set1_pd(400.0))), _mm_andnot_pd(early, one));
+        __m128d w = _mm_add_pd(input, _mm_set1_pd(4.0));
+        w = _mm_sub_pd(w, _mm_mul_pd(civil_floordiv(w, 7.0), _mm_set1_pd(7.0)));
+        if (year)
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(year + i), _mm_cvtpd_epi32(y));
+        if (month)
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(month + i), _mm_cvtpd_epi32(m));
+        if (day)
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(day + i), _mm_cvtpd_epi32(d));
+        if (weekday)
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(weekday + i), _mm_cvtpd_epi32(w));
+    }
+#endif
+    for (; i < count; ++i) {
+        int32_t y, m, d, w;
+        civil_from_days(days[i], y, m, d, w);
+        if (year)
+            year[i] = y;
+        if (month)
+            month[i] = m;
+        if (day)
+            day[i] = d;
+        if (weekday)
+            weekday[i] = w;
+    }
+}
+
+//batched days_from_civil over count dates
+inline void days_from_civil(const int32_t* year, const int32_t* month, const int32_t* day, int32_t* days, size_t count) noexcept {
+    size_t i = 0;
+#if defined(__AVX2__)
+    using detail::civil_floordiv;
+    for (; i + 4 <= count; i += 4) {
+        __m256d m = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(month + i)));
+        __m256d d = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(day + i)));
+        __m256d y = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(year + i)));
+        __m256d late = _mm256_cmp_pd(m, _mm256_set1_pd(2.0), _CMP_GT_OQ);        //March to December
+        y = _mm256_sub_pd(y, _mm256_andnot_pd(late, _mm256_set1_pd(1.0)));
+        __m256d era = civil_floordiv(y, 400.0);
+        __m256d yoe = _mm256_sub_pd(y, _mm256_mul_pd(era, _mm256_set1_pd(400.0)));
+        __m256d mp = _mm256_blendv_pd(_mm256_add_pd(m, _mm256_set1_pd(9.0)), _mm256_sub_pd(m, _mm256_set1_pd(3.0)), late);
+        __m256d doy = _mm256_add_pd(civil_floordiv(_mm256_add_pd(_mm256_mul_pd(mp, _mm256_set1_pd(153.0)), _mm256_set1_pd(2.0)), 5.0),
+            _mm256_sub_pd(d, _mm256_set1_pd(1.0)));
+        __m256d doe = _mm256_add_pd(_mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(yoe, _mm256_set1_pd(365.0)), civil_floordiv(yoe, 4.0)),
+            civil_floordiv(yoe, 100.0)), doy);
+        __m256d result = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(era, _mm256_set1_pd(146097.0)), doe), _mm256_set1_pd(719468.0));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(days + i), _mm256_cvtpd_epi32(result));
+    }
+#elif defined(__SSE4_1__)
+    using detail::civil_floordiv;
+    for (; i + 2 <= count; i += 2) {
+        __m128d m = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(month + i)));
+        __m128d d = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(day + i)));
+        __m128d y = _mm_cvtepi32_pd(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(year + i)));
+        __m128d late = _mm_cmpgt_pd(m, _mm_set1_pd(2.0));
+        y = _mm_sub_pd(y, _mm_andnot_pd(late, _mm_set1_pd(1.0)));
+        __m128d era = civil_floordiv(y, 400.0);
+        __m128d yoe = _mm_sub_pd(y, _mm_mul_pd(era, _mm_set1_pd(400.0)));
+        __m128d mp = _mm_blendv_pd(_mm_add_pd(m, _mm_set1_pd(9.0)), _mm_sub_pd(m, _mm_set1_pd(3.0)), late);
+        __m128d doy = _mm_add_pd(civil_floordiv(_mm_add_pd(_mm_mul_pd(mp, _mm_set1_pd(153.0)), _mm_set1_pd(2.0)), 5.0),
+            _mm_sub_pd(d, _mm_set1_pd(1.0)));
+        __m128d doe = _mm_add_pd(_mm_sub_pd(_mm_add_pd(_mm_mul_pd(yoe, _mm_set1_pd(365.0)), civil_floordiv(yoe, 4.0)),
+            civil_floordiv(yoe, 100.0)), doy);
+        __m128d result = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(era, _mm_set1_pd(146097.0)), doe), _mm_set1_pd(719468.0));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(days + i), _mm_cvtpd_epi32(result));
+    }
+#endif
+    for (; i < count; ++i)
+        days[i] = days_from_civil(year[i], month[i], day[i]);
+}
+
+//six week view of one month: cell 0 is the first day of the week containing the 1st
+struct MonthGrid
+{
+    static constexpr size_t CELLS = 42;
+
+    int32_t year = 0;
+    int32_t month = 0;
+    int32_t days[CELLS];            //days since the epoch
+    int32_t cellYear[CELLS];
+    int32_t cellMonth[CELLS];
+    int32_t cellDay[CELLS];
+    int32_t cellWeekday[CELLS];
+
+    bool inMonth(size_t cell) const noexcept {
+        return cellMonth[cell] == month;
+    }
+};
+
+//count consecutive month grids starting at year-month, converted in one batch;
+//firstWeekday is 0 for weeks starting on Sunday, 1 for Monday
+inline void month_grids(int32_t year, int32_t month, size_t count, MonthGrid* out, int32_t firstWeekday = 1) {
+    for (size_t g = 0; g < count; ++g) {
+        int32_t first = days_from_civil(year, month, 1);
+        int32_t weekday = static_cast<int32_t>(((static_cast<int64_t>(first) + 4) % 7 + 7) % 7);
+        int32_t start = first - (weekday - firstWeekday + 7) % 7;
+        out[g].year = year;
+        out[g].month = month;
+        for (size_t cell = 0; cell < MonthGrid::CELLS; ++cell)
+            out[g].days[cell] = start + static_cast<int32_t>(cell);
+        if (++month > 12) {
+            month = 1;
+            ++year;
+        }
+    }
+    //the cell arrays of one grid are contiguous, so each grid is one batch
+    for (size_t g = 0; g < count; ++g)
+        civil_from_days(out[g].days, out[g].cellYear, out[g].cellMonth, out[g].cellDay, out[g].cellWeekday, MonthGrid::CELLS);
+}
+
+inline MonthGrid month_grid(int32_t year, int32_t month, int32_t firstWeekday = 1) {
+    MonthGrid grid;
+    month_grids(year, month, 1, &grid, firstWeekday);
+    return grid;
+}
+
+#endif
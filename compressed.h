@@ -0,0 +1,400 @@
+#ifndef _COMPRESSED_H_
+#define _COMPRESSED_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "fork_locks.h"
+#include "memory.h"
+
+//reserved 32 GiB region addressed by 32 bit offsets scaled by 8.
+//small objects come from 64 KiB spans dedicated to one size class, larger ones take whole spans,
+//so deallocation finds the size from the span table and needs no header. each thread keeps a few
+//free blocks per size class and moves them to and from the shared free lists in batches, so small
+//allocations only take the heap mutex once per batch
+class CompressedHeap
+{
+public:
+    static constexpr size_t RESERVE = size_t(32) << 30;
+    static constexpr unsigned SHIFT = 3;
+    static constexpr size_t GRANULE = size_t(1) << SHIFT;
+    static constexpr size_t SPAN = size_t(64) << 10;
+    static constexpr size_t CLASS_SIZE = 16;
+    static constexpr size_t CLASS_COUNT = 64;               //small objects up to 1 KiB
+    static constexpr uint32_t BATCH = 16;                   //blocks a thread takes or gives back at once
+    static constexpr uint16_t UNUSED = 0;                   //span table entries, small classes are class + 1
+    static constexpr uint16_t LARGE = 0xffff;
+
+private:
+    static constexpr size_t SPANS = RESERVE / SPAN;
+
+    //free blocks of one thread, linked through the blocks like the shared free lists and handed
+    //back when the thread exits
+    struct ThreadCache
+    {
+        uint32_t heads[CLASS_COUNT] = {};
+        uint32_t counts[CLASS_COUNT] = {};
+        bool exited = false;        //blocks freed by later thread_local destructors go to the heap
+
+        ~ThreadCache() {
+            exited = true;
+            CompressedHeap& heap = instance();
+            std::lock_guard<std::mutex> lock(heap.mutex);
+            for (size_t sizeClass = 0; sizeClass < CLASS_COUNT; ++sizeClass)
+                heap.giveBack(sizeClass, heads[sizeClass], counts[sizeClass]);
+        }
+    };
+    static ThreadCache& threadCache() noexcept {
+        static thread_local ThreadCache cache;
+        return cache;
+    }
+
+    char* base;
+    size_t nextSpan;
+    uint16_t* spanClass;                                    //one entry per span, read without the mutex
+    uint32_t freeLists[CLASS_COUNT];                        //offsets, linked through the freed blocks
+    uint32_t bumpOffset[CLASS_COUNT];
+    uint32_t bumpEnd[CLASS_COUNT];
+    std::unordered_map<size_t, size_t> largeSpans;          //first span to span count
+    std::unordered_map<size_t, std::vector<size_t>> freeLarge;  //span count to free first spans
+    std::mutex mutex;
+
+    CompressedHeap() : nextSpan(1), freeLists(), bumpOffset(), bumpEnd() {
+        void* reserved = mmap(nullptr, RESERVE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        base = reserved == MAP_FAILED ? nullptr : static_cast<char*>(reserved);
+        //a table for the whole region so lookups never see it move; zero pages until spans are used
+        void* table = base ? mmap(nullptr, SPANS * sizeof(uint16_t), PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0) : MAP_FAILED;
+        if (table == MAP_FAILED) {
+            if (base)
+                munmap(base, RESERVE);
+            base = nullptr;
+            spanClass = nullptr;
+        }
+        else {
+            spanClass = static_cast<uint16_t*>(table);
+        }
+        ForkLocks::instance().add(mutex);
+    }
+
+    //span 0 is never handed out so offset 0 can mean null. called with the mutex held
+    size_t takeSpans(size_t count) {
+        auto it = freeLarge.find(count);
+        if (it != freeLarge.end() && !it->second.empty()) {
+            size_t first = it->second.back();
+            it->second.pop_back();
+            return first;
+        }
+        if (!base || (nextSpan + count) * SPAN > RESERVE)
+            throw std::bad_alloc();
+        size_t first = nextSpan;
+        nextSpan += count;
+        return first;
+    }
+
+    uint32_t* link(uint32_t offset) const noexcept {
+        return reinterpret_cast<uint32_t*>(base + (size_t(offset) << SHIFT));
+    }
+
+    //one block of a size class from the shared free list or a fresh span. called with the mutex held
+    uint32_t takeBlock(size_t sizeClass) {
+        uint32_t& head = freeLists[sizeClass];
+        if (head) {
+            uint32_t offset = head;
+            head = *link(offset);
+            return offset;
+        }
+        uint32_t step = static_cast<uint32_t>((sizeClass + 1) * CLASS_SIZE >> SHIFT);
+        if (bumpOffset[sizeClass] == 0 || bumpOffset[sizeClass] + step > bumpEnd[sizeClass]) {
+            size_t span = takeSpans(1);
+            spanClass[span] = static_cast<uint16_t>(sizeClass + 1);
+            bumpOffset[sizeClass] = static_cast<uint32_t>(span * SPAN >> SHIFT);
+            bumpEnd[sizeClass] = static_cast<uint32_t>((span + 1) * SPAN >> SHIFT);
+        }
+        uint32_t offset = bumpOffset[sizeClass];
+        bumpOffset[sizeClass] += step;
+        return offset;
+    }
+
+    //up to BATCH blocks linked together, fewer only when the region is exhausted. called with the mutex held
+    uint32_t takeBatch(size_t sizeClass, uint32_t& count) {
+        uint32_t head = 0;
+        for (count = 0; count < BATCH; ++count) {
+            uint32_t offset;
+            try {
+                offset = takeBlock(sizeClass);
+            }
+            catch (const std::bad_alloc&) {
+                if (count == 0)
+                    throw;
+                break;
+            }
+            *link(offset) = head;
+            head = offset;
+        }
+        return head;
+    }
+
+    //moves the first count blocks of a thread's list to the shared one. called with the mutex held
+    void giveBack(size_t sizeClass, uint32_t& head, uint32_t count) noexcept {
+        for (; count > 0; --count) {
+            uint32_t offset = head;
+            head = *link(offset);
+            *link(offset) = freeLists[sizeClass];
+            freeLists[sizeClass] = offset;
+        }
+    }
+
+public:
+    CompressedHeap(const CompressedHeap& other) = delete;
+    CompressedHeap& operator=(const CompressedHeap& other) = delete;
+
+    //never unmapped, compressed pointers may outlive static destruction
+    static CompressedHeap& instance() {
+        static CompressedHeap* heap = new CompressedHeap();
+        return *heap;
+    }
+
+    char* getBase() const noexcept {
+        return base;
+    }
+    bool contains(const void* ptr) const noexcept {
+        const char* p = static_cast<const char*>(ptr);
+        return base && p >= base && p < base + RESERVE;
+    }
+
+    void* allocate(size_t size) {
+        if (size == 0)
+            size = 1;
+        if (size > CLASS_SIZE * CLASS_COUNT) {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t count = (size + SPAN - 1) / SPAN;
+            size_t first = takeSpans(count);
+            spanClass[first] = LARGE;
+            largeSpans[first] = count;
+            return base + first * SPAN;
+        }
+        size_t sizeClass = (size - 1) / CLASS_SIZE;
+        ThreadCache& cache = threadCache();
+        if (cache.exited) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return base + (size_t(takeBlock(sizeClass)) << SHIFT);
+        }
+        if (cache.counts[sizeClass] == 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            cache.heads[sizeClass] = takeBatch(sizeClass, cache.counts[sizeClass]);
+        }
+        uint32_t offset = cache.heads[sizeClass];
+        cache.heads[sizeClass] = *link(offset);
+        --cache.counts[sizeClass];
+        return base + (size_t(offset) << SHIFT);
+    }
+
+    void deallocate(void* ptr) noexcept {
+        if (!ptr)
+            return;
+        size_t position = static_cast<size_t>(static_cast<char*>(ptr) - base);
+        size_t span = position / SPAN;
+        uint16_t entry = spanClass[span];
+        if (entry == LARGE) {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = largeSpans.find(span);
+            size_t count = it->second;
+            largeSpans.erase(it);
+            spanClass[span] = UNUSED;
+            madvise(ptr, count * SPAN, MADV_DONTNEED);
+            freeLarge[count].push_back(span);
+            return;
+        }
+        size_t sizeClass = entry - 1u;
+        uint32_t offset = static_cast<uint32_t>(position >> SHIFT);
+        ThreadCache& cache = threadCache();
+        if (cache.exited) {
+            std::lock_guard<std::mutex> lock(mutex);
+            *link(offset) = freeLists[sizeClass];
+            freeLists[sizeClass] = offset;
+            return;
+        }
+        *link(offset) = cache.heads[sizeClass];
+        cache.heads[sizeClass] = offset;
+        if (++cache.counts[sizeClass] >= 2 * BATCH) {
+            std::lock_guard<std::mutex> lock(mutex);
+            giveBack(sizeClass, cache.heads[sizeClass], BATCH);
+            cache.counts[sizeClass] -= BATCH;
+        }
+    }
+
+    //offset conversion against this heap's base, 0 is null; ptr must come from this heap
+    uint32_t toOffset(const void* ptr) const noexcept {
+        return ptr ? static_cast<uint32_t>((static_cast<const char*>(ptr) - base) >> SHIFT) : 0;
+    }
+    void* fromOffset(uint32_t offset) const noexcept {
+        return offset ? base + (size_t(offset) << SHIFT) : nullptr;
+    }
+    //the same for the process wide heap, which is created by the first call if needed
+    static uint32_t compress(const void* ptr) noexcept {
+        return ptr ? instance().toOffset(ptr) : 0;
+    }
+    static void* decompress(uint32_t offset) noexcept {
+        return offset ? instance().fromOffset(offset) : nullptr;
+    }
+};
+
+namespace detail
+{
+    //true for types whose class operator new and delete use the compressed heap themselves,
+    //marked by a static constexpr bool compressed_allocation member
+    template<typename T, typename = void>
+    struct class_allocates_compressed : std::false_type {};
+    template<typename T>
+    struct class_allocates_compressed<T, std::void_t<decltype(T::compressed_allocation)>>
+        : std::integral_constant<bool, T::compressed_allocation> {};
+} // namespace detail
+
+//destroys an object living in the compressed heap, through the class operator delete when the
+//type allocates there itself
+template<typename T>
+struct compressed_delete {
+    void operator()(T* ptr) const noexcept {
+        static_assert(sizeof(T) > 0, "Can't delete incomplete type");
+        if constexpr (detail::class_allocates_compressed<T>::value) {
+            delete ptr;
+        }
+        else if (ptr) {
+            void* memory = dynamic_or_self(ptr);
+            ptr->~T();
+            CompressedHeap::instance().deallocate(memory);
+        }
+    }
+private:
+    //start of the most derived object, polymorphic bases may sit at an offset
+    template<typename U>
+    static void* dynamic_or_self(U* ptr) noexcept {
+        if constexpr (std::is_polymorphic<U>::value)
+            return const_cast<void*>(dynamic_cast<const volatile void*>(ptr));
+        else
+            return const_cast<void*>(static_cast<const volatile void*>(ptr));
+    }
+};
+
+
+//4 byte owning pointer into the compressed heap with MyUniquePtr semantics
+template<typename T>
+class MyCompressedPtr
+{
+private:
+    uint32_t offset;
+public:
+    //constructor and destructor, ptr must come from the compressed heap
+    constexpr MyCompressedPtr() noexcept : offset(0) {};
+    explicit MyCompressedPtr(T* ptr) noexcept : offset(CompressedHeap::compress(ptr)) {};
+
+    MyCompressedPtr(const MyCompressedPtr& other) = delete;
+    MyCompressedPtr& operator=(const MyCompressedPtr& other) = delete;
+
+    MyCompressedPtr(MyCompressedPtr&& other) noexcept : offset(other.offset) {
+        other.offset = 0;
+    }
+    template<typename U, typename = std::enable_if_t<std::is_convertible<U*, T*>::value>>
+    MyCompressedPtr(MyCompressedPtr<U>&& other) noexcept : MyCompressedPtr(static_cast<T*>(other.release())) {};
+    MyCompressedPtr& operator=(MyCompressedPtr&& other) noexcept {
+        if (this != &other) {
+            reset(other.get());
+            other.offset = 0;
+        }
+        return *this;
+    }
+
+    ~MyCompressedPtr() {
+        reset();
+    }
+
+    //operators and data access methods
+    T& operator*() const noexcept {
+        return *get();
+    }
+    T* operator->() const noexcept {
+        return get();
+    }
+    T* get() const noexcept {
+        return static_cast<T*>(CompressedHeap::decompress(offset));
+    }
+    uint32_t getOffset() const noexcept {
+        return offset;
+    }
+
+    //methods for resource management
+    T* release() noexcept {
+        T* releasedPtr = get();
+        offset = 0;
+        return releasedPtr;
+    }
+    void reset(T* newPtr = nullptr) noexcept {
+        T* old = get();
+        if (old != newPtr) {
+            offset = CompressedHeap::compress(newPtr);
+            compressed_delete<T>()(old);
+        }
+    }
+    void swap(MyCompressedPtr& other) noexcept {
+        std::swap(offset, other.offset);
+    }
+
+    //bool overload
+    explicit operator bool() const noexcept {
+        return offset != 0;
+    }
+};
+
+//4 byte non-owning reference, e.g. for parent links
+template<typename T>
+class MyCompressedRef
+{
+private:
+    uint32_t offset;
+public:
+    constexpr MyCompressedRef() noexcept : offset(0) {};
+    MyCompressedRef(T* ptr) noexcept : offset(CompressedHeap::compress(ptr)) {};
+    MyCompressedRef(const MyCompressedPtr<T>& owner) noexcept : offset(owner.getOffset()) {};
+
+    T& operator*() const noexcept {
+        return *get();
+    }
+    T* operator->() const noexcept {
+        return get();
+    }
+    T* get() const noexcept {
+        return static_cast<T*>(CompressedHeap::decompress(offset));
+    }
+    explicit operator bool() const noexcept {
+        return offset != 0;
+    }
+};
+
+//make_unique counterpart placing the object in the compressed heap; global placement new bypasses
+//class level operator new such as Widget's arena one, unless the class allocates there itself
+template<class T, class... Args>
+MyCompressedPtr<T> make_my_compressed(Args&&... args)
+{
+    static_assert(alignof(T) <= CompressedHeap::CLASS_SIZE, "over-aligned types are not supported");
+    if constexpr (detail::class_allocates_compressed<T>::value)
+        return MyCompressedPtr<T>(new T(std::forward<Args>(args)...));
+    void* memory = CompressedHeap::instance().allocate(sizeof(T));
+    try {
+        return MyCompressedPtr<T>(::new (memory) T(std::forward<Args>(args)...));
+    }
+    catch (...) {
+        CompressedHeap::instance().deallocate(memory);
+        throw;
+    }
+}
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef _COW_H_
+#define _COW_H_
+
+#include <utility>
+
+#include "memory.h"
+
+//copy on write pointer: copies share one object and read through const access, write() gives
+//mutable access after cloning the object if another owner still holds it. the clone happens
+//only when use_count() > 1, so the last owner writes in place.
+//with AtomicRefCount the owners may live on different threads: seeing a count of one means every
+//other owner has released the object with release ordering, so writing in place is safe. copies
+//of one MyCowPtr instance are still made on the thread that owns that instance
+template<typename T, typename Policy = SingleThreadedRefCount>
+class MyCowPtr
+{
+private:
+    using Block = ControlBlock<T, default_delete<T>, Policy>;
+
+    Block* cb;
+    T* ptr;
+
+    void release() noexcept {
+        if (cb) {
+            T* object = ptr;
+            if (cb->decrementStrongRef() == 0)
+                default_delete<T>()(object);
+        }
+        cb = nullptr;
+        ptr = nullptr;
+    }
+
+public:
+    //constructor and destructor
+    constexpr MyCowPtr() noexcept : cb(nullptr), ptr(nullptr) {};
+    explicit MyCowPtr(T* object) : cb(object ? new Block() : nullptr), ptr(object) {};
+
+    MyCowPtr(const MyCowPtr& other) noexcept : cb(other.cb), ptr(other.ptr) {
+        if (cb)
+            cb->incrementStrongRef();
+    }
+    MyCowPtr& operator=(const MyCowPtr& other) noexcept {
+        if (this != &other) {
+            if (other.cb)
+                other.cb->incrementStrongRef();
+            release();
+            cb = other.cb;
+            ptr = other.ptr;
+        }
+        return *this;
+    }
+    MyCowPtr(MyCowPtr&& other) noexcept : cb(other.cb), ptr(other.ptr) {
+        other.cb = nullptr;
+        other.ptr = nullptr;
+    }
+    MyCowPtr& operator=(MyCowPtr&& other) noexcept {
+        if (this != &other) {
+            release();
+            cb = other.cb;
+            ptr = other.ptr;
+            other.cb = nullptr;
+            other.ptr = nullptr;
+        }
+        return *this;
+    }
+
+    ~MyCowPtr() {
+        release();
+    }
+
+    //shared read access
+    const T& operator*() const noexcept {
+        return *ptr;
+    }
+    const T* operator->() const noexcept {
+        return ptr;
+    }
+    const T* get() const noexcept {
+        return ptr;
+    }
+
+    //exclusive write access, detaching from the other owners first when there are any
+    T& write() {
+        if (cb && cb->getStrongRef() > 1) {
+            MyCowPtr copy(new T(*ptr));
+            *this = std::move(copy);
+        }
+        return *ptr;
+    }
+
+    size_t use_count() const noexcept {
+        return cb ? cb->getStrongRef() : 0;
+    }
+    bool unique() const noexcept {
+        return use_count() == 1;
+    }
+
+    //methods for resource management
+    void reset(T* object = nullptr) {
+        MyCowPtr replacement(object);
+        *this = std::move(replacement);
+    }
+    void swap(MyCowPtr& other) noexcept {
+        std::swap(cb, other.cb);
+        std::swap(ptr, other.ptr);
+    }
+
+    explicit operator bool() const noexcept {
+        return ptr != nullptr;
+    }
+};
+
+//make_unique counterpart
+template<typename T, typename Policy = SingleThreadedRefCount, class... Args>
+MyCowPtr<T, Policy> make_my_cow(Args&&... args)
+{
+    return MyCowPtr<T, Policy>(new T(std::forward<Args>(args)...));
+}
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef _FORK_LOCKS_H_
+#define _FORK_LOCKS_H_
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+#include <unistd.h>
+
+//locks that must not be held by another thread at the moment of fork(): the child inherits only
+//the forking thread, so a lock owned by any other thread would stay locked in the child forever.
+//owners register a lock and unlock pair; all of them are taken in registration order before the
+//fork and released in reverse order on both sides afterwards, so a lock that is taken while
+//another registered lock is held has to be registered after that one
+class ForkLocks
+{
+private:
+    struct Hook
+    {
+        uint64_t id;
+        std::function<void()> lock;
+        std::function<void()> unlock;
+    };
+
+    std::mutex mutex;
+    std::vector<Hook> hooks;
+    uint64_t nextId = 1;
+
+    ForkLocks() = default;
+
+public:
+    ForkLocks(const ForkLocks& other) = delete;
+    ForkLocks& operator=(const ForkLocks& other) = delete;
+
+    //never destroyed, objects with registered locks may outlive statics
+    static ForkLocks& instance() {
+        static ForkLocks* locks = new ForkLocks();
+        return *locks;
+    }
+
+    uint64_t add(std::function<void()> lock, std::function<void()> unlock) {
+        std::lock_guard<std::mutex> guard(mutex);
+        hooks.push_back(Hook{ nextId, std::move(lock), std::move(unlock) });
+        return nextId++;
+    }
+    template<typename Mutex>
+    uint64_t add(Mutex& lockable) {
+        return add([&lockable] { lockable.lock(); }, [&lockable] { lockable.unlock(); });
+    }
+    void remove(uint64_t id) {
+        std::lock_guard<std::mutex> guard(mutex);
+        for (size_t i = 0; i < hooks.size(); ++i) {
+            if (hooks[i].id == id) {
+                hooks.erase(hooks.begin() + i);
+                return;
+            }
+        }
+    }
+
+    //forks with every registered lock held, returns what fork() returned
+    pid_t fork() {
+        std::lock_guard<std::mutex> guard(mutex);
+        for (Hook& hook : hooks)
+            hook.lock();
+        pid_t pid = ::fork();
+        for (size_t i = hooks.size(); i-- > 0;)
+            hooks[i].unlock();
+        return pid;
+    }
+};
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef _FORK_SNAPSHOT_H_
+#define _FORK_SNAPSHOT_H_
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "autosave.h"
+#include "fork_locks.h"
+#include "snapshot.h"
+#include "Widget.h"
+
+struct ForkSnapshotResult
+{
+    bool ok = false;
+    int error = 0;              //errno of the failing step in the child
+    uint64_t bytes = 0;
+    uint64_t pauseNs = 0;       //time the caller was blocked in start(), essentially fork()
+    uint64_t totalNs = 0;       //start() until the result was collected
+};
+
+//pause free checkpoints of a huge tree: start() forks and the child serialises the copy on write
+//image of the tree to path.tmp, fsyncs it, renames it over path and reports back through a pipe,
+//while the parent keeps mutating its own copy. the child only runs the serialiser and raw file
+//calls and leaves with _exit(), so it never runs destructors, atexit handlers or other threads' work
+class ForkSnapshotter
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Report
+    {
+        int32_t error;
+        uint64_t bytes;
+    };
+
+    std::string path;
+    std::string tmpPath;
+    std::string dirPath;
+    pid_t child = -1;
+    int pipeFd = -1;
+    Clock::time_point started;
+    uint64_t pauseNs = 0;
+
+    //runs in the child, never returns
+    [[noreturn]] void runChild(const Widget& root, int reportFd) noexcept {
+        Report report{ 0, 0 };
+        try {
+            std::vector<char> snapshot = save_snapshot(root);
+            report.bytes = snapshot.size();
+            errno = 0;
+            int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0 || !detail::write_fully(fd, snapshot.data(), snapshot.size(), 0) || fsync(fd) != 0
+                || rename(tmpPath.c_str(), path.c_str()) != 0)
+                report.error = errno ? errno : EIO;
+            if (fd >= 0)
+                close(fd);
+            int dirFd = open(dirPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (dirFd >= 0) {
+                if (!report.error && fsync(dirFd) != 0)
+                    report.error = errno;
+                close(dirFd);
+            }
+        }
+        catch (...) {
+            report.error = ENOMEM;
+        }
+        ssize_t ignored = write(reportFd, &report, sizeof(report));
+        (void)ignored;
+        _exit(report.error ? 1 : 0);
+    }
+
+    ForkSnapshotResult reap() {
+        ForkSnapshotResult result;
+        Report report{ EPIPE, 0 };
+        char* cursor = reinterpret_cast<char*>(&report);
+        size_t remaining = sizeof(report);
+        while (remaining) {
+            ssize_t got = read(pipeFd, cursor, remaining);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                break;
+            cursor += got;
+            remaining -= static_cast<size_t>(got);
+        }
+        if (remaining) {
+            report.error = EPIPE;       //the child died before reporting
+            report.bytes = 0;
+        }
+        int status = 0;
+        while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+        close(pipeFd);
+        pipeFd = -1;
+        child = -1;
+        result.ok = report.error == 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        result.error = report.error;
+        result.bytes = report.bytes;
+        result.pauseNs = pauseNs;
+        result.totalNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count());
+        return result;
+    }
+
+public:
+    explicit ForkSnapshotter(std::string target) : path(std::move(target)), tmpPath(path + ".tmp") {
+        size_t slash = path.rfind('/');
+        dirPath = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    }
+
+    ForkSnapshotter(const ForkSnapshotter& other) = delete;
+    ForkSnapshotter& operator=(const ForkSnapshotter& other) = delete;
+
+    //waits for a checkpoint in flight
+    ~ForkSnapshotter() {
+        if (child > 0)
+            reap();
+    }
+
+    //UI thread, between mutations: forks a child writing root; false if a checkpoint is still running
+    //or fork() failed
+    bool start(const Widget& root) {
+        if (child > 0)
+            return false;
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) != 0)
+            return false;
+        started = Clock::now();
+        pid_t pid = ForkLocks::instance().fork();
+        if (pid == 0) {
+            close(fds[0]);
+            runChild(root, fds[1]);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            close(fds[0]);
+            return false;
+        }
+        child = pid;
+        pipeFd = fds[0];
+        pauseNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - started).count());
+        return true;
+    }
+
+    bool running() const noexcept {
+        return child > 0;
+    }
+    //readable once the child has reported, for integration with an event loop
+    int completionFd() const noexcept {
+        return pipeFd;
+    }
+
+    //non blocking: true and result filled once the checkpoint in flight has finished
+    bool poll(ForkSnapshotResult& result) {
+        if (child <= 0)
+            return false;
+        pollfd entry{ pipeFd, POLLIN, 0 };
+        if (::poll(&entry, 1, 0) <= 0)
+            return false;
+        result = reap();
+        return true;
+    }
+    //blocks until the checkpoint in flight has finished
+    ForkSnapshotResult wait() {
+        return child > 0 ? reap() : ForkSnapshotResult();
+    }
+};
+
+#endif
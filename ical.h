@@ -0,0 +1,410 @@
+#ifndef _ICAL_H_
+#define _ICAL_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "civil.h"
+#include "timezone.h"
+#include "Widget.h"
+
+struct IcalImportOptions
+{
+    size_t batchSize = 4096;                //events handed over per batch
+    const TimeZone* floatingZone = nullptr; //zone of times without Z or TZID, UTC when null
+    TimeZoneDb* zones = nullptr;            //resolves TZID parameters, the system database when null
+};
+
+struct IcalImportReport
+{
+    uint64_t events = 0;
+    uint64_t skipped = 0;       //VEVENTs without a usable DTSTART
+    uint64_t batches = 0;
+    uint64_t bytes = 0;
+    double seconds = 0.0;
+
+    double megabytesPerSecond() const noexcept {
+        return seconds > 0.0 ? bytes / 1e6 / seconds : 0.0;
+    }
+};
+
+namespace detail
+{
+    //first occurrence of a or b in [p, end), end if there is none
+    inline const char* ical_find(const char* p, const char* end, char a, char b) noexcept {
+#if defined(__AVX2__)
+        const __m256i va = _mm256_set1_epi8(a);
+        const __m256i vb = _mm256_set1_epi8(b);
+        for (; end - p >= 32; p += 32) {
+            __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+            unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(
+                _mm256_or_si256(_mm256_cmpeq_epi8(chunk, va), _mm256_cmpeq_epi8(chunk, vb))));
+            if (mask)
+                return p + __builtin_ctz(mask);
+        }
+#endif
+#if defined(__SSE2__)
+        const __m128i wa = _mm_set1_epi8(a);
+        const __m128i wb = _mm_set1_epi8(b);
+        for (; end - p >= 16; p += 16) {
+            __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+                _mm_or_si128(_mm_cmpeq_epi8(chunk, wa), _mm_cmpeq_epi8(chunk, wb))));
+            if (mask)
+                return p + __builtin_ctz(mask);
+        }
+#endif
+        for (; p < end; ++p) {
+            if (*p == a || *p == b)
+                return p;
+        }
+        return end;
+    }
+
+    inline bool ical_equals(std::string_view text, const char* upper) noexcept {
+        size_t i = 0;
+        for (; i < text.size() && upper[i]; ++i) {
+            char c = text[i];
+            if (c >= 'a' && c <= 'z')
+                c = static_cast<char>(c - 'a' + 'A');
+            if (c != upper[i])
+                return false;
+        }
+        return i == text.size() && !upper[i];
+    }
+
+    inline bool ical_digits(std::string_view text, size_t at, size_t count, int32_t& value) noexcept {
+        if (at + count > text.size())
+            return false;
+        value = 0;
+        for (size_t i = at; i < at + count; ++i) {
+            if (text[i] < '0' || text[i] > '9')
+                return false;
+            value = value * 10 + (text[i] - '0');
+        }
+        return true;
+    }
+
+    //streaming RFC 5545 reader: logical lines are views into the input unless they are folded,
+    //then they are unfolded into one reused buffer; only event text is copied, into the batch
+    class IcalParser
+    {
+    private:
+        using Sink = std::function<void(CalendarEventBatch&)>;
+
+        const IcalImportOptions& options;
+        const Sink& sink;
+        IcalImportReport& report;
+        CalendarEventBatch batch;
+        std::string folded;
+
+        //current VEVENT
+        bool inEvent = false;
+        int nested = 0;                 //VALARM and friends inside the event
+        size_t textMark = 0;
+        CalendarEvent event;
+        bool hasStart = false, hasEnd = false, hasDuration = false;
+        int64_t duration = 0;
+
+        //last TZID lookup, exports repeat the same few zones
+        std::string zoneName;
+        const TimeZone* zone = nullptr;
+
+        const TimeZone* resolve(std::string_view name) {
+            if (!name.empty() && name.front() == '/')
+                name.remove_prefix(1);
+            if (zone && name == zoneName)
+                return zone;
+            TimeZoneDb& db = options.zones ? *options.zones : TimeZoneDb::system();
+            zoneName.assign(name.data(), name.size());
+            zone = db.get(zoneName);
+            return zone;
+        }
+
+        //DATE or DATE-TIME value to UTC seconds
+        bool parseTime(std::string_view value, std::string_view tzid, bool& date, int64_t& out) {
+            int32_t y, m, d;
+            if (!ical_digits(value, 0, 4, y) || !ical_digits(value, 4, 2, m) || !ical_digits(value, 6, 2, d) || m < 1 || m > 12 || d < 1 || d > 31)
+                return false;
+            int64_t seconds = static_cast<int64_t>(days_from_civil(y, m, d)) * 86400;
+            date = value.size() == 8;
+            if (date) {
+                out = seconds;
+                return true;
+            }
+            int32_t hh, mm, ss;
+            if (value.size() < 15 || value[8] != 'T' || !ical_digits(value, 9, 2, hh) || !ical_digits(value, 11, 2, mm) || !ical_digits(value, 13, 2, ss))
+                return false;
+            seconds += hh * 3600 + mm * 60 + ss;
+            if (value.size() > 15 && value[15] == 'Z') {
+                out = seconds;
+                return true;
+            }
+            const TimeZone* local = tzid.empty() ? options.floatingZone : resolve(tzid);
+            out = local ? local->toUtc(seconds) : seconds;
+            return true;
+        }
+
+        //[+-]P[nW][nD][T[nH][nM][nS]]
+        static bool parseDuration(std::string_view value, int64_t& out) {
+            size_t i = 0;
+            int64_t sign = 1;
+            if (i < value.size() && (value[i] == '+' || value[i] == '-'))
+                sign = value[i++] == '-' ? -1 : 1;
+            if (i == value.size() || value[i++] != 'P')
+                return false;
+            int64_t total = 0, number = 0;
+            bool digits = false;
+            for (; i < value.size(); ++i) {
+                char c = value[i];
+                if (c >= '0' && c <= '9') {
+                    number = number * 10 + (c - '0');
+                    digits = true;
+                    continue;
+                }
+                if (c == 'T')
+                    continue;
+                if (!digits)
+                    return false;
+                switch (c) {
+                case 'W': total += number * 604800; break;
+                case 'D': total += number * 86400; break;
+                case 'H': total += number * 3600; break;
+                case 'M': total += number * 60; break;
+                case 'S': total += number; break;
+                default: return false;
+                }
+                number = 0;
+                digits = false;
+            }
+            out = sign * total;
+            return !digits;
+        }
+
+        //TEXT value with its escapes removed, appended to the batch pool
+        void addText(std::string_view value, uint64_t& offset, uint32_t& length) {
+            offset = batch.text.size();
+            for (size_t i = 0; i < value.size(); ++i) {
+                char c = value[i];
+                if (c == '\\' && i + 1 < value.size()) {
+                    c = value[++i];
+                    if (c == 'n' || c == 'N')
+                        c = '\n';
+                }
+                batch.text.push_back(c);
+            }
+            length = static_cast<uint32_t>(batch.text.size() - offset);
+        }
+
+        void beginEvent() {
+            inEvent = true;
+            nested = 0;
+            textMark = batch.text.size();
+            event = CalendarEvent();
+            hasStart = hasEnd = hasDuration = false;
+        }
+
+        void endEvent() {
+            inEvent = false;
+            if (!hasStart) {
+                ++report.skipped;
+                batch.text.resize(textMark);
+                return;
+            }
+            if (!hasEnd)
+                event.end = event.start + (hasDuration ? duration : event.allDay ? 86400 : 0);
+            batch.events.push_back(event);
+            ++report.events;
+            if (batch.events.size() >= options.batchSize)
+                flush();
+        }
+
+        void property(std::string_view line) {
+            const char* begin = line.data();
+            const char* end = begin + line.size();
+            const char* split = ical_find(begin, end, ';', ':');
+            if (split == end)
+                return;
+            std::string_view name(begin, static_cast<size_t>(split - begin));
+            std::string_view tzid;
+            bool dateParam = false;
+            const char* p = split;
+            //parameters, values may be quoted and contain ':' and ';'
+            while (p < end && *p == ';') {
+                const char* start = ++p;
+                bool quoted = false;
+                while (p < end && (quoted || (*p != ';' && *p != ':'))) {
+                    if (*p == '"')
+                        quoted = !quoted;
+                    ++p;
+                }
+                std::string_view parameter(start, static_cast<size_t>(p - start));
+                size_t equals = parameter.find('=');
+                if (equals == std::string_view::npos)
+                    continue;
+                std::string_view key = parameter.substr(0, equals);
+                std::string_view value = parameter.substr(equals + 1);
+                if (value.size() >= 2 && value.front() == '"' && value.back() == '"')
+                    value = value.substr(1, value.size() - 2);
+                if (ical_equals(key, "TZID"))
+                    tzid = value;
+                else if (ical_equals(key, "VALUE"))
+                    dateParam = ical_equals(value, "DATE");
+            }
+            if (p == end)
+                return;
+            std::string_view value(p + 1, static_cast<size_t>(end - p - 1));
+
+            if (ical_equals(name, "BEGIN")) {
+                if (inEvent)
+                    ++nested;
+                else if (ical_equals(value, "VEVENT"))
+                    beginEvent();
+                return;
+            }
+            if (ical_equals(name, "END")) {
+                if (inEvent && nested > 0)
+                    --nested;
+                else if (inEvent && ical_equals(value, "VEVENT"))
+                    endEvent();
+                return;
+            }
+            if (!inEvent || nested > 0)
+                return;
+            bool date = false;
+            if (ical_equals(name, "DTSTART")) {
+                hasStart = parseTime(value, tzid, date, event.start);
+                event.allDay = hasStart && (date || dateParam);
+            }
+            else if (ical_equals(name, "DTEND")) {
+                hasEnd = parseTime(value, tzid, date, event.end);
+            }
+            else if (ical_equals(name, "DURATION")) {
+                hasDuration = parseDuration(value, duration);
+            }
+            else if (ical_equals(name, "SUMMARY")) {
+                addText(value, event.summary, event.summaryLength);
+            }
+            else if (ical_equals(name, "UID")) {
+                addText(value, event.uid, event.uidLength);
+            }
+        }
+
+    public:
+        IcalParser(const IcalImportOptions& options, const Sink& sink, IcalImportReport& report)
+            : options(options), sink(sink), report(report) {};
+
+        //parses [data, data + size); when release is set, consumed whole pages are dropped from
+        //the mapping as parsing goes so a large file does not stay resident
+        void parse(const char* data, size_t size, bool release) {
+            const size_t releaseStep = size_t(32) << 20;
+            const char* released = data;
+            const char* p = data;
+            const char* end = data + size;
+            while (p < end) {
+                const char* eol = ical_find(p, end, '\n', '\n');
+                const char* next = eol < end ? eol + 1 : end;
+                const char* stop = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+                std::string_view line(p, static_cast<size_t>(stop - p));
+                if (next < end && (*next == ' ' || *next == '\t')) {
+                    folded.assign(line.data(), line.size());
+                    while (next < end && (*next == ' ' || *next == '\t')) {
+                        const char* start = next + 1;
+                        eol = ical_find(start, end, '\n', '\n');
+                        stop = eol > start && eol[-1] == '\r' ? eol - 1 : eol;
+                        folded.append(start, static_cast<size_t>(stop - start));
+                        next = eol < end ? eol + 1 : end;
+                    }
+                    line = folded;
+                }
+                p = next;
+                property(line);
+                if (release && static_cast<size_t>(p - released) >= releaseStep) {
+                    size_t length = static_cast<size_t>(p - released) & ~static_cast<size_t>(sysconf(_SC_PAGESIZE) - 1);
+                    madvise(const_cast<char*>(released), length, MADV_DONTNEED);
+                    released += length;
+                }
+            }
+            flush();
+            report.bytes += size;
+        }
+
+        void flush() {
+            if (batch.events.empty())
+                return;
+            sink(batch);
+            ++report.batches;
+            batch.clear();
+            textMark = 0;
+        }
+    };
+} // namespace detail
+
+//parses iCalendar data and hands the VEVENTs over in batches of options.batchSize, so a caller on
+//another thread can forward them to the UI thread; the sink may keep the batch by swapping it out
+inline IcalImportReport parse_ical(const char* data, size_t size, const std::function<void(CalendarEventBatch&)>& sink,
+    const IcalImportOptions& options = IcalImportOptions()) {
+    IcalImportReport report;
+    auto begun = std::chrono::steady_clock::now();
+    detail::IcalParser parser(options, sink, report);
+    parser.parse(data, size, false);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begun).count();
+    return report;
+}
+
+//maps an .ics file and appends its events to calendar batch by batch; UI thread only
+inline IcalImportReport import_ical(CalendarWidget& calendar, const std::string& path,
+    const IcalImportOptions& options = IcalImportOptions()) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        throw std::runtime_error("ical: cannot open " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        throw std::runtime_error("ical: cannot stat " + path);
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    IcalImportReport report;
+    if (size == 0) {
+        close(fd);
+        return report;
+    }
+    void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+        throw std::runtime_error("ical: cannot map " + path);
+    madvise(mapped, size, MADV_SEQUENTIAL);
+
+    auto begun = std::chrono::steady_clock::now();
+    std::function<void(CalendarEventBatch&)> sink = [&](CalendarEventBatch& batch) {
+        calendar.addEvents(batch);
+    };
+    try {
+        detail::IcalParser parser(options, sink, report);
+        parser.parse(static_cast<const char*>(mapped), size, true);
+    }
+    catch (...) {
+        munmap(mapped, size);
+        throw;
+    }
+    munmap(mapped, size);
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begun).count();
+    return report;
+}
+
+#endif
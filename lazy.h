@@ -0,0 +1,106 @@
+#ifndef _LAZY_H_
+#define _LAZY_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <utility>
+
+#include "memory.h"
+
+//shared resource built on first use instead of at startup, e.g. font tables or calendar locales.
+//the first get() or shared() runs the factory once under a mutex, every later access is one
+//acquire load. a factory that throws, returns null or runs out of memory for the owner leaves the
+//instance unbuilt and the exception reaches the caller; the next access retries.
+//shared() hands out owners with atomic counts that may be kept and dropped on any thread, get()
+//borrows the object for as long as the instance is not torn down
+template<typename T>
+class MyLazyShared
+{
+public:
+    using Pointer = MySharedPtr<T, default_delete<T>, AtomicRefCount>;
+    using Factory = std::function<T*()>;
+
+private:
+    Factory factory;
+    std::mutex mutex;
+    std::atomic<T*> object{ nullptr };
+    Pointer* holder = nullptr;              //written before object is published, read after it
+    std::atomic<uint64_t> constructionNs{ 0 };
+    std::atomic<uint32_t> constructions{ 0 };
+
+    T* construct() {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (T* built = object.load(std::memory_order_relaxed))
+            return built;
+        auto started = std::chrono::steady_clock::now();
+        MyUniquePtr<T> made(factory());
+        if (!made)
+            throw std::bad_alloc();
+        //the holder is allocated while made still owns the object, and the owner's constructor
+        //deletes the object itself when its control block cannot be allocated
+        MyUniquePtr<Pointer> slot(new Pointer());
+        Pointer owner(made.release());
+        *slot = std::move(owner);
+        holder = slot.release();
+        T* built = holder->get();
+        constructionNs.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - started).count()), std::memory_order_relaxed);
+        constructions.fetch_add(1, std::memory_order_relaxed);
+        object.store(built, std::memory_order_release);
+        return built;
+    }
+
+public:
+    MyLazyShared() : factory([] { return new T(); }) {};
+    explicit MyLazyShared(Factory factory) : factory(std::move(factory)) {};
+
+    MyLazyShared(const MyLazyShared& other) = delete;
+    MyLazyShared& operator=(const MyLazyShared& other) = delete;
+
+    ~MyLazyShared() {
+        teardown();
+    }
+
+    //borrowed reference, valid until teardown()
+    T& get() {
+        T* built = object.load(std::memory_order_acquire);
+        return *(built ? built : construct());
+    }
+    T* operator->() {
+        return &get();
+    }
+    //owning reference that keeps the object alive past teardown()
+    Pointer shared() {
+        if (!object.load(std::memory_order_acquire))
+            construct();
+        return *holder;
+    }
+
+    bool initialized() const noexcept {
+        return object.load(std::memory_order_acquire) != nullptr;
+    }
+
+    //drops the instance's own reference, the object goes with the last shared() owner and the
+    //next access builds a new one. callers make sure no other thread is inside get() or shared()
+    void teardown() {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (!object.exchange(nullptr, std::memory_order_acq_rel))
+            return;
+        delete holder;
+        holder = nullptr;
+    }
+
+    //time spent in the factory, the cold start cost moved from startup to first use
+    uint64_t constructionTimeNs() const noexcept {
+        return constructionNs.load(std::memory_order_relaxed);
+    }
+    uint32_t constructionCount() const noexcept {
+        return constructions.load(std::memory_order_relaxed);
+    }
+};
+
+#endif
@@ -1,8 +1,12 @@
 #ifndef _MEMORY_H_
 #define _MEMORY_H_
 
+#include <atomic>
+#include <cstdint>
 #include <utility>
 
+#include "arena.h"
+
 //default_delete
 template <typename T>
 struct default_delete {
@@ -182,84 +186,174 @@ make_my_unique(std::size_t n)
 }
 
 
-//shared_ptr control block
-template<typename T, typename Deleter = default_delete<T>>
+//reference count policies for ControlBlock: plain counters for objects confined to one thread,
+//atomic ones for objects whose owners and observers live on several threads
+struct SingleThreadedRefCount
+{
+    using Counter = size_t;
+    static void increment(Counter& count) noexcept { ++count; }
+    static bool incrementIfNonZero(Counter& count) noexcept {
+        if (count == 0)
+            return false;
+        ++count;
+        return true;
+    }
+    static size_t decrement(Counter& count) noexcept { return --count; }
+    static size_t load(const Counter& count) noexcept { return count; }
+};
+struct AtomicRefCount
+{
+    using Counter = std::atomic<size_t>;
+    static void increment(Counter& count) noexcept { count.fetch_add(1, std::memory_order_relaxed); }
+    static bool incrementIfNonZero(Counter& count) noexcept {
+        size_t current = count.load(std::memory_order_relaxed);
+        while (current != 0) {
+            if (count.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return true;
+        }
+        return false;
+    }
+    static size_t decrement(Counter& count) noexcept { return count.fetch_sub(1, std::memory_order_acq_rel) - 1; }
+    static size_t load(const Counter& count) noexcept { return count.load(std::memory_order_acquire); }
+};
+
+//shared_ptr control block. the strong owners together hold one weak reference, dropped by the
+//last strong release, so the block is deleted exactly once, by whoever drops the last weak reference
+template<typename T, typename Deleter = default_delete<T>, typename Policy = SingleThreadedRefCount>
 class ControlBlock
 {
 private:
-    size_t strong_ref;      //strong ref count
-    size_t weak_ref;        //weak ref count
+    typename Policy::Counter strong_ref;    //strong ref count
+    typename Policy::Counter weak_ref;      //weak ref count, plus one while strong_ref > 0
     Deleter deleter;
 public:
-    constexpr explicit ControlBlock() noexcept : strong_ref(1), weak_ref(0) {};
-    constexpr explicit ControlBlock(Deleter* deleter) noexcept : strong_ref(1), weak_ref(0), deleter(deleter) {};
+    constexpr explicit ControlBlock() noexcept : strong_ref(1), weak_ref(1) {};
+    constexpr explicit ControlBlock(Deleter deleter) noexcept : strong_ref(1), weak_ref(1), deleter(std::move(deleter)) {};
 
-    ControlBlock(const ControlBlock& other) {};
+    ControlBlock(const ControlBlock& other) = delete;
     ControlBlock& operator=(const ControlBlock& other) = delete;
     ControlBlock(ControlBlock&& other) = delete;
     ControlBlock& operator=(ControlBlock&& other) = delete;
 
+    //allocated from the current thread's arena when one is active
+    static void* operator new(size_t size) {
+        return arena_allocate(size);
+    }
+    static void operator delete(void* ptr, size_t size) noexcept {
+        arena_deallocate(ptr, size);
+    }
+
     void incrementStrongRef() {
-        strong_ref++;
+        Policy::increment(strong_ref);
     }
-    void decrementStrongRef() {
-        strong_ref--;
-        if (strong_ref == 0 && weak_ref == 0) {
-            delete this;
-        }
+    //for weak to strong promotion, fails once the object is gone
+    bool incrementStrongRefIfAlive() {
+        return Policy::incrementIfNonZero(strong_ref);
+    }
+    //returns the strong references left; at zero the caller deletes the object, and the block
+    //may already be gone, so callers copy the deleter first
+    size_t decrementStrongRef() {
+        size_t remaining = Policy::decrement(strong_ref);
+        if (remaining == 0)
+            decrementWeakRef();
+        return remaining;
     }
 
     void incrementWeakRef() {
-        weak_ref++;
+        Policy::increment(weak_ref);
     }
     void decrementWeakRef() {
-        weak_ref--;
-        if (strong_ref == 0 && weak_ref == 0) {
+        if (Policy::decrement(weak_ref) == 0) {
             delete this;
         }
     }
 
-    size_t getStrongRef() noexcept { return strong_ref; };
-    size_t getWeakRef() noexcept { return weak_ref; };
+    size_t getStrongRef() noexcept { return Policy::load(strong_ref); };
+    size_t getWeakRef() noexcept {
+        size_t weak = Policy::load(weak_ref);
+        return Policy::load(strong_ref) != 0 && weak != 0 ? weak - 1 : weak;
+    };
 
     Deleter getDeleter() noexcept { return deleter; };
 };
 
 
-//shared_ptr
-template<typename T, typename Deleter = default_delete<T>>
+//weak_ptr
+template<typename T, typename Deleter = default_delete<T>, typename Policy = SingleThreadedRefCount>
+class MyWeakPtr;
+
+//shared_ptr, AtomicRefCount as the policy lets copies live on several threads
+template<typename T, typename Deleter = default_delete<T>, typename Policy = SingleThreadedRefCount>
 class MySharedPtr
 {
 private:
-    ControlBlock<T, Deleter>* cb;
+    ControlBlock<T, Deleter, Policy>* cb;
     T* ptr;
-public:
-    //constructor and destructor
-    constexpr MySharedPtr() : ptr(nullptr), cb(nullptr) {};
-    constexpr explicit MySharedPtr(T* ptr) noexcept : ptr(ptr), cb(new ControlBlock<T, Deleter>()) { };
 
-    template<typename T, typename Deleter>
-    constexpr MySharedPtr(T* ptr, Deleter del) noexcept : ptr(ptr), cb(ControlBlock(del)) {};
+    void adopt(T* object, Deleter del) {
+        if (!object)
+            return;
+        try {
+            cb = new ControlBlock<T, Deleter, Policy>(del);
+        }
+        catch (...) {
+            del(object);
+            ptr = nullptr;
+            throw;
+        }
+    }
+    //drops this owner, deleting the object when it was the last one. decided on the count the
+    //release left, so concurrent releases delete exactly once
+    void release() noexcept {
+        if (cb) {
+            Deleter deleter = cb->getDeleter();
+            if (cb->decrementStrongRef() == 0)
+                deleter(ptr);
+        }
+        cb = nullptr;
+        ptr = nullptr;
+    }
+public:
+    //constructor and destructor, a null pointer gets no control block; when the control block
+    //cannot be allocated the object is deleted and bad_alloc propagates
+    constexpr MySharedPtr() noexcept : cb(nullptr), ptr(nullptr) {};
+    explicit MySharedPtr(T* ptr) : cb(nullptr), ptr(ptr) {
+        adopt(ptr, Deleter());
+    };
+    MySharedPtr(T* ptr, Deleter del) : cb(nullptr), ptr(ptr) {
+        adopt(ptr, std::move(del));
+    };
+    //shares ownership with a weak pointer's object, empty when it has expired
+    explicit MySharedPtr(const MyWeakPtr<T, Deleter, Policy>& weak) noexcept : cb(nullptr), ptr(nullptr) {
+        if (weak.cb && weak.cb->incrementStrongRefIfAlive()) {
+            cb = weak.cb;
+            ptr = weak.ptr;
+        }
+    }
 
-    constexpr MySharedPtr(const MySharedPtr& other) noexcept : ptr(other.ptr), cb(other.cb) {
-        cb->incrementStrongRef();
+    MySharedPtr(const MySharedPtr& other) noexcept : cb(other.cb), ptr(other.ptr) {
+        if (cb)
+            cb->incrementStrongRef();
     }
-    constexpr MySharedPtr& operator=(const MySharedPtr& other) noexcept {
+    MySharedPtr& operator=(const MySharedPtr& other) noexcept {
         if (this != &other)
         {
+            if (other.cb)
+                other.cb->incrementStrongRef();
+            release();
             ptr = other.ptr;
             cb = other.cb;
-            cb->incrementStrongRef();
         }
         return*this;
     }
-    constexpr MySharedPtr(MySharedPtr&& other) noexcept : ptr(other.ptr), cb(other.cb) {
+    constexpr MySharedPtr(MySharedPtr&& other) noexcept : cb(other.cb), ptr(other.ptr) {
         other.ptr = nullptr;
         other.cb = nullptr;
     }
-    constexpr MySharedPtr& operator=(MySharedPtr&& other) noexcept {
+    MySharedPtr& operator=(MySharedPtr&& other) noexcept {
         if (this != &other)
         {
+            release();
             ptr = other.ptr;
             cb = other.cb;
             other.ptr = nullptr;
@@ -269,7 +363,7 @@ public:
     }
 
     ~MySharedPtr() {
-        reset();
+        release();
     }
 
     //operator and data access methods
@@ -282,7 +376,7 @@ public:
     T* get() const {
         return ptr;
     }
-    ControlBlock<T, Deleter>* getCB() const noexcept {
+    ControlBlock<T, Deleter, Policy>* getCB() const noexcept {
         return cb;
     }
     Deleter getDeleter() noexcept {
@@ -292,19 +386,16 @@ public:
         return  cb ? cb->getStrongRef() : 0;
     }
     //other methods
-    template< class Y >
-    bool owner_before(const MySharedPtr<Y>& other) const noexcept {
-        return this->cb->getStrongRef() < other.cb->getStrongRef() ? true : false;
+    template<class Y, class D, class P>
+    bool owner_before(const MySharedPtr<Y, D, P>& other) const noexcept {
+        return reinterpret_cast<uintptr_t>(cb) < reinterpret_cast<uintptr_t>(other.getCB());
     }
     bool unique() const noexcept {
-        return this->cb->getStrongRef() == 1 ? true : false;
+        return use_count() == 1;
     }
-    constexpr void reset(T* newPtr = nullptr) noexcept {
-        if (cb) {
-            if (use_count() - 1 == 0 || cb == nullptr)
-                cb->getDeleter()(ptr);
-            cb->decrementStrongRef();
-        }
+    void reset(T* newPtr = nullptr) {
+        MySharedPtr replacement(newPtr);
+        *this = std::move(replacement);
     }
     explicit operator bool() const noexcept {
         return get() != nullptr ? true : false;
@@ -312,37 +403,42 @@ public:
 };
 
 //weak_ptr
-template<typename T, typename Deleter = default_delete<T>>
+template<typename T, typename Deleter, typename Policy>
 class MyWeakPtr
 {
 private:
+    friend class MySharedPtr<T, Deleter, Policy>;
+
+    using Shared = MySharedPtr<T, Deleter, Policy>;
+
     T* ptr;
-    ControlBlock<T, Deleter>* cb;
+    ControlBlock<T, Deleter, Policy>* cb;
 public:
-    MyWeakPtr() : ptr(nullptr), cb(nullptr) {};
-    explicit MyWeakPtr(const MySharedPtr<T>& shared_ptr) noexcept : ptr(shared_ptr.get()), cb(shared_ptr.getCB()) {
-        cb->incrementWeakRef();
+    MyWeakPtr() noexcept : ptr(nullptr), cb(nullptr) {};
+    explicit MyWeakPtr(const Shared& shared_ptr) noexcept : ptr(shared_ptr.get()), cb(shared_ptr.getCB()) {
+        if (cb)
+            cb->incrementWeakRef();
     };
-    MyWeakPtr(const MyWeakPtr& other) : ptr(other.ptr), cb(other.cb) {
-        cb->incrementWeakRef();
+    MyWeakPtr(const MyWeakPtr& other) noexcept : ptr(other.ptr), cb(other.cb) {
+        if (cb)
+            cb->incrementWeakRef();
     };
-    MyWeakPtr& operator=(const MyWeakPtr& other) {
+    MyWeakPtr& operator=(const MyWeakPtr& other) noexcept {
         if (this != &other) {
-            cb->incrementWeakRef();
+            if (other.cb)
+                other.cb->incrementWeakRef();
+            reset();
             ptr = other.ptr;
             cb = other.cb;
         }
         return *this;
     }
-    MyWeakPtr& operator=(const MySharedPtr<T>& shared_ptr) noexcept {
-        if (shared_ptr.get() == nullptr) {
-            reset();
-        }
-        else {
-            ptr = shared_ptr.get();
-            cb = shared_ptr.getCB();
-            cb->incrementWeakRef();
-        }
+    MyWeakPtr& operator=(const Shared& shared_ptr) noexcept {
+        if (shared_ptr.getCB())
+            shared_ptr.getCB()->incrementWeakRef();
+        reset();
+        ptr = shared_ptr.get();
+        cb = shared_ptr.getCB();
         return *this;
     }
 
@@ -356,17 +452,21 @@ public:
         return !expired();
     }
     bool expired() const {
-        return cb->getStrongRef() == 0;
+        return !cb || cb->getStrongRef() == 0;
     }
-    MySharedPtr<T> lock() const {
-        return expired() ? MySharedPtr<T>() : MySharedPtr<T>(*this);
+    Shared lock() const noexcept {
+        return Shared(*this);
     }
     size_t use_count() const noexcept {
         return  cb ? cb->getStrongRef() : 0;
     }
-    void reset() {
+    ControlBlock<T, Deleter, Policy>* getCB() const noexcept {
+        return cb;
+    }
+    void reset() noexcept {
         ptr = nullptr;
-        cb->decrementWeakRef();
+        if (cb)
+            cb->decrementWeakRef();
         cb = nullptr;
     }
 };
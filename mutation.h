@@ -0,0 +1,295 @@
+#ifndef _MUTATION_H_
+#define _MUTATION_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "fork_locks.h"
+
+class Widget;
+
+enum class MutationKind : uint8_t
+{
+    Added = 1,          //node, new parent, type name; appended to the parent's children
+    Removed = 2,        //node, old parent; the whole subtree leaves the tree
+    Reparented = 3,     //node, old parent, new parent; appended to the new parent's children
+    Property = 4        //node, key, value bytes
+};
+
+//collects mutations of the tree under one root during a frame, coalesces them and delivers one
+//binary batch per flush(). only nodes reachable from the root are reported: subtrees built or
+//changed while detached produce no records until they are attached, and are then reported whole.
+//batch layout: record count varint, then per record kind u8, node id varint and the fields listed
+//in MutationKind, strings and values as length varint plus bytes; node ids are widget addresses.
+//removals come first, then additions and moves with parents before children and siblings in the
+//order they were appended, then property changes. widgets may report from any thread, the records
+//are locked; the tree itself is only changed and encoded on the UI thread
+class MutationFeed
+{
+public:
+    using Subscriber = std::function<void(const uint8_t* data, size_t size)>;
+
+private:
+    struct NodeState
+    {
+        bool structural = false;        //saw an add or a remove this frame
+        bool attachedAtStart = false;   //reachable from the root when the frame began
+        uint64_t sequence = 0;          //order of the latest attach
+        std::vector<const Widget*> startChain;      //ancestors at frame start, parent first
+        std::vector<std::pair<std::string, std::string>> properties;
+    };
+    struct Removal
+    {
+        const Widget* node;             //compared only, the widget is gone
+        std::vector<const Widget*> startChain;
+    };
+
+    const Widget* root;
+    mutable std::mutex recordMutex;     //guards the records, widgets on any thread report to the feed
+    std::unordered_map<const Widget*, NodeState> nodes;
+    std::vector<Removal> pendingRemovals;       //destroyed widgets that were attached at frame start
+    std::mutex subscriberMutex;         //guards the list, subscribers may be added from any thread
+    std::vector<std::pair<uint64_t, Subscriber>> subscribers;
+    uint64_t nextSubscriber = 1;
+    uint64_t nextSequence = 0;
+    uint64_t forkHooks[2];
+
+    //read from widget destructors on worker threads while the UI thread installs feeds
+    static std::atomic<MutationFeed*>& activeFeed() noexcept {
+        static std::atomic<MutationFeed*> feed{ nullptr };
+        return feed;
+    }
+    static bool& suppressedHere() noexcept {
+        static thread_local bool suppressed = false;
+        return suppressed;
+    }
+
+    static void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+    static void putBytes(std::vector<uint8_t>& out, const void* data, size_t size) {
+        putVarint(out, size);
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        out.insert(out.end(), bytes, bytes + size);
+    }
+    static uint64_t id(const Widget* widget) noexcept {
+        return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(widget));
+    }
+
+    //where a node detached by the first structural change of the frame sat at frame start;
+    //parent is its owner until a moment ago, defined in Widget.h. called with recordMutex held
+    void recordStart(NodeState& state, const Widget* parent);
+
+public:
+    //mirrors the tree under root, which the subscribers are assumed to know already
+    explicit MutationFeed(const Widget* root) : root(root) {
+        forkHooks[0] = ForkLocks::instance().add(recordMutex);
+        forkHooks[1] = ForkLocks::instance().add(subscriberMutex);
+    }
+    MutationFeed(const MutationFeed& other) = delete;
+    MutationFeed& operator=(const MutationFeed& other) = delete;
+
+    ~MutationFeed() {
+        ForkLocks::instance().remove(forkHooks[0]);
+        ForkLocks::instance().remove(forkHooks[1]);
+        MutationFeed* self = this;
+        activeFeed().compare_exchange_strong(self, nullptr, std::memory_order_acq_rel);
+    }
+
+    const Widget* getRoot() const noexcept {
+        return root;
+    }
+
+    //the feed widgets report to, nullptr disables recording; install from the UI thread
+    static MutationFeed* active() noexcept {
+        return suppressedHere() ? nullptr : activeFeed().load(std::memory_order_acquire);
+    }
+    static void install(MutationFeed* feed) noexcept {
+        activeFeed().store(feed, std::memory_order_release);
+    }
+
+    //hides the feed from widgets on the current thread while in scope, so detached subtrees can be
+    //built or destroyed off the UI thread; whoever attaches them reports them afterwards
+    class Suppress
+    {
+    private:
+        bool previous;
+    public:
+        Suppress() noexcept : previous(suppressedHere()) {
+            suppressedHere() = true;
+        }
+        Suppress(const Suppress& other) = delete;
+        Suppress& operator=(const Suppress& other) = delete;
+        ~Suppress() {
+            suppressedHere() = previous;
+        }
+    };
+
+    //subscribers
+    uint64_t subscribe(Subscriber subscriber) {
+        std::lock_guard<std::mutex> lock(subscriberMutex);
+        subscribers.emplace_back(nextSubscriber, std::move(subscriber));
+        return nextSubscriber++;
+    }
+    void unsubscribe(uint64_t handle) {
+        std::lock_guard<std::mutex> lock(subscriberMutex);
+        for (size_t i = 0; i < subscribers.size(); ++i) {
+            if (subscribers[i].first == handle) {
+                subscribers.erase(subscribers.begin() + i);
+                return;
+            }
+        }
+    }
+
+    //recording, called by Widget after the change
+    void childAdded(const Widget* parent, const Widget* child) {
+        (void)parent;
+        std::lock_guard<std::mutex> lock(recordMutex);
+        NodeState& state = nodes[child];
+        if (!state.structural) {
+            //a widget gets a parent only while it has none, so it was detached at frame start
+            state.structural = true;
+            state.attachedAtStart = false;
+        }
+        state.sequence = ++nextSequence;
+    }
+    void childRemoved(const Widget* parent, const Widget* child) {
+        std::lock_guard<std::mutex> lock(recordMutex);
+        NodeState& state = nodes[child];
+        if (!state.structural) {
+            state.structural = true;
+            recordStart(state, parent);
+        }
+    }
+    void propertyChanged(const Widget* widget, const std::string& key, const void* data, size_t size) {
+        std::string value(static_cast<const char*>(data), size);
+        std::lock_guard<std::mutex> lock(recordMutex);
+        NodeState& state = nodes[widget];
+        for (auto& property : state.properties) {
+            if (property.first == key) {
+                property.second = std::move(value);
+                return;
+            }
+        }
+        state.properties.emplace_back(key, std::move(value));
+    }
+    //forgets a widget that is being destroyed, its address may be reused within the frame
+    void widgetDestroyed(const Widget* widget) {
+        std::lock_guard<std::mutex> lock(recordMutex);
+        auto it = nodes.find(widget);
+        if (it == nodes.end())
+            return;
+        if (it->second.structural && it->second.attachedAtStart) {
+            //keep the removal apart from nodes, a new widget may take the address
+            pendingRemovals.push_back(Removal{ widget, std::move(it->second.startChain) });
+        }
+        nodes.erase(it);
+    }
+
+    size_t pendingRecords() const {
+        std::lock_guard<std::mutex> lock(recordMutex);
+        return nodes.size() + pendingRemovals.size();
+    }
+
+    //coalesces the frame's records into a batch, clears them and returns the batch
+    std::vector<uint8_t> encode();
+    //encodes and hands the batch to every subscriber, nothing is sent for an empty frame.
+    //the subscribers are called without the list locked, so they may take any lock and subscribe
+    //or unsubscribe, the change applies from the next frame
+    void flush() {
+        if (pendingRecords() == 0)
+            return;
+        std::vector<uint8_t> batch = encode();
+        std::vector<std::pair<uint64_t, Subscriber>> current;
+        {
+            std::lock_guard<std::mutex> lock(subscriberMutex);
+            current = subscribers;
+        }
+        for (auto& subscriber : current)
+            subscriber.second(batch.data(), batch.size());
+    }
+};
+
+
+//record decoded from a batch, strings point into the batch
+struct MutationRecord
+{
+    MutationKind kind;
+    uint64_t node;
+    uint64_t oldParent;
+    uint64_t newParent;
+    const char* text;       //type name or property key
+    size_t textSize;
+    const char* value;
+    size_t valueSize;
+};
+
+//walks the records of a batch produced by MutationFeed
+class MutationBatchReader
+{
+private:
+    const uint8_t* cursor;
+    const uint8_t* end;
+    uint64_t remaining;
+
+    bool getVarint(uint64_t& value) noexcept {
+        value = 0;
+        for (unsigned shift = 0; cursor < end && shift < 64; shift += 7) {
+            uint8_t byte = *cursor++;
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+    bool getBytes(const char*& data, size_t& size) noexcept {
+        uint64_t length;
+        if (!getVarint(length) || static_cast<uint64_t>(end - cursor) < length)
+            return false;
+        data = reinterpret_cast<const char*>(cursor);
+        size = static_cast<size_t>(length);
+        cursor += length;
+        return true;
+    }
+
+public:
+    MutationBatchReader(const uint8_t* data, size_t size) noexcept : cursor(data), end(data + size), remaining(0) {
+        if (!getVarint(remaining))
+            remaining = 0;
+    }
+
+    //false once the batch is exhausted or malformed
+    bool next(MutationRecord& record) noexcept {
+        if (remaining == 0 || cursor >= end)
+            return false;
+        --remaining;
+        record = MutationRecord{ static_cast<MutationKind>(*cursor++), 0, 0, 0, nullptr, 0, nullptr, 0 };
+        if (!getVarint(record.node))
+            return false;
+        switch (record.kind) {
+        case MutationKind::Added:
+            return getVarint(record.newParent) && getBytes(record.text, record.textSize);
+        case MutationKind::Removed:
+            return getVarint(record.oldParent);
+        case MutationKind::Reparented:
+            return getVarint(record.oldParent) && getVarint(record.newParent);
+        case MutationKind::Property:
+            return getBytes(record.text, record.textSize) && getBytes(record.value, record.valueSize);
+        }
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef _OBSERVER_H_
+#define _OBSERVER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+#include "memory.h"
+
+//non owning references to objects held by MyUniquePtr. an observable object shares a small token
+//with its observers, allocated the first time someone observes it, and marks the token dead when
+//it is destroyed; the token itself lives until the object and the last observer are gone.
+//the token only tells whether the object is still alive, it does not keep it alive, so an observer
+//is dereferenced on the thread that owns the object. observers may be copied and dropped anywhere
+
+namespace detail
+{
+    struct LivenessToken
+    {
+        std::atomic<uint32_t> refs;         //owner plus observers
+        std::atomic<bool> alive;
+
+        LivenessToken() noexcept : refs(1), alive(true) {};
+
+        void acquire() noexcept {
+            refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        void release() noexcept {
+            if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete this;
+        }
+    };
+
+    //shared by every destroyed object so observing one never allocates a live token;
+    //its count starts high enough that it is never deleted
+    inline LivenessToken* expired_liveness_token() noexcept {
+        static LivenessToken* expired = [] {
+            static LivenessToken token;
+            token.refs.store(1u << 31, std::memory_order_relaxed);
+            token.alive.store(false, std::memory_order_relaxed);
+            return &token;
+        }();
+        return expired;
+    }
+} // namespace detail
+
+//opt in base for observable types, costs one pointer until the first observer appears
+class MyObservable
+{
+private:
+    mutable std::atomic<detail::LivenessToken*> token{ nullptr };
+
+protected:
+    MyObservable() noexcept = default;
+    //a copy is a different object with its own observers
+    MyObservable(const MyObservable& /*other*/) noexcept {};
+    MyObservable& operator=(const MyObservable& /*other*/) noexcept {
+        return *this;
+    }
+
+    ~MyObservable() {
+        expireObservers();
+    }
+
+    //marks observers expired, including ones made afterwards. derived destructors call this first
+    //so observers never see a half destroyed object
+    void expireObservers() noexcept {
+        detail::LivenessToken* expired = detail::expired_liveness_token();
+        detail::LivenessToken* current = token.exchange(expired, std::memory_order_acq_rel);
+        if (current && current != expired) {
+            current->alive.store(false, std::memory_order_release);
+            current->release();
+        }
+    }
+
+public:
+    //the token shared with observers, created on first use; the caller receives one reference
+    detail::LivenessToken* acquireLivenessToken() const {
+        detail::LivenessToken* current = token.load(std::memory_order_acquire);
+        if (!current) {
+            detail::LivenessToken* created = new detail::LivenessToken();
+            if (token.compare_exchange_strong(current, created, std::memory_order_acq_rel, std::memory_order_acquire))
+                current = created;
+            else
+                delete created;
+        }
+        current->acquire();
+        return current;
+    }
+    bool isObserved() const noexcept {
+        detail::LivenessToken* current = token.load(std::memory_order_acquire);
+        return current && current != detail::expired_liveness_token();
+    }
+};
+
+//weak reference to a uniquely owned object deriving from MyObservable
+template<typename T>
+class MyUniqueObserver
+{
+    static_assert(std::is_base_of<MyObservable, T>::value, "observed types must derive from MyObservable");
+
+private:
+    T* ptr;
+    detail::LivenessToken* token;
+
+public:
+    //constructor and destructor
+    constexpr MyUniqueObserver() noexcept : ptr(nullptr), token(nullptr) {};
+    explicit MyUniqueObserver(T* object) : ptr(object), token(object ? object->acquireLivenessToken() : nullptr) {};
+    template<typename Y, typename Deleter, typename = std::enable_if_t<std::is_convertible<Y*, T*>::value>>
+    explicit MyUniqueObserver(const MyUniquePtr<Y, Deleter>& owner) : MyUniqueObserver(static_cast<T*>(owner.get())) {};
+
+    MyUniqueObserver(const MyUniqueObserver& other) noexcept : ptr(other.ptr), token(other.token) {
+        if (token)
+            token->acquire();
+    }
+    MyUniqueObserver& operator=(const MyUniqueObserver& other) noexcept {
+        if (this != &other) {
+            if (other.token)
+                other.token->acquire();
+            reset();
+            ptr = other.ptr;
+            token = other.token;
+        }
+        return *this;
+    }
+    MyUniqueObserver(MyUniqueObserver&& other) noexcept : ptr(other.ptr), token(other.token) {
+        other.ptr = nullptr;
+        other.token = nullptr;
+    }
+    MyUniqueObserver& operator=(MyUniqueObserver&& other) noexcept {
+        if (this != &other) {
+            reset();
+            ptr = other.ptr;
+            token = other.token;
+            other.ptr = nullptr;
+            other.token = nullptr;
+        }
+        return *this;
+    }
+
+    ~MyUniqueObserver() {
+        reset();
+    }
+
+    //data access methods, nullptr once the object is gone
+    bool expired() const noexcept {
+        return !token || !token->alive.load(std::memory_order_acquire);
+    }
+    T* get() const noexcept {
+        return expired() ? nullptr : ptr;
+    }
+    T* operator->() const noexcept {
+        return get();
+    }
+    T& operator*() const noexcept {
+        return *get();
+    }
+
+    void reset() noexcept {
+        if (token)
+            token->release();
+        ptr = nullptr;
+        token = nullptr;
+    }
+
+    explicit operator bool() const noexcept {
+        return !expired();
+    }
+};
+
+#endif
@@ -0,0 +1,239 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "channel.h"
+#include "memory.h"
+#include "Widget.h"
+
+//latency of one pipeline stage
+struct StageMetrics
+{
+    uint64_t count = 0;
+    uint64_t totalNs = 0;
+    uint64_t maxNs = 0;
+
+    double averageMs() const noexcept {
+        return count ? totalNs / 1e6 / count : 0.0;
+    }
+};
+
+struct PipelineMetrics
+{
+    StageMetrics update;        //UI thread, beginFrame() to submit()
+    StageMetrics queue;         //waiting for the paint worker
+    StageMetrics paint;         //display list building on the worker
+    StageMetrics latency;       //beginFrame() to paint list ready
+    double framesPerSecond = 0.0;
+};
+
+//immutable copy of what a painter needs from a widget tree, taken on the UI thread at submit time
+//so the worker never reads live widgets. nodes are in pre-order, children follow their parent
+struct WidgetFrame
+{
+    struct Node
+    {
+        uint64_t id;            //widget address, matches the mutation feed ids
+        uint32_t parent;        //index of the parent node, NO_PARENT for the root
+        uint32_t depth;
+        std::string type;
+        WidgetProperties properties;
+    };
+    static constexpr uint32_t NO_PARENT = 0xffffffffu;
+
+    std::vector<Node> nodes;
+
+    //snapshot of root and everything below it
+    static MyUniquePtr<const WidgetFrame> capture(const Widget& root) {
+        MyUniquePtr<WidgetFrame> frame(new WidgetFrame());
+        std::vector<std::pair<const Widget*, uint32_t>> stack(1, { &root, NO_PARENT });
+        while (!stack.empty()) {
+            const Widget* widget = stack.back().first;
+            uint32_t parent = stack.back().second;
+            stack.pop_back();
+            uint32_t index = static_cast<uint32_t>(frame->nodes.size());
+            uint32_t depth = parent == NO_PARENT ? 0 : frame->nodes[parent].depth + 1;
+            frame->nodes.push_back(Node{ static_cast<uint64_t>(reinterpret_cast<uintptr_t>(widget)), parent, depth,
+                widget->getType(), widget->getProperties() });
+            const auto& children = widget->getChildren();
+            for (size_t i = children.size(); i-- > 0;)
+                stack.emplace_back(children[i].get(), index);
+        }
+        return MyUniquePtr<const WidgetFrame>(frame.release());
+    }
+};
+
+//two stage frame pipeline: the UI thread updates frame N+1 while a worker builds the paint list
+//of frame N. Frames cross threads as immutable snapshots or change sets through bounded channels,
+//so at most queueDepth frames are in flight and a slow painter pushes back on the UI thread.
+//an exception thrown by the painter is carried to the UI thread and rethrown by collect()
+template<typename Frame, typename PaintList>
+class FramePipeline
+{
+public:
+    using Painter = std::function<MyUniquePtr<PaintList>(const Frame&)>;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Job
+    {
+        uint64_t id;
+        MyUniquePtr<const Frame> frame;
+        Clock::time_point begun;
+        Clock::time_point submitted;
+    };
+
+    struct Result
+    {
+        uint64_t id;
+        MyUniquePtr<PaintList> paint;
+        Clock::time_point begun;
+        std::exception_ptr error;
+    };
+
+    //stage counters written by one thread and read by any
+    struct AtomicStage
+    {
+        std::atomic<uint64_t> count{ 0 };
+        std::atomic<uint64_t> totalNs{ 0 };
+        std::atomic<uint64_t> maxNs{ 0 };
+
+        void record(Clock::duration elapsed) noexcept {
+            uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            count.fetch_add(1, std::memory_order_relaxed);
+            totalNs.fetch_add(ns, std::memory_order_relaxed);
+            uint64_t seen = maxNs.load(std::memory_order_relaxed);
+            while (ns > seen && !maxNs.compare_exchange_weak(seen, ns, std::memory_order_relaxed)) {}
+        }
+        StageMetrics read() const noexcept {
+            StageMetrics metrics;
+            metrics.count = count.load(std::memory_order_relaxed);
+            metrics.totalNs = totalNs.load(std::memory_order_relaxed);
+            metrics.maxNs = maxNs.load(std::memory_order_relaxed);
+            return metrics;
+        }
+    };
+
+    Painter painter;
+    SpscChannel<Job> toWorker;
+    SpscChannel<Result> toPresenter;
+    std::thread worker;
+    std::atomic<bool> finished;
+
+    uint64_t nextFrame;
+    Clock::time_point frameBegun;
+    Clock::time_point started;
+    AtomicStage updateStage, queueStage, paintStage, latencyStage;
+
+    void run() {
+        MyUniquePtr<Job> job;
+        while ((job = toWorker.pop())) {
+            Clock::time_point picked = Clock::now();
+            queueStage.record(picked - job->submitted);
+            MyUniquePtr<Result> result(new Result{ job->id, MyUniquePtr<PaintList>(), job->begun, nullptr });
+            try {
+                result->paint = painter(*job->frame);
+            }
+            catch (...) {
+                result->error = std::current_exception();
+            }
+            Clock::time_point done = Clock::now();
+            paintStage.record(done - picked);
+            latencyStage.record(done - job->begun);
+            job.reset();
+            toPresenter.push(std::move(result));
+        }
+        finished.store(true, std::memory_order_release);
+    }
+
+public:
+    //constructor and destructor, the worker starts right away
+    FramePipeline(Painter painter, size_t queueDepth = 2)
+        : painter(std::move(painter)), toWorker(queueDepth), toPresenter(queueDepth + 1), finished(false),
+        nextFrame(0), frameBegun(Clock::now()), started(Clock::now()) {
+        worker = std::thread(&FramePipeline::run, this);
+    }
+
+    FramePipeline(const FramePipeline& other) = delete;
+    FramePipeline& operator=(const FramePipeline& other) = delete;
+
+    //frames already queued are painted before the worker exits
+    ~FramePipeline() {
+        toWorker.close();
+        //keep draining so the worker never blocks on a full presenter channel
+        while (!finished.load(std::memory_order_acquire)) {
+            if (!toPresenter.tryPop())
+                std::this_thread::yield();
+        }
+        worker.join();
+    }
+
+    //UI thread: marks the start of the update stage of the next frame
+    void beginFrame() noexcept {
+        frameBegun = Clock::now();
+    }
+
+    //UI thread: hands the finished frame snapshot to the painter, waits while queueDepth frames are in flight;
+    //returns the frame id
+    uint64_t submit(MyUniquePtr<const Frame>&& frame) {
+        Clock::time_point now = Clock::now();
+        updateStage.record(now - frameBegun);
+        uint64_t id = nextFrame++;
+        toWorker.push(MyUniquePtr<Job>(new Job{ id, std::move(frame), frameBegun, now }));
+        return id;
+    }
+    //UI thread: like submit() but drops nothing and returns false instead of waiting when the queue is full
+    bool trySubmit(MyUniquePtr<const Frame>& frame, uint64_t& id) {
+        Clock::time_point now = Clock::now();
+        MyUniquePtr<Job> job(new Job{ nextFrame, std::move(frame), frameBegun, now });
+        if (!toWorker.tryPush(std::move(job))) {
+            frame = std::move(job->frame);
+            return false;
+        }
+        updateStage.record(now - frameBegun);
+        id = nextFrame++;
+        return true;
+    }
+
+    //UI thread: newest finished paint list, older finished ones are dropped; empty if none is ready.
+    //rethrows the exception of a frame whose painter threw, frames finished after it stay queued
+    MyUniquePtr<PaintList> collect(uint64_t* frameId = nullptr) {
+        MyUniquePtr<Result> latest;
+        while (MyUniquePtr<Result> result = toPresenter.tryPop()) {
+            if (result->error) {
+                if (frameId)
+                    *frameId = result->id;
+                std::rethrow_exception(result->error);
+            }
+            latest = std::move(result);
+        }
+        if (!latest)
+            return MyUniquePtr<PaintList>();
+        if (frameId)
+            *frameId = latest->id;
+        return std::move(latest->paint);
+    }
+
+    PipelineMetrics metrics() const noexcept {
+        PipelineMetrics result;
+        result.update = updateStage.read();
+        result.queue = queueStage.read();
+        result.paint = paintStage.read();
+        result.latency = latencyStage.read();
+        double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+        result.framesPerSecond = seconds > 0.0 ? result.paint.count / seconds : 0.0;
+        return result;
+    }
+};
+
+#endif
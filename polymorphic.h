@@ -0,0 +1,198 @@
+#ifndef _POLYMORPHIC_H_
+#define _POLYMORPHIC_H_
+
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+//value semantic holder for one object derived from Base. derived types of up to N bytes that are
+//nothrow movable live in the holder itself, larger ones on the heap. each stored type gets a table
+//of thunks for cloning, relocating and destroying it, so copies are deep, moves of inline objects
+//move construct into the destination, and Base needs no virtual destructor or clone method
+template<typename Base, size_t N = 4 * sizeof(void*)>
+class MyPolymorphicValue
+{
+    static_assert(!std::is_array<Base>::value, "polymorphic values hold single objects");
+
+private:
+    struct Ops
+    {
+        Base* (*clone)(const Base* source, void* buffer);   //nullptr for non copyable types
+        Base* (*relocate)(Base* source, void* buffer) noexcept;
+        void (*destroy)(Base* object) noexcept;
+        bool stored;                                        //inline in the buffer
+    };
+
+    template<typename D>
+    static constexpr bool fits_inline = sizeof(D) <= N && alignof(D) <= alignof(std::max_align_t)
+        && std::is_nothrow_move_constructible<D>::value;
+
+    template<typename D>
+    static Base* cloneThunk(const Base* source, void* buffer) {
+        const D& object = *static_cast<const D*>(source);
+        if constexpr (fits_inline<D>)
+            return ::new (buffer) D(object);
+        else
+            return new D(object);
+    }
+    template<typename D>
+    static Base* relocateThunk(Base* source, void* buffer) noexcept {
+        if constexpr (fits_inline<D>) {
+            D* object = static_cast<D*>(source);
+            Base* moved = ::new (buffer) D(std::move(*object));
+            object->~D();
+            return moved;
+        }
+        else {
+            (void)buffer;
+            return source;
+        }
+    }
+    template<typename D>
+    static void destroyThunk(Base* object) noexcept {
+        if constexpr (fits_inline<D>)
+            static_cast<D*>(object)->~D();
+        else
+            delete static_cast<D*>(object);
+    }
+
+    template<typename D>
+    static constexpr auto cloneThunkFor() noexcept -> Base* (*)(const Base*, void*) {
+        if constexpr (std::is_copy_constructible<D>::value)
+            return &cloneThunk<D>;
+        else
+            return nullptr;
+    }
+
+    template<typename D>
+    static constexpr Ops ops_for = {
+        cloneThunkFor<D>(),
+        &relocateThunk<D>,
+        &destroyThunk<D>,
+        fits_inline<D>
+    };
+
+    alignas(std::max_align_t) unsigned char buffer[N];
+    Base* ptr = nullptr;
+    const Ops* ops = nullptr;
+
+    void copyFrom(const MyPolymorphicValue& other) {
+        if (!other.ptr)
+            return;
+        if (!other.ops->clone)
+            throw std::logic_error("MyPolymorphicValue: stored type is not copyable");
+        ptr = other.ops->clone(other.ptr, buffer);
+        ops = other.ops;
+    }
+    void moveFrom(MyPolymorphicValue& other) noexcept {
+        if (!other.ptr)
+            return;
+        ptr = other.ops->relocate(other.ptr, buffer);
+        ops = other.ops;
+        other.ptr = nullptr;
+        other.ops = nullptr;
+    }
+
+public:
+    //constructor and destructor
+    MyPolymorphicValue() noexcept {};
+    template<typename D, typename... Args>
+    explicit MyPolymorphicValue(std::in_place_type_t<D>, Args&&... args) {
+        emplace<D>(std::forward<Args>(args)...);
+    }
+    template<typename D, typename = std::enable_if_t<std::is_base_of<Base, std::decay_t<D>>::value
+        && !std::is_same<std::decay_t<D>, MyPolymorphicValue>::value>>
+    MyPolymorphicValue(D&& value) {
+        emplace<std::decay_t<D>>(std::forward<D>(value));
+    }
+
+    MyPolymorphicValue(const MyPolymorphicValue& other) {
+        copyFrom(other);
+    }
+    MyPolymorphicValue& operator=(const MyPolymorphicValue& other) {
+        if (this != &other) {
+            MyPolymorphicValue copy(other);
+            reset();
+            moveFrom(copy);
+        }
+        return *this;
+    }
+    MyPolymorphicValue(MyPolymorphicValue&& other) noexcept {
+        moveFrom(other);
+    }
+    MyPolymorphicValue& operator=(MyPolymorphicValue&& other) noexcept {
+        if (this != &other) {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    ~MyPolymorphicValue() {
+        reset();
+    }
+
+    //constructs a D in place of the current object
+    template<typename D, typename... Args>
+    D& emplace(Args&&... args) {
+        static_assert(std::is_base_of<Base, D>::value, "stored type must derive from Base");
+        reset();
+        D* object;
+        if constexpr (fits_inline<D>)
+            object = ::new (static_cast<void*>(buffer)) D(std::forward<Args>(args)...);
+        else
+            object = new D(std::forward<Args>(args)...);
+        ptr = object;
+        ops = &ops_for<D>;
+        return *object;
+    }
+
+    //operators and data access methods
+    Base& operator*() const noexcept {
+        return *ptr;
+    }
+    Base* operator->() const noexcept {
+        return ptr;
+    }
+    Base* get() const noexcept {
+        return ptr;
+    }
+    //true when the object lives in the holder rather than on the heap
+    bool isInline() const noexcept {
+        return ops && ops->stored;
+    }
+    template<typename D>
+    static constexpr bool storesInline() noexcept {
+        return fits_inline<D>;
+    }
+
+    //methods for resource management
+    void reset() noexcept {
+        if (ptr) {
+            ops->destroy(ptr);
+            ptr = nullptr;
+            ops = nullptr;
+        }
+    }
+    void swap(MyPolymorphicValue& other) noexcept {
+        MyPolymorphicValue held(std::move(other));
+        other = std::move(*this);
+        *this = std::move(held);
+    }
+
+    //bool overload
+    explicit operator bool() const noexcept {
+        return ptr != nullptr;
+    }
+};
+
+//make_unique counterpart
+template<typename Base, typename D, size_t N = 4 * sizeof(void*), typename... Args>
+MyPolymorphicValue<Base, N> make_my_polymorphic(Args&&... args)
+{
+    return MyPolymorphicValue<Base, N>(std::in_place_type<D>, std::forward<Args>(args)...);
+}
+
+#endif
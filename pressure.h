@@ -0,0 +1,382 @@
+#ifndef _PRESSURE_H_
+#define _PRESSURE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "tab_warmup.h"
+#include "text_cache.h"
+#include "Widget.h"
+
+//eviction order, lower values are shed first
+enum class EvictionPriority
+{
+    RenderCache = 0,        //cached render data, cheap to rebuild
+    Pooled = 1,             //free memory kept by pools and arenas
+    InactiveSubtree = 2     //hibernated subtrees that must be rebuilt on activation
+};
+
+//something holding memory that can be given back on request
+class MemoryConsumer
+{
+public:
+    virtual ~MemoryConsumer() = default;
+
+    virtual size_t reclaimableBytes() const = 0;
+    //frees up to bytes and returns how much was actually freed
+    virtual size_t evict(size_t bytes) = 0;
+    //books up to bytes that the consumer frees later on its own thread and returns how many were
+    //booked; consumers that can always free right away book nothing
+    virtual size_t schedule(size_t /*bytes*/) {
+        return 0;
+    }
+};
+
+//exposes the free regions of an arena as reclaimable memory
+class ArenaConsumer : public MemoryConsumer
+{
+private:
+    HugePageArena& arena;
+public:
+    explicit ArenaConsumer(HugePageArena& arena) noexcept : arena(arena) {};
+
+    size_t reclaimableBytes() const override {
+        return arena.trimmableBytes();
+    }
+    size_t evict(size_t bytes) override {
+        return arena.trim(bytes);
+    }
+};
+
+//consumer for memory that belongs to one thread, usually the UI thread. evictions on the owner thread
+//free right away; on any other thread evict() frees nothing and schedule() books up to the measured
+//reclaimable bytes, which the owner frees the next time it calls service() from its frame loop.
+//reclaimableBytes() is what the last service() measured, so the owner calls it once after setup
+class DeferredConsumer : public MemoryConsumer
+{
+private:
+    std::thread::id owner;
+    std::atomic<size_t> measured{ 0 };
+    std::atomic<size_t> booked{ 0 };
+
+protected:
+    //constructed on the owner thread
+    DeferredConsumer() noexcept : owner(std::this_thread::get_id()) {};
+
+    //owner thread only
+    virtual size_t measureBytes() const = 0;
+    virtual size_t releaseBytes(size_t bytes) = 0;
+
+public:
+    size_t reclaimableBytes() const override {
+        size_t held = measured.load(std::memory_order_acquire);
+        size_t pending = booked.load(std::memory_order_acquire);
+        return held > pending ? held - pending : 0;
+    }
+    size_t evict(size_t bytes) override {
+        if (std::this_thread::get_id() != owner)
+            return 0;
+        size_t freed = releaseBytes(bytes);
+        measured.store(measureBytes(), std::memory_order_release);
+        return freed;
+    }
+    size_t schedule(size_t bytes) override {
+        size_t pending = booked.load(std::memory_order_acquire);
+        size_t granted;
+        do {
+            size_t held = measured.load(std::memory_order_acquire);
+            granted = std::min(bytes, held > pending ? held - pending : 0);
+        } while (granted && !booked.compare_exchange_weak(pending, pending + granted, std::memory_order_acq_rel));
+        return granted;
+    }
+
+    //owner thread, once per frame: frees what other threads booked and measures again
+    size_t service() {
+        size_t pending = booked.exchange(0, std::memory_order_acq_rel);
+        size_t freed = pending ? releaseBytes(pending) : 0;
+        measured.store(measureBytes(), std::memory_order_release);
+        return freed;
+    }
+    size_t pendingBytes() const noexcept {
+        return booked.load(std::memory_order_acquire);
+    }
+};
+
+//shaped text of a UI thread TextShapingCache, register as EvictionPriority::RenderCache
+class TextCacheConsumer : public DeferredConsumer
+{
+private:
+    TextShapingCache& cache;
+
+protected:
+    size_t measureBytes() const override {
+        return cache.memoryBytes();
+    }
+    size_t releaseBytes(size_t bytes) override {
+        return cache.trim(bytes);
+    }
+
+public:
+    explicit TextCacheConsumer(TextShapingCache& cache) : cache(cache) {
+        service();
+    }
+};
+
+//contents of the inactive tabs of a UI thread TabWidget, rebuilt when the tab is activated again;
+//register as EvictionPriority::InactiveSubtree
+class TabContentConsumer : public DeferredConsumer
+{
+private:
+    TabWidget& tabWidget;
+
+protected:
+    size_t measureBytes() const override {
+        return tabWidget.inactiveBytes();
+    }
+    size_t releaseBytes(size_t bytes) override {
+        return tabWidget.unloadInactive(bytes);
+    }
+
+public:
+    explicit TabContentConsumer(TabWidget& tabWidget) : tabWidget(tabWidget) {
+        service();
+    }
+};
+
+//ready builds of a TabWarmer, safe to drop from any thread; register as
+//EvictionPriority::InactiveSubtree so they go with the other hibernated subtrees
+class WarmTabConsumer : public MemoryConsumer
+{
+private:
+    TabWarmer& warmer;
+public:
+    explicit WarmTabConsumer(TabWarmer& warmer) noexcept : warmer(warmer) {};
+
+    size_t reclaimableBytes() const override {
+        return warmer.warmBytes();
+    }
+    size_t evict(size_t bytes) override {
+        return warmer.shed(bytes);
+    }
+};
+
+struct EvictionReport
+{
+    size_t usage;           //memory in use when eviction started
+    size_t target;          //bytes eviction tried to free
+    size_t evicted;         //bytes actually freed
+    size_t scheduled;       //bytes booked for consumers to free later on their own threads
+    size_t retained;        //reclaimable bytes still held by consumers
+};
+
+struct MemoryPressureConfig
+{
+    size_t budgetBytes = 0;                     //0 disables the budget check
+    double targetRatio = 0.9;                   //evict down to this share of the budget
+    size_t pressureEvictBytes = size_t(64) << 20;   //bytes shed per PSI event within budget
+    std::chrono::microseconds stall = std::chrono::microseconds(100000);
+    std::chrono::microseconds window = std::chrono::microseconds(1000000);
+    std::chrono::milliseconds interval = std::chrono::milliseconds(500);
+};
+
+//watches cgroup v2 memory.pressure PSI triggers and a memory budget,
+//evicts from registered consumers in priority order when either fires
+class MemoryPressureMonitor
+{
+private:
+    struct Entry
+    {
+        MemoryConsumer* consumer;
+        EvictionPriority priority;
+    };
+
+    MemoryPressureConfig config;
+    std::vector<Entry> consumers;
+    std::string cgroupDir;
+    EvictionReport last;
+    size_t totalEvicted;
+    std::mutex mutex;
+
+    std::thread worker;
+    int pressureFd;
+    int wakeFd;
+    std::atomic<bool> running;
+
+    //cgroup v2 directory of this process, empty if not in a unified hierarchy
+    static std::string findCgroupDir() {
+        std::ifstream cgroup("/proc/self/cgroup");
+        std::string line;
+        while (std::getline(cgroup, line)) {
+            if (line.compare(0, 3, "0::") == 0)
+                return "/sys/fs/cgroup" + line.substr(3);
+        }
+        return std::string();
+    }
+
+    //memory charged to the cgroup, falls back to the process RSS
+    size_t currentUsage() const {
+        if (!cgroupDir.empty()) {
+            std::ifstream current(cgroupDir + "/memory.current");
+            unsigned long long bytes = 0;
+            if (current >> bytes)
+                return static_cast<size_t>(bytes);
+        }
+        return resident_set_bytes();
+    }
+
+    int openTrigger() const {
+        if (cgroupDir.empty())
+            return -1;
+        int fd = open((cgroupDir + "/memory.pressure").c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0)
+            return -1;
+        char trigger[64];
+        int length = std::snprintf(trigger, sizeof(trigger), "some %lld %lld",
+            static_cast<long long>(config.stall.count()), static_cast<long long>(config.window.count()));
+        if (write(fd, trigger, static_cast<size_t>(length) + 1) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    //caller holds mutex
+    EvictionReport evictLocked(size_t usage, size_t target) {
+        EvictionReport report{ usage, target, 0, 0, 0 };
+        //booked bytes count toward the target, they are freed within a frame
+        for (Entry& entry : consumers) {
+            if (report.evicted + report.scheduled >= target)
+                break;
+            report.evicted += entry.consumer->evict(target - report.evicted - report.scheduled);
+            if (report.evicted + report.scheduled < target)
+                report.scheduled += entry.consumer->schedule(target - report.evicted - report.scheduled);
+        }
+        for (Entry& entry : consumers)
+            report.retained += entry.consumer->reclaimableBytes();
+        totalEvicted += report.evicted;
+        last = report;
+        return report;
+    }
+
+    void check(bool pressured) {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t usage = currentUsage();
+        size_t target = 0;
+        if (config.budgetBytes && usage > config.budgetBytes)
+            target = usage - static_cast<size_t>(config.budgetBytes * config.targetRatio);
+        if (pressured)
+            target = std::max(target, config.pressureEvictBytes);
+        if (target)
+            evictLocked(usage, target);
+    }
+
+    void run() {
+        pollfd fds[2];
+        fds[0] = pollfd{ wakeFd, POLLIN, 0 };
+        fds[1] = pollfd{ pressureFd, POLLPRI, 0 };
+        nfds_t count = pressureFd >= 0 ? 2 : 1;
+        while (running.load(std::memory_order_acquire)) {
+            int ready = poll(fds, count, static_cast<int>(config.interval.count()));
+            if (ready < 0)
+                continue;
+            if (!running.load(std::memory_order_acquire))
+                break;
+            bool pressured = count == 2 && (fds[1].revents & POLLPRI);
+            if (count == 2 && (fds[1].revents & POLLERR))
+                count = 1;      //trigger went away with the cgroup, keep the budget check
+            check(pressured);
+        }
+    }
+
+public:
+    //constructor and destructor
+    explicit MemoryPressureMonitor(const MemoryPressureConfig& config = MemoryPressureConfig())
+        : config(config), cgroupDir(findCgroupDir()), last{ 0, 0, 0, 0, 0 }, totalEvicted(0),
+        pressureFd(-1), wakeFd(-1), running(false) {};
+
+    MemoryPressureMonitor(const MemoryPressureMonitor& other) = delete;
+    MemoryPressureMonitor& operator=(const MemoryPressureMonitor& other) = delete;
+
+    ~MemoryPressureMonitor() {
+        stop();
+    }
+
+    //consumers must stay alive while registered
+    void addConsumer(MemoryConsumer& consumer, EvictionPriority priority) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Entry entry{ &consumer, priority };
+        auto it = std::upper_bound(consumers.begin(), consumers.end(), entry,
+            [](const Entry& a, const Entry& b) { return a.priority < b.priority; });
+        consumers.insert(it, entry);
+    }
+    void removeConsumer(MemoryConsumer& consumer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        consumers.erase(std::remove_if(consumers.begin(), consumers.end(),
+            [&](const Entry& entry) { return entry.consumer == &consumer; }), consumers.end());
+    }
+
+    void setBudget(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        config.budgetBytes = bytes;
+    }
+
+    //background thread control, returns false if the thread could not be started
+    bool start() {
+        if (running.load())
+            return true;
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        if (wakeFd < 0)
+            return false;
+        pressureFd = openTrigger();
+        running.store(true, std::memory_order_release);
+        worker = std::thread(&MemoryPressureMonitor::run, this);
+        return true;
+    }
+    void stop() {
+        if (!running.exchange(false))
+            return;
+        uint64_t one = 1;
+        (void)!write(wakeFd, &one, sizeof(one));
+        worker.join();
+        close(wakeFd);
+        if (pressureFd >= 0)
+            close(pressureFd);
+        wakeFd = pressureFd = -1;
+    }
+
+    //true when PSI triggers are armed, otherwise only the budget is polled
+    bool hasPressureTrigger() const noexcept {
+        return pressureFd >= 0;
+    }
+
+    //sheds bytes right away, independent of pressure and budget
+    EvictionReport relieve(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return evictLocked(currentUsage(), bytes);
+    }
+
+    EvictionReport lastReport() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return last;
+    }
+    size_t evictedBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return totalEvicted;
+    }
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef _SCAVENGER_H_
+#define _SCAVENGER_H_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "arena.h"
+
+struct TrimReport
+{
+    size_t rssBefore;
+    size_t rssAfter;
+    size_t released;        //bytes advised away with MADV_DONTNEED
+};
+
+//background scavenger returning fully free arena regions to the OS,
+//each pass releases at most bytesPerPass and only touches regions idle for minIdle
+class Scavenger
+{
+private:
+    std::vector<HugePageArena*> arenas;
+    std::chrono::milliseconds interval;
+    std::chrono::milliseconds minIdle;
+    size_t bytesPerPass;
+    size_t totalReleased;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    bool running;
+
+    size_t pass(size_t budget, std::chrono::steady_clock::duration idle) {
+        size_t released = 0;
+        for (HugePageArena* arena : arenas) {
+            if (released >= budget)
+                break;
+            released += arena->trim(budget - released, idle);
+        }
+        totalReleased += released;
+        return released;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (running) {
+            wakeup.wait_for(lock, interval);
+            if (running)
+                pass(bytesPerPass, minIdle);
+        }
+    }
+
+public:
+    //constructor and destructor
+    explicit Scavenger(std::chrono::milliseconds interval = std::chrono::milliseconds(1000),
+        size_t bytesPerPass = size_t(64) << 20,
+        std::chrono::milliseconds minIdle = std::chrono::milliseconds(2000)) noexcept
+        : interval(interval), minIdle(minIdle), bytesPerPass(bytesPerPass), totalReleased(0), running(false) {};
+
+    Scavenger(const Scavenger& other) = delete;
+    Scavenger& operator=(const Scavenger& other) = delete;
+
+    ~Scavenger() {
+        stop();
+    }
+
+    //arenas must stay alive while registered
+    void addArena(HugePageArena& arena) {
+        std::lock_guard<std::mutex> lock(mutex);
+        arenas.push_back(&arena);
+    }
+    void removeArena(HugePageArena& arena) {
+        std::lock_guard<std::mutex> lock(mutex);
+        arenas.erase(std::remove(arenas.begin(), arenas.end(), &arena), arenas.end());
+    }
+
+    //background thread control
+    void start() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (running)
+            return;
+        running = true;
+        worker = std::thread(&Scavenger::run, this);
+    }
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wakeup.notify_all();
+        if (worker.joinable())
+            worker.join();
+    }
+
+    //releases every fully free region right away, ignoring rate limit and idle time
+    TrimReport trim() {
+        std::lock_guard<std::mutex> lock(mutex);
+        TrimReport report;
+        report.rssBefore = resident_set_bytes();
+        report.released = pass(SIZE_MAX, std::chrono::steady_clock::duration::zero());
+        report.rssAfter = resident_set_bytes();
+        return report;
+    }
+
+    size_t releasedBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return totalReleased;
+    }
+};
+
+#endif
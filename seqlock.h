@@ -0,0 +1,81 @@
+#ifndef _SEQLOCK_H_
+#define _SEQLOCK_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//small POD value with one writer and any number of lock-free readers.
+//the writer makes the sequence odd, stores the data and makes it even again; readers copy the
+//data between two sequence loads and retry when it changed, so they never write shared memory.
+//the payload is kept in relaxed atomic words so torn reads are benign rather than data races
+template<typename T>
+class SeqLocked
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLocked needs a trivially copyable type");
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint64_t> words[WORDS];
+
+    void copyIn(const T& value) noexcept {
+        uint64_t buffer[WORDS] = {};
+        std::memcpy(buffer, &value, sizeof(T));
+        for (size_t i = 0; i < WORDS; ++i)
+            words[i].store(buffer[i], std::memory_order_relaxed);
+    }
+
+public:
+    //constructor
+    SeqLocked() noexcept : SeqLocked(T()) {};
+    explicit SeqLocked(const T& value) noexcept : sequence(0) {
+        copyIn(value);
+    }
+
+    SeqLocked(const SeqLocked& other) = delete;
+    SeqLocked& operator=(const SeqLocked& other) = delete;
+
+    //writer side, one writing thread at a time
+    void store(const T& value) noexcept {
+        uint32_t current = sequence.load(std::memory_order_relaxed);
+        sequence.store(current + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        copyIn(value);
+        sequence.store(current + 2, std::memory_order_release);
+    }
+
+    //reader side, one attempt; false if a write was in progress or overlapped
+    bool tryLoad(T& out) const noexcept {
+        uint32_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1)
+            return false;
+        uint64_t buffer[WORDS];
+        for (size_t i = 0; i < WORDS; ++i)
+            buffer[i] = words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) != before)
+            return false;
+        std::memcpy(&out, buffer, sizeof(T));
+        return true;
+    }
+    //retries until it gets a consistent copy
+    T load() const noexcept {
+        T value;
+        while (!tryLoad(value)) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        return value;
+    }
+
+    uint32_t version() const noexcept {
+        return sequence.load(std::memory_order_acquire);
+    }
+};
+
+#endif
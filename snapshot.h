@@ -0,0 +1,520 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "arena.h"
+#include "Widget.h"
+
+//snapshot layout, all integers little endian:
+//  header      magic "WSNP", version u32, type count u32, subtree count u32
+//  type table  per type: name length u16, name bytes
+//  skeleton    node records in preorder from the root, covering every widget whose subtree is too
+//              large to decode as one unit; runs of smaller sibling subtrees are replaced by one
+//              placeholder record each, so large subtrees are split however deep they sit
+//  directory   per run: offset u64, size u64, node count u64
+//  runs        node records in preorder of one or more consecutive sibling subtrees, independent
+//              of each other and decoded concurrently
+//node record: type index u16, child count u32, state size u32, state bytes. in the skeleton the
+//child count counts records, and a placeholder is type index 0xffff, run index u32, state size 0
+
+//creates widgets by type name while loading
+class WidgetFactory
+{
+private:
+    std::unordered_map<std::string, std::function<Widget*()>> creators;
+public:
+    template<typename W>
+    void registerType(const std::string& type) {
+        creators[type] = []() -> Widget* { return new W(); };
+    }
+
+    Widget* create(const std::string& type) const {
+        auto it = creators.find(type);
+        if (it == creators.end())
+            throw std::runtime_error("snapshot: unknown widget type " + type);
+        return it->second();
+    }
+
+    //factory knowing the widgets declared in Widget.h
+    static WidgetFactory& defaults() {
+        static WidgetFactory factory = []() {
+            WidgetFactory f;
+            f.registerType<TabWidget>("TabWidget");
+            f.registerType<CalendarWidget>("CalendarWidget");
+            return f;
+        }();
+        return factory;
+    }
+};
+
+//loaded tree together with the per-thread arenas its widgets live in,
+//root is declared last so it is destroyed before the arenas
+struct WidgetDocument
+{
+    std::vector<MyUniquePtr<HugePageArena>> arenas;
+    MyUniquePtr<Widget> root;
+};
+
+namespace detail
+{
+    constexpr uint32_t snapshot_version = 2;
+    constexpr uint16_t snapshot_placeholder = 0xffff;
+    constexpr size_t snapshot_record_bytes = 10;        //a node record without state
+
+    template<typename V>
+    void put(std::vector<char>& out, V value) {
+        char bytes[sizeof(V)];
+        std::memcpy(bytes, &value, sizeof(V));
+        out.insert(out.end(), bytes, bytes + sizeof(V));
+    }
+
+    class SnapshotReader
+    {
+    private:
+        const char* cursor;
+        const char* end;
+    public:
+        SnapshotReader(const char* begin, const char* end) noexcept : cursor(begin), end(end) {};
+
+        template<typename V>
+        V get() {
+            if (static_cast<size_t>(end - cursor) < sizeof(V))
+                throw std::runtime_error("snapshot: truncated");
+            V value;
+            std::memcpy(&value, cursor, sizeof(V));
+            cursor += sizeof(V);
+            return value;
+        }
+        const char* bytes(size_t size) {
+            if (static_cast<size_t>(end - cursor) < size)
+                throw std::runtime_error("snapshot: truncated");
+            const char* data = cursor;
+            cursor += size;
+            return data;
+        }
+        const char* position() const noexcept {
+            return cursor;
+        }
+    };
+
+    //node record as decoded by a worker, linked up in the stitch pass
+    struct DecodedNode
+    {
+        Widget* widget;
+        uint32_t childCount;
+    };
+
+    inline void write_node(std::vector<char>& out, const Widget& widget, uint32_t childCount,
+        std::unordered_map<std::string, uint16_t>& types, std::vector<std::string>& typeNames, std::vector<char>& state) {
+        std::string type = widget.getType();
+        auto it = types.find(type);
+        if (it == types.end()) {
+            it = types.emplace(type, static_cast<uint16_t>(typeNames.size())).first;
+            typeNames.push_back(type);
+        }
+        state.clear();
+        widget.writeState(state);
+        put<uint16_t>(out, it->second);
+        put<uint32_t>(out, childCount);
+        put<uint32_t>(out, static_cast<uint32_t>(state.size()));
+        out.insert(out.end(), state.begin(), state.end());
+    }
+
+    //preorder without recursion, trees can be deep
+    inline uint64_t write_subtree(std::vector<char>& out, const Widget& root,
+        std::unordered_map<std::string, uint16_t>& types, std::vector<std::string>& typeNames) {
+        std::vector<char> state;
+        std::vector<const Widget*> stack{ &root };
+        uint64_t count = 0;
+        while (!stack.empty()) {
+            const Widget* widget = stack.back();
+            stack.pop_back();
+            write_node(out, *widget, static_cast<uint32_t>(widget->getChildren().size()), types, typeNames, state);
+            ++count;
+            const auto& children = widget->getChildren();
+            for (size_t i = children.size(); i-- > 0;)
+                stack.push_back(children[i].get());
+        }
+        return count;
+    }
+
+    inline DecodedNode read_node(SnapshotReader& reader, const std::vector<std::string>& typeNames, const WidgetFactory& factory) {
+        uint16_t type = reader.get<uint16_t>();
+        uint32_t childCount = reader.get<uint32_t>();
+        uint32_t stateSize = reader.get<uint32_t>();
+        const char* state = reader.bytes(stateSize);
+        if (type >= typeNames.size())
+            throw std::runtime_error("snapshot: bad type index");
+        MyUniquePtr<Widget> widget(factory.create(typeNames[type]));
+        widget->readState(state, stateSize);
+        return DecodedNode{ widget.release(), childCount };
+    }
+
+    //node counts of every subtree under root, including root
+    inline std::unordered_map<const Widget*, uint64_t> subtree_sizes(const Widget& root) {
+        std::unordered_map<const Widget*, uint64_t> sizes;
+        std::vector<std::pair<const Widget*, bool>> stack{ { &root, false } };
+        while (!stack.empty()) {
+            std::pair<const Widget*, bool> top = stack.back();
+            stack.pop_back();
+            const auto& children = top.first->getChildren();
+            if (top.second) {
+                uint64_t count = 1;
+                for (const auto& child : children)
+                    count += sizes[child.get()];
+                sizes[top.first] = count;
+                continue;
+            }
+            stack.emplace_back(top.first, true);
+            for (const auto& child : children)
+                stack.emplace_back(child.get(), false);
+        }
+        return sizes;
+    }
+
+    //skeleton record located by the scan, the widget is created after the runs are decoded
+    struct SkeletonRecord
+    {
+        uint16_t type;
+        uint32_t childCount;        //records, or the run index of a placeholder
+        const char* state;
+        uint32_t stateSize;
+        Widget* widget;
+    };
+
+    inline SkeletonRecord scan_record(SnapshotReader& reader) {
+        uint16_t type = reader.get<uint16_t>();
+        uint32_t childCount = reader.get<uint32_t>();
+        uint32_t stateSize = reader.get<uint32_t>();
+        return SkeletonRecord{ type, childCount, reader.bytes(stateSize), stateSize, nullptr };
+    }
+
+    //links a preorder run of decoded nodes and returns the roots of its subtrees
+    inline std::vector<Widget*> stitch(const std::vector<DecodedNode>& nodes) {
+        struct Open { Widget* widget; uint32_t remaining; };
+        std::vector<Open> open;
+        std::vector<Widget*> roots;
+        for (const DecodedNode& node : nodes) {
+            if (!open.empty()) {
+                open.back().widget->addChild(node.widget);
+                if (--open.back().remaining == 0)
+                    open.pop_back();
+            }
+            else {
+                roots.push_back(node.widget);
+            }
+            if (node.childCount)
+                open.push_back(Open{ node.widget, node.childCount });
+            while (!open.empty() && open.back().remaining == 0)
+                open.pop_back();
+        }
+        return roots;
+    }
+} // namespace detail
+
+namespace detail
+{
+    //a serialised tree before it is laid out as one block: type table, skeleton and runs
+    struct SnapshotParts
+    {
+        struct Run
+        {
+            std::vector<char> records;
+            uint64_t count = 0;
+        };
+        std::vector<std::string> typeNames;
+        std::vector<char> skeleton;
+        std::vector<Run> runs;
+
+        size_t size() const noexcept {
+            size_t bytes = 16 + skeleton.size() + runs.size() * 3 * sizeof(uint64_t);
+            for (const std::string& name : typeNames)
+                bytes += sizeof(uint16_t) + name.size();
+            for (const Run& run : runs)
+                bytes += run.records.size();
+            return bytes;
+        }
+        //writes the size() bytes of the snapshot to out
+        void copyTo(char* out) const noexcept {
+            char* cursor = out;
+            auto put = [&cursor](auto value) {
+                std::memcpy(cursor, &value, sizeof(value));
+                cursor += sizeof(value);
+            };
+            auto append = [&cursor](const char* data, size_t size) {
+                if (size)
+                    std::memcpy(cursor, data, size);
+                cursor += size;
+            };
+            append("WSNP", 4);
+            put(uint32_t(snapshot_version));
+            put(static_cast<uint32_t>(typeNames.size()));
+            put(static_cast<uint32_t>(runs.size()));
+            for (const std::string& name : typeNames) {
+                put(static_cast<uint16_t>(name.size()));
+                append(name.data(), name.size());
+            }
+            append(skeleton.data(), skeleton.size());
+            uint64_t offset = static_cast<uint64_t>(cursor - out) + runs.size() * 3 * sizeof(uint64_t);
+            for (const Run& run : runs) {
+                put(offset);
+                put(static_cast<uint64_t>(run.records.size()));
+                put(run.count);
+                offset += run.records.size();
+            }
+            for (const Run& run : runs)
+                append(run.records.data(), run.records.size());
+        }
+    };
+
+    //subtrees of at most splitNodes widgets are decoded as units, sibling subtrees smaller than
+    //that are grouped into runs of about splitNodes widgets; 0 picks a 64th of the tree, at least 256
+    inline SnapshotParts serialise_parts(const Widget& root, uint64_t splitNodes) {
+        SnapshotParts parts;
+        std::unordered_map<std::string, uint16_t> types;
+        std::unordered_map<const Widget*, uint64_t> sizes = subtree_sizes(root);
+        if (splitNodes == 0)
+            splitNodes = std::max<uint64_t>(256, sizes[&root] / 64);
+
+        struct Item
+        {
+            const Widget* widget;       //nullptr for a placeholder
+            uint32_t run;
+        };
+        std::vector<SnapshotParts::Run>& runs = parts.runs;
+        std::vector<char> state;
+        std::vector<Item> stack{ Item{ &root, 0 } };
+        std::vector<Item> items;
+        while (!stack.empty()) {
+            Item item = stack.back();
+            stack.pop_back();
+            if (!item.widget) {
+                put<uint16_t>(parts.skeleton, snapshot_placeholder);
+                put<uint32_t>(parts.skeleton, item.run);
+                put<uint32_t>(parts.skeleton, 0);
+                continue;
+            }
+            //large children stay in the skeleton, consecutive small ones share a run
+            items.clear();
+            bool open = false;
+            for (const auto& child : item.widget->getChildren()) {
+                uint64_t count = sizes[child.get()];
+                if (count > splitNodes) {
+                    items.push_back(Item{ child.get(), 0 });
+                    open = false;
+                    continue;
+                }
+                if (!open) {
+                    runs.emplace_back();
+                    items.push_back(Item{ nullptr, static_cast<uint32_t>(runs.size() - 1) });
+                    open = true;
+                }
+                runs.back().count += write_subtree(runs.back().records, *child, types, parts.typeNames);
+                open = runs.back().count < splitNodes;
+            }
+            write_node(parts.skeleton, *item.widget, static_cast<uint32_t>(items.size()), types, parts.typeNames, state);
+            for (size_t i = items.size(); i-- > 0;)
+                stack.push_back(items[i]);
+        }
+        return parts;
+    }
+} // namespace detail
+
+//serialises root into the snapshot layout. subtrees of at most splitNodes widgets are decoded as
+//units, sibling subtrees smaller than that are grouped into runs of about splitNodes widgets;
+//0 picks a 64th of the tree, at least 256 widgets
+inline std::vector<char> save_snapshot(const Widget& root, uint64_t splitNodes = 0) {
+    detail::SnapshotParts parts = detail::serialise_parts(root, splitNodes);
+    std::vector<char> out(parts.size());
+    parts.copyTo(out.data());
+    return out;
+}
+
+//save_snapshot into memory of the caller: reserve(size) returns where the size bytes of the
+//snapshot are written, and the size is returned
+template<typename Reserve>
+size_t save_snapshot_into(const Widget& root, Reserve&& reserve, uint64_t splitNodes = 0) {
+    detail::SnapshotParts parts = detail::serialise_parts(root, splitNodes);
+    size_t size = parts.size();
+    parts.copyTo(reserve(size));
+    return size;
+}
+
+//decodes and links the runs of a snapshot concurrently, each worker allocating into its own arena,
+//then creates the skeleton widgets and attaches the run subtrees to them on the calling thread.
+//on error every widget decoded so far is destroyed before the exception leaves
+inline WidgetDocument load_snapshot(const char* data, size_t size, unsigned threads = 0,
+    const WidgetFactory& factory = WidgetFactory::defaults()) {
+    detail::SnapshotReader reader(data, data + size);
+    if (std::memcmp(reader.bytes(4), "WSNP", 4) != 0)
+        throw std::runtime_error("snapshot: bad magic");
+    uint32_t version = reader.get<uint32_t>();
+    if (version != detail::snapshot_version)
+        throw std::runtime_error("snapshot: unsupported version");
+    uint32_t typeCount = reader.get<uint32_t>();
+    uint32_t runCount = reader.get<uint32_t>();
+    std::vector<std::string> typeNames;
+    for (uint32_t i = 0; i < typeCount; ++i) {
+        uint16_t length = reader.get<uint16_t>();
+        typeNames.emplace_back(reader.bytes(length), length);
+    }
+
+    //the skeleton is only located here, every run must be referenced by exactly one placeholder
+    std::vector<detail::SkeletonRecord> skeleton;
+    std::vector<bool> placed(runCount, false);
+    auto place = [&](uint32_t run) {
+        if (run >= runCount || placed[run])
+            throw std::runtime_error("snapshot: bad placeholder");
+        placed[run] = true;
+        skeleton.push_back(detail::SkeletonRecord{ detail::snapshot_placeholder, run, nullptr, 0, nullptr });
+    };
+    for (uint64_t pending = 1; pending > 0; --pending) {
+        detail::SkeletonRecord record = detail::scan_record(reader);
+        if (record.type == detail::snapshot_placeholder) {
+            place(record.childCount);
+            continue;
+        }
+        pending += record.childCount;
+        skeleton.push_back(record);
+    }
+    if (skeleton.front().type == detail::snapshot_placeholder)
+        throw std::runtime_error("snapshot: bad root record");
+    if (std::find(placed.begin(), placed.end(), false) != placed.end())
+        throw std::runtime_error("snapshot: run without placeholder");
+
+    struct Entry { uint64_t offset, size, count; };
+    std::vector<Entry> directory(runCount);
+    for (Entry& entry : directory) {
+        entry.offset = reader.get<uint64_t>();
+        entry.size = reader.get<uint64_t>();
+        entry.count = reader.get<uint64_t>();
+        if (entry.offset > size || entry.size > size - entry.offset || entry.count > entry.size / detail::snapshot_record_bytes)
+            throw std::runtime_error("snapshot: bad directory entry");
+    }
+
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    if (threads > runCount)
+        threads = runCount ? runCount : 1;
+
+    WidgetDocument document;
+    for (unsigned i = 0; i < threads; ++i)
+        document.arenas.emplace_back(new HugePageArena());
+
+    //a run that decoded completely is linked by its worker and kept as its subtree roots, one that
+    //failed keeps its unlinked nodes; each is freed on its own if loading fails
+    std::vector<std::vector<detail::DecodedNode>> decoded(runCount);
+    std::vector<std::vector<Widget*>> subtrees(runCount);
+    std::atomic<size_t> next(0);
+    std::vector<std::exception_ptr> errors(threads);
+    auto work = [&](unsigned worker) {
+        ArenaScope scope(*document.arenas[worker]);
+        //the subtrees are detached until the calling thread attaches them
+        MutationFeed::Suppress suppress;
+        try {
+            for (size_t i = next++; i < runCount; i = next++) {
+                const Entry& entry = directory[i];
+                detail::SnapshotReader run(data + entry.offset, data + entry.offset + entry.size);
+                decoded[i].reserve(static_cast<size_t>(entry.count));
+                for (uint64_t n = 0; n < entry.count; ++n)
+                    decoded[i].push_back(detail::read_node(run, typeNames, factory));
+                subtrees[i] = detail::stitch(decoded[i]);
+                decoded[i].clear();
+            }
+        }
+        catch (...) {
+            errors[worker] = std::current_exception();
+        }
+    };
+    {
+        //joins whatever was started, also when starting the next worker throws; the workers and
+        //the calling thread share the runs, so fewer workers only take longer
+        std::vector<std::thread> pool;
+        struct Join
+        {
+            std::vector<std::thread>& threads;
+            ~Join() {
+                for (std::thread& thread : threads)
+                    thread.join();
+            }
+        } join{ pool };
+        try {
+            for (unsigned i = 1; i < threads; ++i)
+                pool.emplace_back(work, i);
+        }
+        catch (...) {
+        }
+        work(0);
+    }
+
+    auto discard = [&] {
+        for (auto& nodes : decoded) {
+            for (detail::DecodedNode& node : nodes)
+                delete node.widget;
+        }
+        for (auto& roots : subtrees) {
+            for (Widget* widget : roots)
+                delete widget;
+        }
+        for (detail::SkeletonRecord& record : skeleton)
+            delete record.widget;
+    };
+    try {
+        for (std::exception_ptr& error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+        ArenaScope scope(*document.arenas[0]);
+        for (detail::SkeletonRecord& record : skeleton) {
+            if (record.type == detail::snapshot_placeholder)
+                continue;
+            if (record.type >= typeNames.size())
+                throw std::runtime_error("snapshot: bad type index");
+            record.widget = factory.create(typeNames[record.type]);
+            record.widget->readState(record.state, record.stateSize);
+        }
+    }
+    catch (...) {
+        discard();
+        throw;
+    }
+
+    struct Open { Widget* widget; uint32_t remaining; };
+    std::vector<Open> open;
+    document.root.reset(skeleton.front().widget);
+    for (size_t i = 0; i < skeleton.size(); ++i) {
+        const detail::SkeletonRecord& record = skeleton[i];
+        if (i > 0) {
+            if (record.widget)
+                open.back().widget->addChild(record.widget);
+            else {
+                for (Widget* subtree : subtrees[record.childCount])
+                    open.back().widget->addChild(subtree);
+            }
+            --open.back().remaining;
+        }
+        if (record.widget && record.childCount)
+            open.push_back(Open{ record.widget, record.childCount });
+        while (!open.empty() && open.back().remaining == 0)
+            open.pop_back();
+    }
+    return document;
+}
+
+inline WidgetDocument load_snapshot(const std::vector<char>& snapshot, unsigned threads = 0,
+    const WidgetFactory& factory = WidgetFactory::defaults()) {
+    return load_snapshot(snapshot.data(), snapshot.size(), threads, factory);
+}
+
+#endif
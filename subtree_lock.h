@@ -0,0 +1,355 @@
+#ifndef _SUBTREE_LOCK_H_
+#define _SUBTREE_LOCK_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "memory.h"
+
+class Widget;
+class SubtreeLockManager;
+
+enum class LockMode : uint8_t
+{
+    IntentShared,       //a descendant is read
+    IntentExclusive,    //a descendant is written
+    Shared,             //the subtree is read
+    Exclusive           //the subtree is written or restructured
+};
+
+//multi-granularity lock of one widget for one manager, plus the counters optimistic readers
+//validate against. the holders and a version share one atomic word, so taking an intention lock on
+//an ancestor is one compare and swap and releasing it one add; the mutex and condition variable
+//are only used by threads that have to wait. widgets keep their nodes in a list, one per manager
+class SubtreeLockNode
+{
+    friend class SubtreeLockManager;
+
+private:
+    //state word: intention exclusive, intention shared and shared holders in 12 bits each, the
+    //exclusive bit, and above it a version bumped whenever a write mode is released, so at most
+    //4095 threads hold one mode on a widget at a time
+    static constexpr uint64_t INTENT_EXCLUSIVE = 1;
+    static constexpr uint64_t INTENT_SHARED = uint64_t(1) << 12;
+    static constexpr uint64_t SHARED = uint64_t(1) << 24;
+    static constexpr uint64_t EXCLUSIVE = uint64_t(1) << 36;
+    static constexpr uint64_t VERSION = uint64_t(1) << 37;
+    static constexpr uint64_t COUNT_MASK = 0xfff;
+
+    std::atomic<uint64_t> state{ 0 };
+    std::atomic<uint64_t> selfVersion{ 0 };        //bumped when this widget itself was held exclusive
+    std::atomic<uint32_t> waiting{ 0 };
+    std::mutex mutex;
+    std::condition_variable released;
+
+    std::atomic<SubtreeLockManager*> manager;      //null once the manager is gone, reused by the next
+    SubtreeLockNode* next;                         //next node of the same widget, fixed once published
+
+    SubtreeLockNode(SubtreeLockManager* manager, SubtreeLockNode* next) noexcept : manager(manager), next(next) {};
+
+    static uint64_t unit(LockMode mode) noexcept {
+        switch (mode) {
+        case LockMode::IntentShared: return INTENT_SHARED;
+        case LockMode::IntentExclusive: return INTENT_EXCLUSIVE;
+        case LockMode::Shared: return SHARED;
+        case LockMode::Exclusive: return EXCLUSIVE;
+        }
+        return 0;
+    }
+
+    static bool compatible(uint64_t word, LockMode mode) noexcept {
+        if (word & EXCLUSIVE)
+            return false;
+        switch (mode) {
+        case LockMode::IntentShared:
+            return true;
+        case LockMode::IntentExclusive:
+            return ((word / SHARED) & COUNT_MASK) == 0;
+        case LockMode::Shared:
+            return (word & COUNT_MASK) == 0;
+        case LockMode::Exclusive:
+            return (word & (VERSION - 1)) == 0;
+        }
+        return false;
+    }
+
+    //no exclusive holder here and no writer below
+    static bool unwritten(uint64_t word) noexcept {
+        return (word & (EXCLUSIVE | COUNT_MASK)) == 0;
+    }
+
+    bool tryAcquire(LockMode mode) noexcept {
+        uint64_t word = state.load(std::memory_order_seq_cst);
+        while (compatible(word, mode)) {
+            if (state.compare_exchange_weak(word, word + unit(mode), std::memory_order_seq_cst, std::memory_order_seq_cst))
+                return true;
+        }
+        return false;
+    }
+
+    void acquire(LockMode mode) {
+        if (tryAcquire(mode))
+            return;
+        std::unique_lock<std::mutex> lock(mutex);
+        waiting.fetch_add(1, std::memory_order_seq_cst);
+        released.wait(lock, [&] { return tryAcquire(mode); });
+        waiting.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void release(LockMode mode) {
+        if (mode == LockMode::Exclusive)
+            selfVersion.fetch_add(1, std::memory_order_release);
+        if (mode == LockMode::Exclusive || mode == LockMode::IntentExclusive)
+            state.fetch_add(VERSION - unit(mode), std::memory_order_seq_cst);
+        else
+            state.fetch_sub(unit(mode), std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_seq_cst) != 0) {
+            //a waiter checks the state under the mutex, so it either sees this release or is asleep
+            { std::lock_guard<std::mutex> lock(mutex); }
+            released.notify_all();
+        }
+    }
+};
+
+//hierarchical intention locking along owner chains: a guard on a widget takes intention locks
+//on every ancestor from the root down, so writers on disjoint subtrees proceed in parallel while
+//an exclusive lock on a shared ancestor waits for, and then blocks, everything below it. lock state
+//hangs off the widget, so finding it takes no lock and optimistic reads neither lock nor allocate.
+//every live manager drops the lock state of a widget when the widget is destroyed
+class SubtreeLockManager
+{
+private:
+    static constexpr size_t SHARDS = 64;
+
+    //live managers, never destroyed so widgets with static storage may still report to it
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<SubtreeLockManager*> managers;
+        std::atomic<size_t> count{ 0 };
+    };
+    static Registry& registry() {
+        static Registry* managers = new Registry();
+        return *managers;
+    }
+
+    //widgets this manager has a node on, only touched when a node is created or dropped
+    struct Shard
+    {
+        std::mutex mutex;
+        std::unordered_set<const Widget*> widgets;
+    };
+    Shard shards[SHARDS];
+
+    Shard& shardOf(const Widget* widget) noexcept {
+        return shards[(reinterpret_cast<uintptr_t>(widget) >> 4) % SHARDS];
+    }
+
+    //lock nodes of a widget, one per manager that locked it; defined in Widget.h
+    static std::atomic<SubtreeLockNode*>& nodesOf(const Widget* widget) noexcept;
+    //owner chain, root first and widget last; defined in Widget.h
+    static std::vector<const Widget*> chain(const Widget* widget);
+    std::vector<SubtreeLockNode*> path(const std::vector<const Widget*>& widgets) {
+        std::vector<SubtreeLockNode*> nodes;
+        nodes.reserve(widgets.size());
+        for (const Widget* w : widgets)
+            nodes.push_back(&node(w));
+        return nodes;
+    }
+
+    SubtreeLockNode* find(const Widget* widget) const noexcept {
+        for (SubtreeLockNode* n = nodesOf(widget).load(std::memory_order_acquire); n; n = n->next) {
+            if (n->manager.load(std::memory_order_acquire) == this)
+                return n;
+        }
+        return nullptr;
+    }
+
+    //what an optimistic reader validates: the target's state word without its holder counts, and
+    //the owner chain with the summed self versions of its widgets. versions only grow, so an equal
+    //sum over the same chain means no ancestor was held exclusive in between
+    struct Observed
+    {
+        bool stable = true;
+        uint64_t target = 0;
+        uint64_t versions = 0;
+        uintptr_t widgets = 0;
+        size_t depth = 0;
+
+        bool operator==(const Observed& other) const noexcept {
+            return target == other.target && versions == other.versions && widgets == other.widgets && depth == other.depth;
+        }
+    };
+    //defined in Widget.h, walks the owner chain without locking or allocating
+    Observed observe(const Widget* widget) const noexcept;
+
+public:
+    //RAII guard releasing the whole path bottom up
+    class Guard
+    {
+        friend class SubtreeLockManager;
+
+    private:
+        std::vector<SubtreeLockNode*> nodes;
+        LockMode mode;          //mode held on the widget itself
+
+        Guard(std::vector<SubtreeLockNode*>&& nodes, LockMode mode) noexcept : nodes(std::move(nodes)), mode(mode) {};
+
+    public:
+        Guard(const Guard& other) = delete;
+        Guard& operator=(const Guard& other) = delete;
+        Guard(Guard&& other) noexcept : nodes(std::move(other.nodes)), mode(other.mode) {
+            other.nodes.clear();
+        }
+
+        ~Guard() {
+            if (nodes.empty())
+                return;
+            nodes.back()->release(mode);
+            LockMode intent = mode == LockMode::Exclusive ? LockMode::IntentExclusive : LockMode::IntentShared;
+            for (size_t i = nodes.size() - 1; i-- > 0;)
+                nodes[i]->release(intent);
+        }
+    };
+
+    SubtreeLockManager() {
+        Registry& live = registry();
+        std::lock_guard<std::mutex> lock(live.mutex);
+        live.managers.push_back(this);
+        live.count.fetch_add(1, std::memory_order_release);
+    }
+    SubtreeLockManager(const SubtreeLockManager& other) = delete;
+    SubtreeLockManager& operator=(const SubtreeLockManager& other) = delete;
+
+    //nodes stay on their widgets until the widgets are destroyed, unowned so another manager can take them
+    ~SubtreeLockManager() {
+        Registry& live = registry();
+        std::lock_guard<std::mutex> lock(live.mutex);
+        live.managers.erase(std::find(live.managers.begin(), live.managers.end(), this));
+        for (Shard& shard : shards) {
+            for (const Widget* widget : shard.widgets)
+                find(widget)->manager.store(nullptr, std::memory_order_release);
+        }
+        //after the nodes are released, a widget destroyed once it sees no manager frees them itself
+        live.count.fetch_sub(1, std::memory_order_release);
+    }
+
+    //called by ~Widget, forgets the widget in every live manager and frees its nodes
+    static void widgetDestroyed(const Widget* widget) {
+        std::atomic<SubtreeLockNode*>& nodes = nodesOf(widget);
+        if (!nodes.load(std::memory_order_acquire))
+            return;
+        Registry& live = registry();
+        if (live.count.load(std::memory_order_acquire) != 0) {
+            std::lock_guard<std::mutex> lock(live.mutex);
+            for (SubtreeLockManager* manager : live.managers)
+                manager->forget(widget);
+        }
+        for (SubtreeLockNode* n = nodes.exchange(nullptr, std::memory_order_acquire); n;) {
+            SubtreeLockNode* next = n->next;
+            delete n;
+            n = next;
+        }
+    }
+
+    //lock state of a widget, created on first use
+    SubtreeLockNode& node(const Widget* widget) {
+        if (SubtreeLockNode* n = find(widget))
+            return *n;
+        Shard& shard = shardOf(widget);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (SubtreeLockNode* n = find(widget))
+            return *n;
+        shard.widgets.insert(widget);
+        std::atomic<SubtreeLockNode*>& nodes = nodesOf(widget);
+        SubtreeLockNode* head = nodes.load(std::memory_order_acquire);
+        for (SubtreeLockNode* n = head; n; n = n->next) {
+            SubtreeLockManager* none = nullptr;
+            if (n->manager.compare_exchange_strong(none, this, std::memory_order_acq_rel))
+                return *n;
+        }
+        SubtreeLockNode* created = new SubtreeLockNode(this, head);
+        while (!nodes.compare_exchange_weak(created->next, created, std::memory_order_acq_rel)) {}
+        return *created;
+    }
+
+    //drops the lock state of a widget that is about to be destroyed; no guard may hold it.
+    //~Widget does this for every live manager
+    void forget(const Widget* widget) {
+        Shard& shard = shardOf(widget);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.widgets.erase(widget) != 0)
+            find(widget)->manager.store(nullptr, std::memory_order_release);
+    }
+
+    //widgets that currently have lock state
+    size_t trackedWidgets() {
+        size_t count = 0;
+        for (Shard& shard : shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            count += shard.widgets.size();
+        }
+        return count;
+    }
+
+    //exclusive access to widget and its subtree, including structural changes below it
+    Guard lockWrite(const Widget* widget) {
+        std::vector<const Widget*> widgets = chain(widget);
+        std::vector<SubtreeLockNode*> nodes = path(widgets);
+        for (size_t i = 0; i + 1 < nodes.size(); ++i)
+            nodes[i]->acquire(LockMode::IntentExclusive);
+        nodes.back()->acquire(LockMode::Exclusive);
+        if (chain(widget) != widgets) {
+            //reparented while we were waiting, the locks cover the old path
+            Guard(std::move(nodes), LockMode::Exclusive);
+            return lockWrite(widget);
+        }
+        return Guard(std::move(nodes), LockMode::Exclusive);
+    }
+
+    //shared access to widget and its subtree
+    Guard lockRead(const Widget* widget) {
+        std::vector<const Widget*> widgets = chain(widget);
+        std::vector<SubtreeLockNode*> nodes = path(widgets);
+        for (size_t i = 0; i + 1 < nodes.size(); ++i)
+            nodes[i]->acquire(LockMode::IntentShared);
+        nodes.back()->acquire(LockMode::Shared);
+        if (chain(widget) != widgets) {
+            Guard(std::move(nodes), LockMode::Shared);
+            return lockRead(widget);
+        }
+        return Guard(std::move(nodes), LockMode::Shared);
+    }
+
+    //runs read without taking locks and validates that no writer touched the subtree or restructured
+    //an ancestor meanwhile, retrying and finally falling back to lockRead(). read may see torn values
+    //while it runs, so it must only copy data out and must not follow child pointers. widgets that
+    //were never locked count as unwritten and get no lock state from this
+    template<typename F>
+    void readOptimistic(const Widget* widget, F&& read, unsigned attempts = 4) {
+        for (unsigned attempt = 0; attempt < attempts; ++attempt) {
+            Observed before = observe(widget);
+            if (!before.stable) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            read();
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            Observed after = observe(widget);
+            if (after.stable && after == before)
+                return;
+        }
+        Guard guard = lockRead(widget);
+        read();
+    }
+};
+
+#endif
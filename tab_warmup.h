@@ -0,0 +1,343 @@
+#ifndef _TAB_WARMUP_H_
+#define _TAB_WARMUP_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "arena.h"
+#include "fork_locks.h"
+#include "memory.h"
+#include "mutation.h"
+#include "Widget.h"
+
+//scores which tab is activated next from the observed tab to tab transitions, overall usage and
+//adjacency to the active tab, in that order of weight
+class TabPredictor
+{
+private:
+    size_t tabs = 0;
+    std::vector<uint32_t> transitions;      //tabs x tabs counts, row is the tab switched away from
+    std::vector<uint32_t> uses;
+    uint64_t totalUses = 0;
+
+    void grow(size_t count) {
+        if (count <= tabs)
+            return;
+        std::vector<uint32_t> grown(count * count, 0);
+        for (size_t from = 0; from < tabs; ++from)
+            std::copy(transitions.begin() + from * tabs, transitions.begin() + (from + 1) * tabs, grown.begin() + from * count);
+        transitions = std::move(grown);
+        uses.resize(count, 0);
+        tabs = count;
+    }
+
+public:
+    //records a switch, from is TabWidget::NO_TAB for the first activation
+    void record(size_t from, size_t to) {
+        grow(std::max(from == TabWidget::NO_TAB ? 0 : from + 1, to + 1));
+        if (from != TabWidget::NO_TAB && from != to)
+            ++transitions[from * tabs + to];
+        ++uses[to];
+        ++totalUses;
+    }
+
+    double score(size_t active, size_t tab) const noexcept {
+        if (tab == active)
+            return 0.0;
+        double value = 0.0;
+        if (active != TabWidget::NO_TAB && active < tabs && tab < tabs) {
+            uint64_t leaving = 0;
+            for (size_t to = 0; to < tabs; ++to)
+                leaving += transitions[active * tabs + to];
+            if (leaving)
+                value += 4.0 * transitions[active * tabs + tab] / leaving;
+        }
+        if (tab < tabs && totalUses)
+            value += 2.0 * uses[tab] / totalUses;
+        if (active != TabWidget::NO_TAB) {
+            size_t distance = tab > active ? tab - active : active - tab;
+            if (distance <= 2)
+                value += 1.0 / distance;
+        }
+        return value;
+    }
+
+    //up to count most likely next tabs out of tabCount, best first
+    std::vector<size_t> predict(size_t active, size_t tabCount, size_t count) const {
+        std::vector<std::pair<double, size_t>> scored;
+        for (size_t tab = 0; tab < tabCount; ++tab) {
+            double value = score(active, tab);
+            if (value > 0.0)
+                scored.emplace_back(-value, tab);
+        }
+        std::sort(scored.begin(), scored.end());
+        std::vector<size_t> result;
+        for (size_t i = 0; i < scored.size() && i < count; ++i)
+            result.push_back(scored[i].second);
+        return result;
+    }
+};
+
+struct WarmupMetrics
+{
+    uint64_t started = 0;           //builds run on the worker
+    uint64_t discarded = 0;         //stale or over the memory cap when done
+    uint64_t hits = 0;              //activations served by a warm build
+    uint64_t misses = 0;            //activations that built on the UI thread
+    uint64_t hitNs = 0;             //time spent in activate() per outcome
+    uint64_t missNs = 0;
+
+    double averageHitMs() const noexcept {
+        return hits ? hitNs / 1e6 / hits : 0.0;
+    }
+    double averageMissMs() const noexcept {
+        return misses ? missNs / 1e6 / misses : 0.0;
+    }
+};
+
+//pre-builds the contents of the tabs a TabWidget is likely to switch to next on a worker thread.
+//each warm build allocates from its own arena, which moves into the TabWidget with it, and is
+//measured with Widget::buildMeasured so the memory cap covers the containers its widgets hold as
+//well; activate() then installs a ready build with one attach instead of constructing it.
+//idle() and activate() belong to the UI thread, the builders run on the worker
+class TabWarmer
+{
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Job
+    {
+        size_t tab;
+        uint64_t generation;
+        TabWidget::ContentBuilder build;
+    };
+
+    //arena is declared first so the content goes before it
+    struct Warm
+    {
+        size_t tab;
+        uint64_t generation;
+        size_t bytes;
+        MyUniquePtr<HugePageArena> arena;
+        MyUniquePtr<Widget> content;
+    };
+
+    TabWidget& tabWidget;
+    TabPredictor predictor;
+    size_t candidates;
+    size_t memoryCap;
+
+    std::mutex mutex;
+    uint64_t forkHook;
+    std::condition_variable wake;
+    std::deque<Job> jobs;
+    std::vector<Warm> ready;
+    std::vector<size_t> building;       //tabs queued or being built
+    std::vector<size_t> tooLarge;       //tabs that did not fit the cap, retried after the prediction changes
+    std::atomic<uint64_t> generation;   //bumped whenever the prediction changes
+    size_t readyBytes = 0;
+    bool stopping = false;
+    WarmupMetrics stats;
+    std::thread worker;
+
+    std::vector<size_t> wanted;         //current prediction, written by the UI thread under mutex
+
+    bool stale(uint64_t jobGeneration) const noexcept {
+        return jobGeneration != generation.load(std::memory_order_acquire);
+    }
+
+    void run() {
+        MutationFeed::Suppress suppress;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [&] { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            Job job = std::move(jobs.front());
+            jobs.pop_front();
+            if (stale(job.generation)) {
+                building.erase(std::remove(building.begin(), building.end(), job.tab), building.end());
+                continue;
+            }
+            ++stats.started;
+            lock.unlock();
+
+            Warm warm{ job.tab, job.generation, 0, MyUniquePtr<HugePageArena>(new HugePageArena()), MyUniquePtr<Widget>() };
+            try {
+                ArenaScope scope(*warm.arena);
+                warm.content = Widget::buildMeasured(job.build, warm.bytes);
+            }
+            catch (...) {
+                //the tab is built again on activation and reports the error there
+                warm.content.reset();
+            }
+            //the widgets' containers live on the heap, the arena may hold more than they report
+            warm.bytes = std::max(warm.bytes, warm.arena->liveBytes());
+
+            lock.lock();
+            building.erase(std::remove(building.begin(), building.end(), job.tab), building.end());
+            if (!warm.content || stale(job.generation) || readyBytes + warm.bytes > memoryCap) {
+                ++stats.discarded;
+                if (warm.content && !stale(job.generation))
+                    tooLarge.push_back(job.tab);
+                lock.unlock();
+                warm.content.reset();
+                warm.arena.reset();
+                lock.lock();
+                continue;
+            }
+            readyBytes += warm.bytes;
+            ready.push_back(std::move(warm));
+        }
+    }
+
+    //takes the ready build of tab out of the pool, empty if there is none
+    Warm take(size_t tab) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < ready.size(); ++i) {
+            if (ready[i].tab != tab)
+                continue;
+            Warm warm = std::move(ready[i]);
+            ready.erase(ready.begin() + i);
+            readyBytes -= warm.bytes;
+            return warm;
+        }
+        return Warm();
+    }
+
+public:
+    //candidates is the number of tabs kept warm, memoryCap bounds the bytes of all warm builds
+    explicit TabWarmer(TabWidget& tabWidget, size_t candidates = 2, size_t memoryCap = size_t(64) << 20)
+        : tabWidget(tabWidget), candidates(candidates), memoryCap(memoryCap), generation(0) {
+        forkHook = ForkLocks::instance().add(mutex);
+        worker = std::thread(&TabWarmer::run, this);
+    }
+
+    TabWarmer(const TabWarmer& other) = delete;
+    TabWarmer& operator=(const TabWarmer& other) = delete;
+
+    //a build in progress finishes first, its result is thrown away
+    ~TabWarmer() {
+        ForkLocks::instance().remove(forkHook);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+        MutationFeed::Suppress suppress;
+        ready.clear();
+    }
+
+    //UI thread, call when there is idle time: refreshes the prediction, cancels warm-ups that are no
+    //longer wanted and queues builds for the predicted tabs that have none yet
+    void idle() {
+        std::vector<size_t> next = predictor.predict(tabWidget.activeTab(), tabWidget.tabCount(), candidates);
+        std::vector<Job> queued;
+        for (size_t tab : next) {
+            if (!tabWidget.isBuilt(tab))
+                queued.push_back(Job{ tab, 0, tabWidget.tabBuilder(tab) });
+        }
+        std::vector<Warm> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (next != wanted) {
+                wanted = next;
+                uint64_t current = generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+                jobs.clear();
+                building.clear();       //builds in progress see the new generation and discard themselves
+                tooLarge.clear();
+                for (size_t i = ready.size(); i-- > 0;) {
+                    if (std::find(wanted.begin(), wanted.end(), ready[i].tab) != wanted.end()) {
+                        ready[i].generation = current;
+                        continue;
+                    }
+                    readyBytes -= ready[i].bytes;
+                    dropped.push_back(std::move(ready[i]));
+                    ready.erase(ready.begin() + i);
+                }
+            }
+            uint64_t current = generation.load(std::memory_order_relaxed);
+            for (Job& job : queued) {
+                bool warm = std::any_of(ready.begin(), ready.end(), [&](const Warm& w) { return w.tab == job.tab; });
+                if (warm || std::find(building.begin(), building.end(), job.tab) != building.end()
+                    || std::find(tooLarge.begin(), tooLarge.end(), job.tab) != tooLarge.end())
+                    continue;
+                job.generation = current;
+                building.push_back(job.tab);
+                jobs.push_back(std::move(job));
+            }
+        }
+        wake.notify_one();
+        MutationFeed::Suppress suppress;
+        dropped.clear();
+    }
+
+    //UI thread: switches the TabWidget to tab, installing a warm build when one is ready
+    Widget* activate(size_t tab) {
+        Clock::time_point begun = Clock::now();
+        size_t previous = tabWidget.activeTab();
+        predictor.record(previous, tab);
+        if (tabWidget.isBuilt(tab))
+            return tabWidget.activate(tab);
+        Warm warm = take(tab);
+        bool hit = warm.content && tabWidget.install(tab, warm.content, warm.arena, warm.bytes);
+        Widget* content = tabWidget.activate(tab);
+        uint64_t ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begun).count());
+        std::lock_guard<std::mutex> lock(mutex);
+        if (hit) {
+            ++stats.hits;
+            stats.hitNs += ns;
+        }
+        else {
+            ++stats.misses;
+            stats.missNs += ns;
+        }
+        return content;
+    }
+
+    //any thread: drops ready builds, least likely tab first, until bytes were freed; the dropped
+    //tabs are not warmed again until the prediction changes. returns the bytes freed
+    size_t shed(size_t bytes) {
+        std::vector<Warm> dropped;
+        size_t freed = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::stable_sort(ready.begin(), ready.end(), [&](const Warm& a, const Warm& b) {
+                return std::find(wanted.begin(), wanted.end(), a.tab) > std::find(wanted.begin(), wanted.end(), b.tab);
+            });
+            while (!ready.empty() && freed < bytes) {
+                freed += ready.front().bytes;
+                readyBytes -= ready.front().bytes;
+                tooLarge.push_back(ready.front().tab);
+                dropped.push_back(std::move(ready.front()));
+                ready.erase(ready.begin());
+            }
+        }
+        MutationFeed::Suppress suppress;
+        dropped.clear();
+        return freed;
+    }
+
+    const TabPredictor& getPredictor() const noexcept {
+        return predictor;
+    }
+
+    WarmupMetrics metrics() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+    size_t warmBytes() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return readyBytes;
+    }
+};
+
+#endif
@@ -0,0 +1,185 @@
+#ifndef _TAGGED_H_
+#define _TAGGED_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "memory.h"
+#include "Widget.h"
+
+//unique_ptr packing a small tag into the low alignment bits of the pointer,
+//the deleter is default constructed on use so the whole pointer stays one word
+template<typename T, unsigned Bits = 3, typename Deleter = default_delete<T>>
+class MyTaggedUniquePtr
+{
+    static_assert(Bits > 0 && Bits <= 4, "tag must fit into alignment bits");
+    static_assert(std::is_empty<Deleter>::value, "tagged pointers need a stateless deleter");
+
+private:
+    uintptr_t bits;
+
+    static constexpr uintptr_t TAG_MASK = (uintptr_t(1) << Bits) - 1;
+
+public:
+    static constexpr unsigned MAX_TAG = TAG_MASK;
+
+    //constructor and destructor, alignment is checked when a pointer is stored
+    constexpr MyTaggedUniquePtr() noexcept : bits(0) {};
+    explicit MyTaggedUniquePtr(T* ptr, unsigned tag = 0) noexcept
+        : bits(reinterpret_cast<uintptr_t>(ptr) | (tag & TAG_MASK)) {
+        static_assert(alignof(T) > TAG_MASK, "type alignment too small for the tag bits");
+    };
+    MyTaggedUniquePtr(MyUniquePtr<T, Deleter>&& other, unsigned tag = 0) noexcept
+        : MyTaggedUniquePtr(other.release(), tag) {};
+
+    MyTaggedUniquePtr(const MyTaggedUniquePtr& other) = delete;
+    MyTaggedUniquePtr& operator=(const MyTaggedUniquePtr& other) = delete;
+
+    MyTaggedUniquePtr(MyTaggedUniquePtr&& other) noexcept : bits(other.bits) {
+        other.bits = 0;
+    }
+    MyTaggedUniquePtr& operator=(MyTaggedUniquePtr&& other) noexcept {
+        if (this != &other) {
+            reset();
+            bits = other.bits;
+            other.bits = 0;
+        }
+        return *this;
+    }
+
+    ~MyTaggedUniquePtr() {
+        reset();
+    }
+
+    //operators and data access methods
+    T& operator*() const noexcept {
+        return *get();
+    }
+    T* operator->() const noexcept {
+        return get();
+    }
+    T* get() const noexcept {
+        return reinterpret_cast<T*>(bits & ~TAG_MASK);
+    }
+    unsigned tag() const noexcept {
+        return static_cast<unsigned>(bits & TAG_MASK);
+    }
+    void setTag(unsigned tag) noexcept {
+        bits = (bits & ~TAG_MASK) | (tag & TAG_MASK);
+    }
+    uintptr_t raw() const noexcept {
+        return bits;
+    }
+
+    //methods for resource management, the tag is kept by reset
+    T* release() noexcept {
+        T* releasedPtr = get();
+        bits &= TAG_MASK;
+        return releasedPtr;
+    }
+    void reset(T* newPtr = nullptr) noexcept {
+        T* old = get();
+        if (old != newPtr) {
+            bits = reinterpret_cast<uintptr_t>(newPtr) | (bits & TAG_MASK);
+            if (old)
+                Deleter()(old);
+        }
+    }
+    void swap(MyTaggedUniquePtr& other) noexcept {
+        std::swap(bits, other.bits);
+    }
+
+    //bool overload
+    explicit operator bool() const noexcept {
+        return get() != nullptr;
+    }
+};
+
+//writes the indices of slots carrying tag to out, returns how many matched;
+//only the pointer words are read, the pointees are never touched
+template<typename T, unsigned Bits, typename Deleter>
+size_t filter_by_tag(const MyTaggedUniquePtr<T, Bits, Deleter>* slots, size_t count, unsigned tag, uint32_t* out) noexcept {
+    static_assert(sizeof(MyTaggedUniquePtr<T, Bits, Deleter>) == sizeof(uint64_t), "slots must be one word");
+    const uint64_t mask = (uint64_t(1) << Bits) - 1;
+    const uint64_t* words = reinterpret_cast<const uint64_t*>(slots);
+    size_t found = 0;
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i maskVec = _mm256_set1_epi64x(static_cast<long long>(mask));
+    const __m256i tagVec = _mm256_set1_epi64x(static_cast<long long>(tag & mask));
+    for (; i + 4 <= count; i += 4) {
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(words + i));
+        __m256i hit = _mm256_cmpeq_epi64(_mm256_and_si256(value, maskVec), tagVec);
+        unsigned bitsSet = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(hit)));
+        while (bitsSet) {
+            out[found++] = static_cast<uint32_t>(i + __builtin_ctz(bitsSet));
+            bitsSet &= bitsSet - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    //masked words have a zero high half, so comparing the low 32 bit lanes is enough
+    const __m128i maskVec = _mm_set1_epi64x(static_cast<long long>(mask));
+    const __m128i tagVec = _mm_set1_epi64x(static_cast<long long>(tag & mask));
+    for (; i + 2 <= count; i += 2) {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i));
+        __m128i hit = _mm_cmpeq_epi32(_mm_and_si128(value, maskVec), tagVec);
+        unsigned bitsSet = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(hit)));
+        if (bitsSet & 0x1)
+            out[found++] = static_cast<uint32_t>(i);
+        if (bitsSet & 0x4)
+            out[found++] = static_cast<uint32_t>(i + 1);
+    }
+#endif
+    for (; i < count; ++i) {
+        if ((words[i] & mask) == (tag & mask))
+            out[found++] = static_cast<uint32_t>(i);
+    }
+    return found;
+}
+
+
+//type tags of the widgets declared in Widget.h, 0 stands for any other widget
+enum class WidgetTag : unsigned
+{
+    Other = 0,
+    Tab = 1,
+    Calendar = 2
+};
+
+template<typename W>
+struct widget_tag { static constexpr WidgetTag value = WidgetTag::Other; };
+template<>
+struct widget_tag<TabWidget> { static constexpr WidgetTag value = WidgetTag::Tab; };
+template<>
+struct widget_tag<CalendarWidget> { static constexpr WidgetTag value = WidgetTag::Calendar; };
+
+//tag of an already built widget, looked up once when it is stored
+inline WidgetTag widget_tag_of(const Widget* widget) noexcept {
+    if (dynamic_cast<const CalendarWidget*>(widget))
+        return WidgetTag::Calendar;
+    if (dynamic_cast<const TabWidget*>(widget))
+        return WidgetTag::Tab;
+    return WidgetTag::Other;
+}
+
+using MyTaggedWidgetPtr = MyTaggedUniquePtr<Widget>;
+using TaggedChildren = std::vector<MyTaggedWidgetPtr>;
+
+template<class W, class... Args>
+MyTaggedWidgetPtr make_tagged_widget(Args&&... args)
+{
+    return MyTaggedWidgetPtr(new W(std::forward<Args>(args)...), static_cast<unsigned>(widget_tag<W>::value));
+}
+
+inline size_t filter_children(const TaggedChildren& children, WidgetTag tag, uint32_t* out) noexcept {
+    return filter_by_tag(children.data(), children.size(), static_cast<unsigned>(tag), out);
+}
+
+#endif
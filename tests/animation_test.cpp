@@ -0,0 +1,142 @@
+#include <atomic>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "animation.h"
+#include "check.h"
+
+//built once per instruction set (see CMakeLists.txt) so the SSE2 and AVX2 evaluation paths each run
+//against the scalar easing formulas, with track counts that leave scalar tails
+#if defined(__AVX2__)
+static bool supported() { return __builtin_cpu_supports("avx2"); }
+#else
+static bool supported() { return true; }
+#endif
+
+constexpr int SKIPPED = 77;
+
+struct Box : Widget
+{
+    std::string getType() const override {
+        return "Box";
+    }
+};
+
+static float eased(float t, Easing curve) {
+    switch (curve) {
+    case Easing::EaseIn:
+        return t * t;
+    case Easing::EaseOut:
+        return t * (2.0f - t);
+    case Easing::EaseInOut:
+        return t < 0.5f ? 2.0f * t * t : -1.0f + (4.0f - 2.0f * t) * t;
+    default:
+        return t;
+    }
+}
+
+static bool near(float a, float b) {
+    return std::fabs(a - b) <= 1e-4f * (1.0f + std::fabs(b));
+}
+
+int main() {
+    if (!supported())
+        return SKIPPED;
+
+    //every curve on many widgets, mid way and after the end, which writes the exact target value
+    {
+        const size_t count = 37;
+        std::vector<Box> boxes(count);
+        AnimationSystem animations;
+        for (size_t i = 0; i < count; ++i) {
+            Easing curve = static_cast<Easing>(i % 4);
+            animations.add(&boxes[i], AnimatedProperty::X, float(i), float(i) + 10.0f, 1.0f, 2.0f, curve);
+            animations.add(&boxes[i], AnimatedProperty::Height, 0.0f, -1.0f, 1.0f, 4.0f, curve);
+        }
+        CHECK(animations.size() == 2 * count);
+        CHECK(animations.update(0.5f) == 2 * count);
+        bool before = true;
+        for (size_t i = 0; i < count; ++i)
+            before = before && boxes[i].getProperties().x == float(i) && boxes[i].getProperties().height == 0.0f;
+        CHECK(before);
+
+        CHECK(animations.update(1.6f) == 2 * count);
+        bool middle = true;
+        for (size_t i = 0; i < count; ++i) {
+            Easing curve = static_cast<Easing>(i % 4);
+            WidgetProperties properties = boxes[i].getProperties();
+            middle = middle && near(properties.x, float(i) + 10.0f * eased(0.3f, curve));
+            middle = middle && near(properties.height, -eased(0.15f, curve));
+            middle = middle && properties.y == 0.0f;
+        }
+        CHECK(middle);
+
+        CHECK(animations.update(3.0f) == count);
+        bool done = true;
+        for (size_t i = 0; i < count; ++i)
+            done = done && boxes[i].getProperties().x == float(i) + 10.0f;
+        CHECK(done);
+        CHECK(animations.update(5.0f) == 0);
+        CHECK(boxes[count - 1].getProperties().height == -1.0f);
+    }
+
+    //a zero length track finishes in the frame it starts, not one frame later
+    {
+        Box box;
+        AnimationSystem animations;
+        AnimationHandle handle = animations.add(&box, AnimatedProperty::Width, 1.0f, 8.0f, 2.0f, 0.0f);
+        CHECK(animations.update(1.0f) == 1);
+        CHECK(box.getProperties().width == 1.0f);
+        CHECK(animations.update(2.0f) == 0);
+        CHECK(!animations.isActive(handle));
+        CHECK(box.getProperties().width == 8.0f);
+    }
+
+    //cancel keeps the last value, handles are not reused by later tracks, other fields are kept
+    {
+        Box box;
+        WidgetProperties properties;
+        properties.flags = 7;
+        box.setProperties(properties);
+        AnimationSystem animations;
+        AnimationHandle first = animations.add(&box, AnimatedProperty::Y, 0.0f, 100.0f, 0.0f, 10.0f);
+        animations.update(5.0f);
+        animations.cancel(first);
+        CHECK(!animations.isActive(first));
+        animations.update(9.0f);
+        CHECK(box.getProperties().y == 50.0f);
+        AnimationHandle second = animations.add(&box, AnimatedProperty::Y, 50.0f, 0.0f, 9.0f, 1.0f);
+        CHECK(second.index == first.index && !animations.isActive(first) && animations.isActive(second));
+        animations.cancel(first);
+        CHECK(animations.isActive(second));
+        animations.update(10.0f);
+        CHECK(box.getProperties().y == 0.0f && box.getProperties().flags == 7);
+    }
+
+    //all tracks of a widget land in one store per frame: a reader never sees x, y, width and
+    //height from different frames
+    {
+        Box box;
+        AnimationSystem animations;
+        for (AnimatedProperty property : { AnimatedProperty::X, AnimatedProperty::Y, AnimatedProperty::Width, AnimatedProperty::Height })
+            animations.add(&box, property, 0.0f, 1000.0f, 0.0f, 1000.0f);
+        std::atomic<bool> running{ true };
+        std::atomic<bool> torn{ false };
+        std::thread reader([&] {
+            while (running.load(std::memory_order_relaxed)) {
+                WidgetProperties seen = box.getProperties();
+                if (seen.x != seen.y || seen.x != seen.width || seen.x != seen.height)
+                    torn = true;
+            }
+        });
+        for (int frame = 1; frame <= 20000; ++frame)
+            animations.update(frame * 0.05f);
+        running = false;
+        reader.join();
+        CHECK(!torn);
+        CHECK(animations.size() == 0 && box.getProperties().height == 1000.0f);
+    }
+    return check_failures();
+}
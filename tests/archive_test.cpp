@@ -0,0 +1,234 @@
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "archive.h"
+#include "check.h"
+
+static int live = 0;
+
+struct Item
+{
+    std::string name;
+    Item() { ++live; }
+    ~Item() { --live; }
+
+    template<typename Archive>
+    void serialize(Archive& archive) {
+        archive(name);
+    }
+};
+
+struct Node
+{
+    int value = 0;
+    std::vector<MySharedPtr<Node>> children;
+    MySharedPtr<Item> item;
+    MyWeakPtr<Node> back;
+    MyUniquePtr<Item> owned;
+    Node() { ++live; }
+    ~Node() { --live; }
+
+    template<typename Archive>
+    void serialize(Archive& archive) {
+        archive(value, children, item, back, owned);
+    }
+};
+
+//weak pointers inside vector elements, to objects archived after them
+struct Entry
+{
+    int value = 0;
+    MyWeakPtr<Item> peer;
+
+    template<typename Archive>
+    void serialize(Archive& archive) {
+        archive(value, peer);
+    }
+};
+
+//default construction already holds objects, loading must release them
+struct Prefilled
+{
+    MySharedPtr<Item> item;
+    Prefilled() : item(new Item()) { item->name = "default"; }
+
+    template<typename Archive>
+    void serialize(Archive& archive) {
+        archive(item);
+    }
+};
+
+static void round_trip() {
+    std::vector<char> bytes;
+    {
+        MySharedPtr<Node> root(new Node());
+        MySharedPtr<Item> shared(new Item());
+        shared->name = "shared";
+        root->value = 1;
+        for (int i = 0; i < 3; ++i) {
+            MySharedPtr<Node> child(new Node());
+            child->value = 10 + i;
+            child->item = shared;
+            child->back = root;
+            child->owned.reset(new Item());
+            child->owned->name = "owned" + std::to_string(i);
+            root->children.push_back(child);
+        }
+        root->children.push_back(root->children[0]);    //same child twice
+        root->back = root->children[2];
+
+        BinaryOutputArchive out(bytes);
+        out(root);
+        CHECK(out.objectCount() == 5);
+        for (auto& child : root->children)
+            child->back.reset();            //break the cycle through root->back
+    }
+    CHECK(live == 0);
+
+    MySharedPtr<Node> loaded;
+    {
+        BinaryInputArchive in(bytes);
+        in(loaded);
+    }
+    CHECK(loaded && loaded->value == 1 && loaded->children.size() == 4);
+    CHECK(loaded->children[0].get() == loaded->children[3].get());
+    CHECK(loaded->children[0]->item.get() == loaded->children[2]->item.get());
+    CHECK(loaded->children[1]->item->name == "shared");
+    CHECK(loaded->children[1]->owned->name == "owned1");
+    CHECK(!loaded->children[1]->back.expired());
+    CHECK(loaded->children[1]->back.getCB() == loaded.getCB());
+    CHECK(loaded->back.getCB() == loaded->children[2].getCB());
+    CHECK(loaded->children[0].use_count() == 2);
+    CHECK(loaded.use_count() == 1);
+    loaded.reset();
+    CHECK(live == 0);
+}
+
+static void stream_and_prefilled() {
+    std::stringstream stream;
+    {
+        Prefilled source;
+        source.item->name = "saved";
+        MySharedPtr<Item> empty;
+        StreamOutputArchive out(stream);
+        out(source, empty);
+    }
+    {
+        Prefilled target;
+        MySharedPtr<Item> other(new Item());
+        StreamInputArchive in(stream);
+        in(target, other);
+        in.finish();
+        CHECK(target.item->name == "saved" && target.item.use_count() == 1);
+        CHECK(!other);
+        CHECK(live == 1);
+    }
+    CHECK(live == 0);
+}
+
+static void weak_in_vectors() {
+    std::vector<char> bytes;
+    {
+        std::vector<MySharedPtr<Item>> items;
+        std::vector<Entry> entries(100);
+        for (int i = 0; i < 100; ++i) {
+            items.emplace_back(new Item());
+            items.back()->name = std::to_string(i);
+            entries[i].value = i;
+            entries[i].peer = items[i % 10];
+        }
+        BinaryOutputArchive out(bytes);
+        out(entries, items);
+    }
+    CHECK(live == 0);
+
+    //elements are loaded in place, so the pending links still point at them in finish()
+    {
+        std::vector<Entry> entries;
+        std::vector<MySharedPtr<Item>> items;
+        BinaryInputArchive in(bytes);
+        in(entries, items);
+        in.finish();
+        CHECK(entries.size() == 100 && items.size() == 100);
+        bool linked = true;
+        for (int i = 0; i < 100; ++i)
+            linked = linked && entries[i].value == i && entries[i].peer.getCB() == items[i % 10].getCB();
+        CHECK(linked);
+        CHECK(items[3]->name == "3");
+    }
+    CHECK(live == 0);
+
+    //weak pointers to objects loaded earlier link right away
+    {
+        std::vector<char> reversed;
+        {
+            MySharedPtr<Item> item(new Item());
+            std::vector<Entry> entries(3);
+            for (Entry& entry : entries)
+                entry.peer = item;
+            BinaryOutputArchive out(reversed);
+            out(item, entries);
+        }
+        MySharedPtr<Item> item;
+        std::vector<Entry> entries;
+        BinaryInputArchive in(reversed);
+        in(item, entries);
+        CHECK(entries[2].peer.getCB() == item.getCB());
+    }
+    CHECK(live == 0);
+
+    //the destructor never writes into values that are gone before it
+    {
+        BinaryInputArchive in(bytes);
+        std::vector<Entry> entries;
+        std::vector<MySharedPtr<Item>> items;
+        in(entries, items);
+    }
+    CHECK(live == 0);
+}
+
+static bool rejects(const std::vector<char>& bytes) {
+    try {
+        MySharedPtr<Node> node;
+        BinaryInputArchive in(bytes);
+        in(node);
+    }
+    catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+static void malformed() {
+    std::vector<char> header;
+    {
+        BinaryOutputArchive out(header);
+    }
+    //a definition of object id 2^31 as the very first object
+    std::vector<char> bytes = header;
+    for (char byte : { '\x81', '\x80', '\x80', '\x80', '\x10' })
+        bytes.push_back(byte);
+    CHECK(rejects(bytes));
+    //a reference to an object never defined
+    bytes = header;
+    bytes.push_back(4);
+    CHECK(rejects(bytes));
+    //truncated
+    bytes = header;
+    bytes.push_back(3);
+    CHECK(rejects(bytes));
+    bytes = header;
+    bytes[0] ^= 1;
+    CHECK(rejects(bytes));
+    CHECK(live == 0);
+}
+
+int main() {
+    round_trip();
+    stream_and_prefilled();
+    weak_in_vectors();
+    malformed();
+    return check_failures();
+}
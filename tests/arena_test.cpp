@@ -0,0 +1,77 @@
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "memory.h"
+
+struct Node
+{
+    char payload[48];
+
+    static void* operator new(size_t size) {
+        return arena_allocate(size);
+    }
+    static void operator delete(void* ptr, size_t size) noexcept {
+        arena_deallocate(ptr, size);
+    }
+};
+
+static bool transparent_huge_pages_enabled() {
+    std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string mode;
+    std::getline(file, mode);
+    return !mode.empty() && mode.find("[never]") == std::string::npos;
+}
+
+int main() {
+    HugePageArena arena;
+
+    //allocations inside a scope land in the arena, outside it on the heap
+    std::vector<Node*> nodes;
+    {
+        ArenaScope scope(arena);
+        for (int i = 0; i < 1000; ++i)
+            nodes.push_back(new Node());
+    }
+    Node* outside = new Node();
+    CHECK(arena.owns(nodes.front()) && arena.owns(nodes.back()));
+    CHECK(!arena.owns(outside));
+    CHECK(arena.liveBytes() == 1000 * sizeof(Node));
+    CHECK(arena.reservedBytes() == HugePageArena::HUGE_PAGE_SIZE);
+    delete outside;
+
+    //control blocks follow the same routing
+    {
+        ArenaScope scope(arena);
+        MySharedPtr<int> shared(new int(5));
+        CHECK(arena.owns(shared.getCB()));
+    }
+
+    //a region is reused once empty and can then be trimmed
+    for (Node* node : nodes)
+        delete node;
+    CHECK(arena.liveBytes() == 0);
+    CHECK(arena.trimmableBytes() == HugePageArena::HUGE_PAGE_SIZE);
+    CHECK(arena.trim() == HugePageArena::HUGE_PAGE_SIZE);
+    CHECK(arena.trimmableBytes() == 0);
+    {
+        ArenaScope scope(arena);
+        Node* again = new Node();
+        CHECK(arena.reservedBytes() == HugePageArena::HUGE_PAGE_SIZE);
+        delete again;
+    }
+
+    //large allocations get their own region; touching it faults in huge pages when THP allows
+    HugePageArena big(size_t(16) << 20);
+    char* block = static_cast<char*>(big.allocate(size_t(8) << 20, HugePageArena::HUGE_PAGE_SIZE));
+    std::memset(block, 1, size_t(8) << 20);
+    size_t huge = big.hugePageBytes();
+    CHECK(huge <= big.reservedBytes());
+    if (transparent_huge_pages_enabled())
+        CHECK(huge > 0);
+    std::printf("huge page bytes %zu of %zu reserved\n", huge, big.reservedBytes());
+
+    return check_failures();
+}
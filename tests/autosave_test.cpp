@@ -0,0 +1,111 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "autosave.h"
+#include "check.h"
+
+struct Box : Widget
+{
+    std::string getType() const override {
+        return "Box";
+    }
+};
+
+static std::vector<char> readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+static bool exists(const std::string& path) {
+    return access(path.c_str(), F_OK) == 0;
+}
+
+//saves through one writer and checks that the file ends up holding the last snapshot
+static void checkWriter(const std::string& dir, bool useUring) {
+    std::string path = dir + (useUring ? "/uring.snap" : "/blocking.snap");
+    Box root;
+    for (int i = 0; i < 1000; ++i) {
+        Widget* child = new Box();
+        root.addChild(child);
+        child->addChild(new Box());
+    }
+
+    {
+        AutosaveWriter writer(path, useUring);
+        if (useUring)
+            std::printf("io_uring %s\n", writer.metrics().usingUring ? "in use" : "not available");
+        else
+            CHECK(!writer.metrics().usingUring);
+        CHECK(writer.save(root));
+        //saves while both buffers are in flight are skipped, never queued
+        for (int i = 0; i < 20; ++i) {
+            root.addChild(new Box());
+            writer.save(root);
+        }
+        while (writer.queueDepth() != 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        root.addChild(new Box());
+        CHECK(writer.save(root));
+    }
+
+    //the destructor waited for the writes, the last one is on disk and the temporary is gone
+    std::vector<char> expected = save_snapshot(root);
+    CHECK(readFile(path) == expected);
+    CHECK(!exists(path + ".tmp"));
+    unlink(path.c_str());
+}
+
+int main() {
+    char pattern[] = "/tmp/autosave_testXXXXXX";
+    char* dir = mkdtemp(pattern);
+    CHECK(dir != nullptr);
+    if (!dir)
+        return check_failures();
+
+    checkWriter(dir, true);
+    checkWriter(dir, false);
+
+    //metrics count every call as a save or a skip
+    {
+        std::string path = std::string(dir) + "/metrics.snap";
+        Box root;
+        AutosaveWriter writer(path, false);
+        int accepted = 0;
+        for (int i = 0; i < 10; ++i)
+            accepted += writer.save(root);
+        while (writer.queueDepth() != 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        AutosaveMetrics metrics = writer.metrics();
+        CHECK(metrics.saves == static_cast<uint64_t>(accepted));
+        CHECK(metrics.saves + metrics.skipped == 10);
+        CHECK(metrics.written == metrics.saves);
+        CHECK(metrics.failed == 0);
+        CHECK(metrics.write.count == metrics.saves);
+        CHECK(metrics.bytes == metrics.saves * save_snapshot(root).size());
+        unlink(path.c_str());
+    }
+
+    //a directory that cannot be opened is reported at construction
+    {
+        bool threw = false;
+        try {
+            AutosaveWriter writer(std::string(dir) + "/missing/file.snap");
+        }
+        catch (const std::runtime_error&) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+
+    rmdir(dir);
+    return check_failures();
+}
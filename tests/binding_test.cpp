@@ -0,0 +1,136 @@
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "binding.h"
+#include "check.h"
+
+int main() {
+    BindingGraph graph;
+
+    //a diamond settles in one run of the effect with consistent inputs
+    {
+        Signal<int> a(graph, 1);
+        Computed<int> doubled(graph, [&] { return a.get() * 2; });
+        Computed<int> next(graph, [&] { return a.get() + 1; });
+        Computed<int> sum(graph, [&] { return doubled.get() + next.get(); });
+        std::vector<int> seen;
+        Effect effect(graph, [&] { seen.push_back(sum.get()); });
+        CHECK(seen.size() == 1 && seen.back() == 4);
+
+        a.set(5);
+        CHECK(graph.pendingEffects() == 1);
+        CHECK(seen.size() == 1);
+        graph.commit();
+        CHECK(seen.size() == 2 && seen.back() == 16);
+        CHECK(graph.pendingEffects() == 0);
+
+        //writing the current value invalidates nothing
+        size_t before = graph.recomputeCount();
+        a.set(5);
+        CHECK(graph.pendingEffects() == 0);
+        graph.commit();
+        CHECK(graph.recomputeCount() == before);
+        CHECK(seen.size() == 2);
+    }
+
+    //a computed whose value did not change stops the propagation
+    {
+        Signal<int> a(graph, 1);
+        size_t parityRuns = 0;
+        Computed<bool> odd(graph, [&] { ++parityRuns; return a.get() % 2 == 1; });
+        size_t effectRuns = 0;
+        Effect effect(graph, [&] { odd.get(); ++effectRuns; });
+        a.set(3);
+        graph.commit();
+        CHECK(parityRuns == 2);
+        CHECK(effectRuns == 1);
+        a.set(4);
+        graph.commit();
+        CHECK(parityRuns == 3);
+        CHECK(effectRuns == 2);
+    }
+
+    //dependencies are the ones read during the last evaluation
+    {
+        Signal<bool> useFirst(graph, true);
+        Signal<int> first(graph, 1);
+        Signal<int> second(graph, 2);
+        Computed<int> chosen(graph, [&] { return useFirst.get() ? first.get() : second.get(); });
+        int value = 0;
+        Effect effect(graph, [&] { value = chosen.get(); });
+        CHECK(value == 1);
+        second.set(20);
+        CHECK(graph.pendingEffects() == 0);
+        useFirst.set(false);
+        graph.commit();
+        CHECK(value == 20);
+        first.set(10);
+        CHECK(graph.pendingEffects() == 0);
+        second.set(30);
+        graph.commit();
+        CHECK(value == 30);
+    }
+
+    //computeds are lazy and cached between changes
+    {
+        Signal<int> a(graph, 2);
+        size_t runs = 0;
+        Computed<int> square(graph, [&] { ++runs; return a.get() * a.get(); });
+        CHECK(runs == 0);
+        CHECK(square.get() == 4);
+        CHECK(square.get() == 4);
+        CHECK(runs == 1);
+        a.set(3);
+        CHECK(runs == 1);
+        CHECK(square.get() == 9);
+        CHECK(runs == 2);
+    }
+
+    //an effect destroyed with a pending run leaves the batch, nodes can go in any order
+    {
+        Signal<int> a(graph, 0);
+        std::unique_ptr<Computed<int>> plus(new Computed<int>(graph, [&] { return a.get() + 1; }));
+        int runs = 0;
+        std::unique_ptr<Effect> effect(new Effect(graph, [&] { plus->get(); ++runs; }));
+        a.set(1);
+        CHECK(graph.pendingEffects() == 1);
+        effect.reset();
+        CHECK(graph.pendingEffects() == 0);
+        graph.commit();
+        CHECK(runs == 1);
+        plus.reset();
+        a.set(2);
+        CHECK(graph.pendingEffects() == 0);
+    }
+
+    //a compute that throws leaves no node collecting reads made outside any compute
+    {
+        Signal<int> a(graph, 1);
+        Signal<int> other(graph, 0);
+        bool fail = true;
+        size_t runs = 0;
+        Computed<int> twice(graph, [&] {
+            ++runs;
+            if (fail)
+                throw std::runtime_error("compute failed");
+            return a.get() * 2;
+        });
+        bool thrown = false;
+        try {
+            twice.get();
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+        fail = false;
+        CHECK(twice.get() == 2);
+        CHECK(runs == 2);
+        other.get();
+        other.set(1);
+        CHECK(twice.get() == 2);
+        CHECK(runs == 2);
+    }
+    return check_failures();
+}
@@ -0,0 +1,159 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "channel.h"
+#include "check.h"
+
+struct Item
+{
+    static std::atomic<int> live;
+    size_t producer;
+    size_t value;
+
+    Item(size_t producer, size_t value) : producer(producer), value(value) {
+        live.fetch_add(1, std::memory_order_relaxed);
+    }
+    ~Item() {
+        live.fetch_sub(1, std::memory_order_relaxed);
+    }
+};
+std::atomic<int> Item::live{ 0 };
+
+using ItemPtr = MyUniquePtr<Item>;
+
+template<typename Channel>
+static void checkBounded() {
+    Channel channel(5);
+    CHECK(channel.capacity() == 8);
+    for (size_t i = 0; i < 8; ++i)
+        CHECK(channel.tryPush(ItemPtr(new Item(0, i))));
+
+    //a full channel leaves the item with the caller
+    ItemPtr extra(new Item(0, 8));
+    CHECK(!channel.tryPush(std::move(extra)));
+    CHECK(extra && extra->value == 8);
+
+    ItemPtr out[3];
+    CHECK(channel.tryPopBatch(out, 3) == 3);
+    for (size_t i = 0; i < 3; ++i)
+        CHECK(out[i]->value == i);
+    CHECK(channel.tryPush(std::move(extra)));
+    CHECK(!extra);
+    CHECK(channel.tryPop()->value == 3);
+
+    //whatever is still queued goes with the channel
+    CHECK(Item::live.load() == 3 + 5);
+}
+
+//a producer blocked on a full channel returns when the channel is closed, keeping what did not fit
+template<typename Channel>
+static void checkCloseWhileFull() {
+    Channel channel(4);
+    ItemPtr items[6];
+    for (size_t i = 0; i < 6; ++i)
+        items[i].reset(new Item(0, i));
+    size_t pushed = 0;
+    std::thread producer([&] { pushed = channel.pushBatch(items, 6); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    channel.close();
+    producer.join();
+    CHECK(pushed == 4);
+    CHECK(!items[3] && items[4] && items[5]->value == 5);
+
+    ItemPtr last(new Item(0, 6));
+    CHECK(!channel.push(std::move(last)));
+    CHECK(last && last->value == 6);
+    ItemPtr out[8];
+    CHECK(channel.popBatch(out, 8) == 4 && out[3]->value == 3);
+}
+
+int main() {
+    checkBounded<SpscChannel<Item>>();
+    CHECK(Item::live.load() == 0);
+    checkBounded<MpmcChannel<Item>>();
+    CHECK(Item::live.load() == 0);
+    checkCloseWhileFull<SpscChannel<Item>>();
+    checkCloseWhileFull<MpmcChannel<Item>>();
+    CHECK(Item::live.load() == 0);
+
+    //one producer and one consumer see every item once and in order, in batches of any size
+    {
+        const size_t count = 100000;
+        SpscChannel<Item> channel(64);
+        std::thread producer([&] {
+            ItemPtr batch[7];
+            for (size_t i = 0; i < count;) {
+                size_t n = 0;
+                while (n < 7 && i < count)
+                    batch[n++].reset(new Item(0, i++));
+                channel.pushBatch(batch, n);
+            }
+            channel.close();
+        });
+        size_t expected = 0;
+        bool ordered = true;
+        ItemPtr batch[16];
+        while (size_t n = channel.popBatch(batch, 16)) {
+            for (size_t i = 0; i < n; ++i)
+                ordered = ordered && batch[i]->value == expected++;
+        }
+        producer.join();
+        CHECK(ordered);
+        CHECK(expected == count);
+        CHECK(channel.isClosed());
+        CHECK(!channel.tryPop());
+    }
+    CHECK(Item::live.load() == 0);
+
+    //several producers and consumers: nothing lost or duplicated, each producer's items stay in
+    //order for every consumer
+    {
+        const size_t producers = 4;
+        const size_t consumers = 4;
+        const size_t perProducer = 20000;
+        MpmcChannel<Item> channel(128);
+        std::vector<std::atomic<uint32_t>> seen(producers * perProducer);
+        std::atomic<bool> ordered{ true };
+
+        std::vector<std::thread> threads;
+        for (size_t c = 0; c < consumers; ++c) {
+            threads.emplace_back([&] {
+                std::vector<size_t> last(producers, 0);
+                std::vector<bool> any(producers, false);
+                ItemPtr batch[8];
+                while (size_t n = channel.popBatch(batch, 8)) {
+                    for (size_t i = 0; i < n; ++i) {
+                        Item& item = *batch[i];
+                        if (any[item.producer] && item.value <= last[item.producer])
+                            ordered.store(false);
+                        any[item.producer] = true;
+                        last[item.producer] = item.value;
+                        seen[item.producer * perProducer + item.value].fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            });
+        }
+        std::vector<std::thread> producing;
+        for (size_t p = 0; p < producers; ++p) {
+            producing.emplace_back([&, p] {
+                for (size_t i = 0; i < perProducer; ++i)
+                    channel.push(ItemPtr(new Item(p, i)));
+            });
+        }
+        for (std::thread& thread : producing)
+            thread.join();
+        channel.close();
+        for (std::thread& thread : threads)
+            thread.join();
+
+        bool once = true;
+        for (auto& count : seen)
+            once = once && count.load() == 1;
+        CHECK(once);
+        CHECK(ordered.load());
+    }
+    CHECK(Item::live.load() == 0);
+    return check_failures();
+}
@@ -0,0 +1,22 @@
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+#include <cstdio>
+
+//minimal checking for the component tests: failures are reported and counted, and main returns
+//check_failures() so ctest sees the result
+
+inline int& check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                \
+    do {                                                                                \
+        if (!(condition)) {                                                             \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++check_failures();                                                         \
+        }                                                                               \
+    } while (0)
+
+#endif
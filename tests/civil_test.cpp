@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "civil.h"
+#include "check.h"
+
+//built once per instruction set (see CMakeLists.txt) so the scalar, SSE4.1 and AVX2 batch paths
+//are each compared with the scalar algorithm and the calendar rules, over sampled windows of the
+//int32 day range by default and over all of it when built with CIVIL_EXHAUSTIVE
+
+#if defined(__AVX2__)
+static const char* const PATH = "avx2";
+static bool supported() { return __builtin_cpu_supports("avx2"); }
+#elif defined(__SSE4_1__)
+static const char* const PATH = "sse4.1";
+static bool supported() { return __builtin_cpu_supports("sse4.1"); }
+#else
+static const char* const PATH = "scalar";
+static bool supported() { return true; }
+#endif
+
+constexpr int SKIPPED = 77;
+constexpr size_t CHUNK = 4096;                  //also the spacing of the scalar checkpoints
+
+static bool leap(int64_t year) {
+    return year % 4 == 0 && (year % 100 != 0 || year % 400 == 0);
+}
+static int32_t monthLength(int64_t year, int32_t month) {
+    static const int32_t lengths[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    return month == 2 && leap(year) ? 29 : lengths[month - 1];
+}
+
+//dates one day apart, advanced by the calendar rules instead of the conversion formulas
+struct Walker
+{
+    int32_t year, month, day, weekday;
+
+    void next() {
+        weekday = weekday == 6 ? 0 : weekday + 1;
+        if (day < monthLength(year, month)) {
+            ++day;
+            return;
+        }
+        day = 1;
+        if (month < 12) {
+            ++month;
+            return;
+        }
+        month = 1;
+        ++year;
+    }
+};
+
+static bool sameAsScalar(int32_t days, int32_t year, int32_t month, int32_t day, int32_t weekday) {
+    int32_t y, m, d, w;
+    civil_from_days(days, y, m, d, w);
+    return y == year && m == month && d == day && w == weekday && days_from_civil(y, m, d) == days;
+}
+
+//days [first, first + count) in chunks: a walker started from the scalar result at first checks the
+//batches for every day, and the scalar algorithm at the start of every chunk. returns mismatches
+static uint64_t checkRange(int64_t first, int64_t count) {
+    std::vector<int32_t> days(CHUNK), year(CHUNK), month(CHUNK), day(CHUNK), weekday(CHUNK), back(CHUNK);
+    Walker walker;
+    civil_from_days(static_cast<int32_t>(first), walker.year, walker.month, walker.day, walker.weekday);
+    uint64_t mismatches = 0;
+    for (int64_t end = first + count; first < end; first += CHUNK) {
+        size_t n = static_cast<size_t>(std::min<int64_t>(CHUNK, end - first));
+        mismatches += !sameAsScalar(static_cast<int32_t>(first), walker.year, walker.month, walker.day, walker.weekday);
+        for (size_t i = 0; i < n; ++i)
+            days[i] = static_cast<int32_t>(first + static_cast<int64_t>(i));
+        civil_from_days(days.data(), year.data(), month.data(), day.data(), weekday.data(), n);
+        days_from_civil(year.data(), month.data(), day.data(), back.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            mismatches += year[i] != walker.year || month[i] != walker.month || day[i] != walker.day
+                || weekday[i] != walker.weekday || back[i] != days[i];
+            walker.next();
+        }
+    }
+    return mismatches;
+}
+
+int main() {
+    if (!supported()) {
+        std::printf("civil_test: %s not supported by this cpu\n", PATH);
+        return SKIPPED;
+    }
+
+    //edge values, including odd counts so the vector tails run
+    {
+        std::vector<int32_t> days = { INT32_MIN, INT32_MIN + 1, -719469, -719468, -719162, -146097, -146096,
+            -1, 0, 1, 59, 60, 11016, 11017, 146096, 146097, 2932896, INT32_MAX - 1, INT32_MAX };
+        for (size_t count = 1; count <= days.size(); ++count) {
+            std::vector<int32_t> year(count), month(count), day(count), weekday(count), back(count);
+            civil_from_days(days.data(), year.data(), month.data(), day.data(), weekday.data(), count);
+            days_from_civil(year.data(), month.data(), day.data(), back.data(), count);
+            for (size_t i = 0; i < count; ++i) {
+                CHECK(sameAsScalar(days[i], year[i], month[i], day[i], weekday[i]));
+                CHECK(back[i] == days[i]);
+            }
+        }
+        int32_t y, m, d, w;
+        civil_from_days(0, y, m, d, w);
+        CHECK(y == 1970 && m == 1 && d == 1 && w == 4);
+        civil_from_days(11016, y, m, d, w);
+        CHECK(y == 2000 && m == 2 && d == 29 && w == 2);
+        CHECK(days_from_civil(1600, 3, 1) == -135080);
+    }
+
+#if defined(CIVIL_EXHAUSTIVE)
+    //every int32 day count, opt in with MY_EXHAUSTIVE_TESTS
+    CHECK(checkRange(INT32_MIN, int64_t(1) << 32) == 0);
+#else
+    //windows around the ends of the range and the era and epoch boundaries, then blocks spread over
+    //the whole range at a stride that is not a multiple of any cycle or vector width
+    {
+        const int64_t window = int64_t(1) << 16;
+        uint64_t mismatches = 0;
+        for (int64_t anchor : { int64_t(INT32_MIN), int64_t(-719468), int64_t(-146097), int64_t(0), int64_t(2932896) })
+            mismatches += checkRange(std::max<int64_t>(INT32_MIN, anchor - window / 2), window);
+        mismatches += checkRange(int64_t(INT32_MAX) - window + 1, window);
+        const int64_t stride = 4194301;
+        for (int64_t first = INT32_MIN + 12345; first + 1000 <= INT32_MAX; first += stride)
+            mismatches += checkRange(first, 1000 + (first & 7));
+        CHECK(mismatches == 0);
+    }
+#endif
+
+    //month grids start on the requested weekday and cover the whole month
+    {
+        MonthGrid grids[24];
+        month_grids(2023, 11, 24, grids, 1);
+        for (const MonthGrid& grid : grids) {
+            CHECK(grid.cellWeekday[0] == 1);
+            size_t inside = 0;
+            for (size_t cell = 0; cell < MonthGrid::CELLS; ++cell)
+                inside += grid.inMonth(cell);
+            CHECK(inside == static_cast<size_t>(monthLength(grid.year, grid.month)));
+        }
+    }
+
+    return check_failures();
+}
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cstring>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Widget.h"
+#include "check.h"
+
+//built with MY_COMPRESSED_CHILDREN (see CMakeLists.txt): the heap's thread caches and free lists,
+//and the size of widgets holding their children and parent through 4 byte offsets
+
+struct Box : Widget
+{
+    std::string getType() const override {
+        return "Box";
+    }
+};
+
+int main() {
+    CompressedHeap& heap = CompressedHeap::instance();
+    CHECK(heap.getBase() != nullptr);
+    if (!heap.getBase())
+        return check_failures();
+
+    //child and parent links are 4 bytes and the widget has no padding beyond its members
+    {
+        CHECK(sizeof(WidgetChildPtr) == 4);
+        CHECK(sizeof(WidgetParentRef) == 4);
+        CHECK(64 / sizeof(WidgetChildPtr) == 16);
+        size_t members = sizeof(void*) + sizeof(MyObservable) + sizeof(WidgetParentRef) + sizeof(std::vector<WidgetChildPtr>)
+            + sizeof(std::atomic<Widget*>) + sizeof(SeqLocked<WidgetProperties>) + sizeof(std::atomic<SubtreeLockNode*>);
+        auto padded = [](size_t bytes) { return (bytes + alignof(Widget) - 1) / alignof(Widget) * alignof(Widget); };
+        CHECK(sizeof(Widget) == padded(members));
+        //a MyWeakPtr parent would cost 8 more bytes even after padding
+        CHECK(sizeof(Widget) + 8 <= padded(members - sizeof(WidgetParentRef) + sizeof(MyWeakPtr<Widget>)));
+    }
+
+    //a freed block is the next one handed out for its size class on the same thread
+    {
+        void* first = heap.allocate(40);
+        heap.deallocate(first);
+        CHECK(heap.allocate(40) == first);
+        void* other = heap.allocate(200);
+        CHECK(other != first);
+        heap.deallocate(other);
+        heap.deallocate(first);
+        CHECK(heap.allocate(33) == first);
+        heap.deallocate(first);
+    }
+
+    //a block freed by another thread than the one that allocated it goes to the freeing thread
+    {
+        void* block = nullptr;
+        std::thread([&] { block = heap.allocate(72); }).join();
+        heap.deallocate(block);
+        CHECK(heap.allocate(72) == block);
+        heap.deallocate(block);
+    }
+
+    //blocks a thread frees reach the shared free lists in batches and when it exits
+    {
+        const size_t count = 3 * CompressedHeap::BATCH;
+        std::set<void*> freed;
+        std::thread([&] {
+            std::vector<void*> blocks;
+            for (size_t i = 0; i < count; ++i)
+                blocks.push_back(heap.allocate(1000));
+            freed.insert(blocks.begin(), blocks.end());
+            for (void* block : blocks)
+                heap.deallocate(block);
+        }).join();
+        CHECK(freed.size() == count);
+        std::vector<void*> again;
+        for (size_t i = 0; i < count; ++i)
+            again.push_back(heap.allocate(1000));
+        CHECK(std::all_of(again.begin(), again.end(), [&](void* block) { return freed.count(block) == 1; }));
+        for (void* block : again)
+            heap.deallocate(block);
+    }
+
+    //large objects take whole spans, which are reused by the next object of as many spans
+    {
+        void* large = heap.allocate(3 * CompressedHeap::SPAN - 100);
+        CHECK(heap.toOffset(large) % (CompressedHeap::SPAN >> CompressedHeap::SHIFT) == 0);
+        heap.deallocate(large);
+        CHECK(heap.allocate(3 * CompressedHeap::SPAN) == large);
+        heap.deallocate(large);
+    }
+
+    //widgets come from the heap through their class operators and reuse freed blocks
+    {
+        Widget* first = new Box();
+        CHECK(heap.contains(first));
+        delete first;
+        MyCompressedPtr<Box> second = make_my_compressed<Box>();
+        CHECK(static_cast<void*>(second.get()) == static_cast<void*>(first));
+
+        MySharedPtr<Widget> shared(new Box());
+        TabWidget* child = new TabWidget(shared);
+        CHECK(child->getParent().get() == shared.get());
+        CHECK(child->getOwner() == shared.get());
+        CHECK(shared->getChildren().back().get() == child);
+    }
+
+    //threads allocating and freeing at the same time never get overlapping blocks
+    {
+        std::vector<std::thread> threads;
+        std::vector<int> corrupted(4, 0);
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&, t] {
+                std::vector<std::pair<unsigned char*, size_t>> live;
+                uint32_t state = 2463534242u + t;
+                for (int i = 0; i < 100000; ++i) {
+                    state ^= state << 13;
+                    state ^= state >> 17;
+                    state ^= state << 5;
+                    if (live.size() < 64 && (state & 1)) {
+                        size_t size = 1 + state % 300;
+                        unsigned char* block = static_cast<unsigned char*>(heap.allocate(size));
+                        std::memset(block, t + 1, size);
+                        live.emplace_back(block, size);
+                    }
+                    else if (!live.empty()) {
+                        size_t index = state % live.size();
+                        auto [block, size] = live[index];
+                        corrupted[t] += std::count(block, block + size, t + 1) != static_cast<long>(size);
+                        heap.deallocate(block);
+                        live[index] = live.back();
+                        live.pop_back();
+                    }
+                }
+                for (auto [block, size] : live)
+                    heap.deallocate(block);
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        CHECK(std::count(corrupted.begin(), corrupted.end(), 0) == 4);
+    }
+    return check_failures();
+}
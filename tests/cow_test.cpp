@@ -0,0 +1,65 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "cow.h"
+
+static std::atomic<int> copies{ 0 };
+static std::atomic<int> live{ 0 };
+
+struct StyleTable
+{
+    std::vector<int> values;
+    StyleTable() : values(256, 1) { ++live; }
+    StyleTable(const StyleTable& other) : values(other.values) { ++copies; ++live; }
+    ~StyleTable() { --live; }
+};
+
+int main() {
+    {
+        MyCowPtr<StyleTable> a = make_my_cow<StyleTable>();
+        a.write().values[0] = 5;
+        CHECK(copies == 0);
+
+        //readers share, the first write of a shared table clones it once
+        MyCowPtr<StyleTable> b = a;
+        CHECK(a.use_count() == 2 && a.get() == b.get());
+        b.write().values[0] = 6;
+        CHECK(copies == 1 && a->values[0] == 5 && b->values[0] == 6);
+        CHECK(a.unique() && b.unique());
+        b.write();
+        CHECK(copies == 1);
+
+        b = a;
+        CHECK(live == 1 && a.use_count() == 2);
+        b.reset();
+        CHECK(a.unique() && !b && b.use_count() == 0);
+    }
+    CHECK(live == 0);
+
+    //owners on several threads: each writes its own copy, the last one writes in place
+    copies = 0;
+    {
+        MyCowPtr<StyleTable, AtomicRefCount> shared = make_my_cow<StyleTable, AtomicRefCount>();
+        std::vector<std::thread> threads;
+        for (int i = 0; i < 8; ++i) {
+            MyCowPtr<StyleTable, AtomicRefCount> mine = shared;
+            threads.emplace_back([mine = std::move(mine), i]() mutable {
+                for (int k = 0; k < 1000; ++k) {
+                    MyCowPtr<StyleTable, AtomicRefCount> reader = mine;
+                    CHECK(reader->values[0] == 1);
+                }
+                mine.write().values[1] = i;
+                CHECK(mine.unique() && mine->values[1] == i);
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        CHECK(shared.unique() && shared->values[1] == 1);
+        CHECK(copies <= 8);
+    }
+    CHECK(live == 0);
+
+    return check_failures();
+}
@@ -0,0 +1,147 @@
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fork_snapshot.h"
+#include "check.h"
+
+//carries a value through the snapshot
+struct Node : Widget
+{
+    int32_t value = 0;
+    Node() = default;
+    explicit Node(int32_t value) : value(value) {}
+    std::string getType() const override {
+        return "Node";
+    }
+    void writeState(std::vector<char>& out) const override {
+        detail::put<int32_t>(out, value);
+    }
+    void readState(const char* data, size_t size) override {
+        if (size != sizeof(value))
+            throw std::runtime_error("node: bad state");
+        std::memcpy(&value, data, sizeof(value));
+    }
+};
+
+static std::vector<char> readFile(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+//exit status of a child that checks a lock is free, 2 if it could not be reaped
+static int reapChild(pid_t pid) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR)
+            return 2;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 2;
+}
+
+int main() {
+    WidgetFactory factory;
+    factory.registerType<Node>("Node");
+
+    char pattern[] = "/tmp/fork_snapshot_testXXXXXX";
+    char* dir = mkdtemp(pattern);
+    CHECK(dir != nullptr);
+    if (!dir)
+        return check_failures();
+    std::string path = std::string(dir) + "/tree.snap";
+
+    //the child writes the tree as it was at start() while the parent keeps changing its copy
+    {
+        Node root(0);
+        for (int32_t i = 1; i <= 20; ++i) {
+            Widget* child = new Node(i);
+            root.addChild(child);
+            child->addChild(new Node(100 + i));
+        }
+        std::vector<char> expected = save_snapshot(root);
+
+        ForkSnapshotter snapshotter(path);
+        CHECK(snapshotter.start(root));
+        CHECK(snapshotter.running() && !snapshotter.start(root));
+        for (int32_t i = 0; i < 10; ++i)
+            root.addChild(new Node(-i));
+        static_cast<Node*>(root.getChildren()[0].get())->value = 999;
+        ForkSnapshotResult result = snapshotter.wait();
+        CHECK(result.ok && result.error == 0);
+        CHECK(result.bytes == expected.size());
+        CHECK(result.pauseNs <= result.totalNs);
+        CHECK(!snapshotter.running());
+
+        std::vector<char> written = readFile(path);
+        CHECK(written == expected);
+        WidgetDocument document = load_snapshot(written, 2, factory);
+        CHECK(document.root && save_snapshot(*document.root) == expected);
+        CHECK(document.root->getChildren().size() == 20);
+        CHECK(access((path + ".tmp").c_str(), F_OK) != 0);
+    }
+
+    //a failing child is reported through the result
+    {
+        ForkSnapshotter snapshotter(std::string(dir) + "/missing/tree.snap");
+        Node root(0);
+        CHECK(snapshotter.start(root));
+        ForkSnapshotResult result = snapshotter.wait();
+        CHECK(!result.ok && result.error == ENOENT);
+    }
+
+    //registered locks are taken around fork() and released again in the parent and in the child,
+    //even when another thread held one of them when fork() was called
+    {
+        std::mutex registered;
+        int locked = 0, unlocked = 0;
+        uint64_t counter = ForkLocks::instance().add([&] { ++locked; }, [&] { ++unlocked; });
+        uint64_t hook = ForkLocks::instance().add(registered);
+
+        std::atomic<bool> holding{ false };
+        std::thread holder([&] {
+            std::lock_guard<std::mutex> hold(registered);
+            holding = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        });
+        while (!holding)
+            std::this_thread::yield();
+        pid_t pid = ForkLocks::instance().fork();
+        if (pid == 0) {
+            bool free = registered.try_lock();
+            _exit(free && locked == 1 && unlocked == 1 ? 0 : 1);
+        }
+        CHECK(pid > 0);
+        bool free = registered.try_lock();
+        CHECK(free);
+        if (free)
+            registered.unlock();
+        CHECK(locked == 1 && unlocked == 1);
+        CHECK(pid > 0 && reapChild(pid) == 0);
+        holder.join();
+
+        //removed hooks are no longer run
+        ForkLocks::instance().remove(counter);
+        ForkLocks::instance().remove(hook);
+        pid = ForkLocks::instance().fork();
+        if (pid == 0)
+            _exit(0);
+        CHECK(pid > 0 && reapChild(pid) == 0);
+        CHECK(locked == 1 && unlocked == 1);
+    }
+
+    unlink(path.c_str());
+    rmdir(dir);
+    return check_failures();
+}
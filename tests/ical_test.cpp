@@ -0,0 +1,158 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "ical.h"
+#include "check.h"
+
+#if defined(__AVX2__)
+static bool supported() { return __builtin_cpu_supports("avx2"); }
+#else
+static bool supported() { return true; }
+#endif
+
+constexpr int SKIPPED = 77;
+
+//one batch of events copied out of the parser, text included
+struct Collected
+{
+    std::vector<CalendarEvent> events;
+    std::vector<std::string> summaries;
+    std::vector<std::string> uids;
+    size_t batches = 0;
+
+    void add(CalendarEventBatch& batch) {
+        ++batches;
+        for (const CalendarEvent& event : batch.events) {
+            events.push_back(event);
+            summaries.emplace_back(batch.text.data() + event.summary, event.summaryLength);
+            uids.emplace_back(batch.text.data() + event.uid, event.uidLength);
+        }
+    }
+};
+
+static const char* const CALENDAR =
+    "BEGIN:VCALENDAR\r\n"
+    "VERSION:2.0\r\n"
+    "BEGIN:VEVENT\r\n"
+    "UID:first@example.com\r\n"
+    "DTSTART:20240102T030405Z\r\n"
+    "DTEND:20240102T040405Z\r\n"
+    "SUMMARY:Review\\, planning\\nand a summary line long enough to cross a vector width\r\n"
+    "BEGIN:VALARM\r\n"
+    "DTSTART:19990101T000000Z\r\n"
+    "END:VALARM\r\n"
+    "END:VEVENT\r\n"
+    "BEGIN:VEVENT\r\n"
+    "UID:second@example.com\r\n"
+    "DTSTART;VALUE=DATE:20240301\r\n"
+    "SUMMARY:Fol\r\n"
+    " ded\r\n"
+    "\tline\r\n"
+    "END:VEVENT\r\n"
+    "BEGIN:VEVENT\n"
+    "UID:no-start\n"
+    "SUMMARY:skipped\n"
+    "END:VEVENT\n"
+    "BEGIN:VEVENT\n"
+    "UID:third\n"
+    "DTSTART;TZID=\"America/New_York\":20240115T090000\n"
+    "DURATION:PT1H30M\n"
+    "END:VEVENT\n"
+    "END:VCALENDAR\n";
+
+int main() {
+    if (!supported())
+        return SKIPPED;
+
+    const int64_t jan2 = int64_t(days_from_civil(2024, 1, 2)) * 86400;
+    const int64_t mar1 = int64_t(days_from_civil(2024, 3, 1)) * 86400;
+    const int64_t jan15 = int64_t(days_from_civil(2024, 1, 15)) * 86400;
+    TimeZoneDb zones;
+    const TimeZone* newYork = zones.get("America/New_York");
+
+    //events, escapes, folding, durations and nested components, handed over in batches
+    {
+        Collected collected;
+        IcalImportOptions options;
+        options.batchSize = 2;
+        options.zones = &zones;
+        std::string data(CALENDAR);
+        IcalImportReport report = parse_ical(data.data(), data.size(),
+            [&](CalendarEventBatch& batch) { collected.add(batch); }, options);
+        CHECK(report.events == 3);
+        CHECK(report.skipped == 1);
+        CHECK(report.batches == 2 && collected.batches == 2);
+        CHECK(report.bytes == data.size());
+        CHECK(collected.events.size() == 3);
+
+        CHECK(collected.uids[0] == "first@example.com");
+        CHECK(collected.events[0].start == jan2 + 3 * 3600 + 4 * 60 + 5);
+        CHECK(collected.events[0].end == collected.events[0].start + 3600);
+        CHECK(!collected.events[0].allDay);
+        CHECK(collected.summaries[0] == "Review, planning\nand a summary line long enough to cross a vector width");
+
+        CHECK(collected.uids[1] == "second@example.com");
+        CHECK(collected.events[1].allDay);
+        CHECK(collected.events[1].start == mar1);
+        CHECK(collected.events[1].end == mar1 + 86400);
+        CHECK(collected.summaries[1] == "Foldedline");
+
+        CHECK(collected.uids[2] == "third");
+        CHECK(collected.events[2].end - collected.events[2].start == 5400);
+        if (newYork)
+            CHECK(collected.events[2].start == jan15 + 14 * 3600);
+        else
+            std::printf("America/New_York not available, TZID conversion not checked\n");
+    }
+
+    //floating times use the configured zone
+    if (newYork) {
+        Collected collected;
+        IcalImportOptions options;
+        options.floatingZone = newYork;
+        std::string data = "BEGIN:VEVENT\nDTSTART:20240115T090000\nEND:VEVENT\n";
+        parse_ical(data.data(), data.size(), [&](CalendarEventBatch& batch) { collected.add(batch); }, options);
+        CHECK(collected.events.size() == 1);
+        CHECK(collected.events[0].start == jan15 + 14 * 3600);
+    }
+
+    //a file imported into a calendar, many events across several batches
+    {
+        char path[] = "/tmp/ical_testXXXXXX";
+        int fd = mkstemp(path);
+        CHECK(fd >= 0);
+        std::string data = "BEGIN:VCALENDAR\n";
+        const int count = 10000;
+        for (int i = 0; i < count; ++i) {
+            data += "BEGIN:VEVENT\nUID:event-" + std::to_string(i) + "\nDTSTART:20240102T000000Z\n";
+            data += "DURATION:P" + std::to_string(i % 7) + "D\nSUMMARY:Event number " + std::to_string(i) + "\nEND:VEVENT\n";
+        }
+        data += "END:VCALENDAR\n";
+        CHECK(write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+        close(fd);
+
+        CalendarWidget calendar;
+        IcalImportReport report = import_ical(calendar, path);
+        unlink(path);
+        CHECK(report.events == count);
+        CHECK(report.batches == (count + 4095) / 4096);
+        CHECK(calendar.eventCount() == count);
+        CHECK(calendar.eventUid(1234) == "event-1234");
+        CHECK(calendar.eventSummary(count - 1) == "Event number " + std::to_string(count - 1));
+        CHECK(calendar.event(9).end == jan2 + 2 * 86400);
+
+        bool threw = false;
+        try {
+            import_ical(calendar, "/nonexistent/calendar.ics");
+        }
+        catch (const std::runtime_error&) {
+            threw = true;
+        }
+        CHECK(threw);
+        CHECK(calendar.eventCount() == count);
+    }
+    return check_failures();
+}
@@ -0,0 +1,124 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "check.h"
+#include "lazy.h"
+
+//global allocations fail on demand: the n-th allocation after arming throws. gcc cannot see
+//that the replaced operator new hands out malloc memory
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+static std::atomic<int> failCountdown{ 0 };
+
+void* operator new(size_t size) {
+    if (failCountdown.load(std::memory_order_relaxed) > 0 && failCountdown.fetch_sub(1) == 1)
+        throw std::bad_alloc();
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+static std::atomic<int> live{ 0 };
+
+struct FontTable
+{
+    std::vector<int> glyphs;
+    FontTable() : glyphs(4096, 3) { ++live; }
+    ~FontTable() { --live; }
+};
+
+static void once_across_threads() {
+    MyLazyShared<FontTable> fonts;
+    CHECK(!fonts.initialized() && fonts.constructionCount() == 0);
+    std::vector<MyLazyShared<FontTable>::Pointer> kept(8);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&fonts, &kept, i] {
+            for (int k = 0; k < 1000; ++k) {
+                CHECK(fonts.get().glyphs[5] == 3);
+                MyLazyShared<FontTable>::Pointer owner = fonts.shared();
+                CHECK(owner && owner->glyphs[0] == 3);
+            }
+            kept[i] = fonts.shared();
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    CHECK(fonts.constructionCount() == 1 && live == 1);
+    CHECK(kept[0].use_count() == 9);
+
+    //teardown drops the instance's reference, owners keep the object alive
+    fonts.teardown();
+    CHECK(!fonts.initialized() && live == 1);
+    for (auto& owner : kept)
+        owner.reset();
+    CHECK(live == 0);
+
+    //the next access builds a new instance
+    fonts->glyphs[0] = 1;
+    CHECK(live == 1 && fonts.constructionCount() == 2);
+}
+
+static void failures_leave_it_unbuilt() {
+    int attempts = 0;
+    MyLazyShared<FontTable> failing([&attempts]() -> FontTable* {
+        if (++attempts == 1)
+            throw 1;
+        return new FontTable();
+    });
+    bool threw = false;
+    try {
+        failing.get();
+    }
+    catch (int) {
+        threw = true;
+    }
+    CHECK(threw && !failing.initialized());
+    failing.get();
+    CHECK(attempts == 2 && failing.initialized());
+
+    MyLazyShared<FontTable> null([]() -> FontTable* { return nullptr; });
+    threw = false;
+    try {
+        null.get();
+    }
+    catch (const std::bad_alloc&) {
+        threw = true;
+    }
+    CHECK(threw && !null.initialized());
+
+    //allocation failures after the factory ran: the holder (second allocation after the object's
+    //two) and the control block (third)
+    for (int failAt : { 3, 4 }) {
+        MyLazyShared<FontTable> fonts;
+        int before = live;
+        threw = false;
+        failCountdown = failAt;
+        try {
+            fonts.get();
+        }
+        catch (const std::bad_alloc&) {
+            threw = true;
+        }
+        failCountdown = 0;
+        CHECK(threw && !fonts.initialized() && live == before);
+        CHECK(fonts.get().glyphs[1] == 3);
+    }
+}
+
+int main() {
+    once_across_threads();
+    failures_leave_it_unbuilt();
+    CHECK(live == 0);
+    return check_failures();
+}
@@ -0,0 +1,159 @@
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "check.h"
+#include "memory.h"
+
+static int live = 0;
+
+struct Tracked
+{
+    int value;
+    explicit Tracked(int value = 0) : value(value) { ++live; }
+    ~Tracked() { --live; }
+};
+
+struct CountingDeleter
+{
+    int* calls;
+    void operator()(Tracked* ptr) const noexcept {
+        ++*calls;
+        delete ptr;
+    }
+};
+
+static void unique_pointers() {
+    {
+        MyUniquePtr<Tracked> a = make_my_unique<Tracked>(1);
+        MyUniquePtr<Tracked> b(std::move(a));
+        CHECK(!a && b && b->value == 1);
+        b.reset(new Tracked(2));
+        CHECK(live == 1 && b->value == 2);
+        Tracked* raw = b.release();
+        CHECK(!b);
+        delete raw;
+    }
+    {
+        MyUniquePtr<int[]> array = make_my_unique<int[]>(8);
+        CHECK(array[7] == 0);
+    }
+    CHECK(live == 0);
+}
+
+static void shared_pointers() {
+    {
+        MySharedPtr<Tracked> a(new Tracked(1));
+        MySharedPtr<Tracked> b(a);
+        CHECK(a.use_count() == 2 && b.get() == a.get());
+
+        //assignment releases what the target held
+        MySharedPtr<Tracked> c(new Tracked(2));
+        c = a;
+        CHECK(live == 1 && a.use_count() == 3);
+        MySharedPtr<Tracked> empty;
+        c = empty;
+        CHECK(!c && a.use_count() == 2);
+        b = std::move(c);
+        CHECK(live == 1 && a.use_count() == 1 && !b);
+        a = MySharedPtr<Tracked>();
+        CHECK(live == 0);
+
+        //null pointers copy and compare safely
+        MySharedPtr<Tracked> null;
+        MySharedPtr<Tracked> copy(null);
+        copy = null;
+        CHECK(copy.use_count() == 0 && !copy.unique());
+
+        //reset releases the old object and owns the new one
+        MySharedPtr<Tracked> d(new Tracked(3));
+        d.reset(new Tracked(4));
+        CHECK(live == 1 && d->value == 4 && d.unique());
+        d.reset();
+        CHECK(live == 0 && d.use_count() == 0);
+
+        MySharedPtr<Tracked> e(new Tracked(5)), f(new Tracked(6));
+        CHECK(e.owner_before(f) != f.owner_before(e));
+    }
+    {
+        int calls = 0;
+        {
+            MySharedPtr<Tracked, CountingDeleter> a(new Tracked(1), CountingDeleter{ &calls });
+            MySharedPtr<Tracked, CountingDeleter> b = a;
+        }
+        CHECK(calls == 1);
+    }
+    CHECK(live == 0);
+}
+
+static void weak_pointers() {
+    {
+        MySharedPtr<Tracked> shared(new Tracked(1));
+        MyWeakPtr<Tracked> weak(shared);
+        MyWeakPtr<Tracked> copy(weak);
+        CHECK(!weak.expired() && weak.use_count() == 1);
+        CHECK(shared.getCB()->getWeakRef() == 2);
+        {
+            MySharedPtr<Tracked> locked = weak.lock();
+            CHECK(locked.get() == shared.get() && shared.use_count() == 2);
+        }
+        //assigning a weak pointer drops the reference it held
+        MySharedPtr<Tracked> other(new Tracked(2));
+        copy = other;
+        CHECK(shared.getCB()->getWeakRef() == 1 && other.getCB()->getWeakRef() == 1);
+        copy = weak;
+        CHECK(shared.getCB()->getWeakRef() == 2);
+
+        shared.reset();
+        CHECK(live == 1 && weak.expired() && copy.expired());
+        CHECK(!weak.lock());
+        MyWeakPtr<Tracked> empty;
+        CHECK(empty.expired() && !empty.lock());
+        copy = empty;
+        CHECK(!copy.getCB());
+    }
+    CHECK(live == 0);
+
+    //the owners' shared weak reference is not reported; the block outlives the object only while
+    //observed, and a stateful deleter runs once, from the copy taken before the block may go
+    {
+        int calls = 0;
+        MySharedPtr<Tracked, CountingDeleter> owner(new Tracked(1), CountingDeleter{ &calls });
+        CHECK(owner.getCB()->getWeakRef() == 0 && owner.getCB()->getStrongRef() == 1);
+        MyWeakPtr<Tracked, CountingDeleter> observer(owner);
+        CHECK(owner.getCB()->getWeakRef() == 1);
+        owner.reset();
+        CHECK(calls == 1 && live == 0 && observer.expired());
+        CHECK(observer.getCB()->getWeakRef() == 1);
+        observer.reset();
+        MySharedPtr<Tracked, CountingDeleter> alone(new Tracked(2), CountingDeleter{ &calls });
+        alone = MySharedPtr<Tracked, CountingDeleter>();
+        CHECK(calls == 2 && live == 0);
+    }
+
+    //the last strong and the last weak release racing on different threads free the block once
+    for (int round = 0; round < 2000; ++round) {
+        using Shared = MySharedPtr<Tracked, default_delete<Tracked>, AtomicRefCount>;
+        using Weak = MyWeakPtr<Tracked, default_delete<Tracked>, AtomicRefCount>;
+        Shared* shared = new Shared(new Tracked(round));
+        Weak* weak = new Weak(*shared);
+        std::thread strongSide([shared] { delete shared; });
+        std::thread weakSide([weak] {
+            Shared promoted = weak->lock();
+            if (promoted)
+                CHECK(promoted->value >= 0);
+            delete weak;
+        });
+        strongSide.join();
+        weakSide.join();
+    }
+    CHECK(live == 0);
+}
+
+int main() {
+    unique_pointers();
+    shared_pointers();
+    weak_pointers();
+    return check_failures();
+}
@@ -0,0 +1,234 @@
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Widget.h"
+#include "check.h"
+
+struct Box : Widget
+{
+    std::string getType() const override {
+        return "Box";
+    }
+};
+
+//the subscriber's copy of the tree, built only from batches
+struct Mirror
+{
+    std::map<uint64_t, std::vector<uint64_t>> children;
+
+    static uint64_t id(const Widget* widget) {
+        return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(widget));
+    }
+
+    void seed(const Widget* widget) {
+        auto& list = children[id(widget)];
+        list.clear();
+        for (const auto& child : widget->getChildren()) {
+            list.push_back(id(child.get()));
+            seed(child.get());
+        }
+    }
+    void drop(uint64_t node) {
+        for (uint64_t child : children[node])
+            drop(child);
+        children.erase(node);
+    }
+    void detach(uint64_t parent, uint64_t node) {
+        auto& list = children[parent];
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (list[i] == node) {
+                list.erase(list.begin() + i);
+                return;
+            }
+        }
+        CHECK(false);
+    }
+    void apply(const std::vector<uint8_t>& batch) {
+        MutationBatchReader reader(batch.data(), batch.size());
+        MutationRecord record;
+        while (reader.next(record)) {
+            switch (record.kind) {
+            case MutationKind::Added:
+                CHECK(children.count(record.newParent) == 1);
+                CHECK(children.count(record.node) == 0);
+                children[record.newParent].push_back(record.node);
+                children[record.node];
+                break;
+            case MutationKind::Removed:
+                detach(record.oldParent, record.node);
+                drop(record.node);
+                break;
+            case MutationKind::Reparented:
+                CHECK(children.count(record.newParent) == 1);
+                detach(record.oldParent, record.node);
+                children[record.newParent].push_back(record.node);
+                break;
+            case MutationKind::Property:
+                CHECK(children.count(record.node) == 1);
+                break;
+            }
+        }
+    }
+    //same nodes in the same sibling order as the live tree
+    bool matches(const Widget* root) const {
+        Mirror expected;
+        expected.seed(root);
+        return expected.children == children;
+    }
+};
+
+static size_t countKind(const std::vector<uint8_t>& batch, MutationKind kind) {
+    MutationBatchReader reader(batch.data(), batch.size());
+    MutationRecord record;
+    size_t count = 0;
+    while (reader.next(record))
+        count += record.kind == kind;
+    return count;
+}
+
+static Widget* addBox(Widget* parent) {
+    Widget* box = new Box();
+    parent->addChild(box);
+    return box;
+}
+
+int main() {
+    Box root;
+    Widget* a = addBox(&root);
+    Widget* b = addBox(&root);
+    Widget* a1 = addBox(a);
+
+    MutationFeed feed(&root);
+    MutationFeed::install(&feed);
+    CHECK(MutationFeed::active() == &feed);
+    Mirror mirror;
+    mirror.seed(&root);
+
+    //siblings keep the order they were appended in, whatever their addresses
+    {
+        std::vector<Widget*> added;
+        for (int i = 0; i < 16; ++i)
+            added.push_back(addBox(b));
+        mirror.apply(feed.encode());
+        CHECK(mirror.matches(&root));
+        for (Widget* widget : added)
+            b->removeChild(widget);
+        mirror.apply(feed.encode());
+        CHECK(mirror.matches(&root));
+    }
+
+    //a subtree built detached reports nothing until it is attached, then arrives whole
+    {
+        MyUniquePtr<Widget> detached(new Box());
+        Widget* inner = addBox(detached.get());
+        addBox(inner);
+        WidgetProperties properties;
+        properties.flags = 1;
+        inner->setProperties(properties);
+        std::vector<uint8_t> batch = feed.encode();
+        CHECK(countKind(batch, MutationKind::Added) == 0);
+        CHECK(countKind(batch, MutationKind::Property) == 0);
+        root.addChild(detached.release());
+        batch = feed.encode();
+        CHECK(countKind(batch, MutationKind::Added) == 3);
+        mirror.apply(batch);
+        CHECK(mirror.matches(&root));
+    }
+
+    //a child added under a removed but still alive node is not reported
+    {
+        MyUniquePtr<Widget> removed = root.removeChild(a);
+        addBox(removed.get());
+        std::vector<uint8_t> batch = feed.encode();
+        CHECK(countKind(batch, MutationKind::Removed) == 1);
+        CHECK(countKind(batch, MutationKind::Added) == 0);
+        mirror.apply(batch);
+        CHECK(mirror.matches(&root));
+
+        //and comes back with the subtree when it is attached again
+        root.addChild(removed.release());
+        batch = feed.encode();
+        CHECK(countKind(batch, MutationKind::Added) == 3);
+        mirror.apply(batch);
+        CHECK(mirror.matches(&root));
+    }
+
+    //a node moved out of a subtree that is removed in the same frame; removals go first, so the
+    //mirror loses it with the subtree and gets it back as an addition
+    {
+        MyUniquePtr<Widget> moved = a->removeChild(a1);
+        b->addChild(moved.release());
+        MyUniquePtr<Widget> gone = root.removeChild(a);
+        gone.reset();
+        std::vector<uint8_t> batch = feed.encode();
+        CHECK(countKind(batch, MutationKind::Removed) == 1);
+        CHECK(countKind(batch, MutationKind::Added) == 1);
+        mirror.apply(batch);
+        CHECK(mirror.matches(&root));
+    }
+
+    //a move between two parents that stay is one record
+    {
+        Widget* target = root.getChildren().front().get();
+        MyUniquePtr<Widget> moved = b->removeChild(a1);
+        target->addChild(moved.release());
+        std::vector<uint8_t> batch = feed.encode();
+        CHECK(countKind(batch, MutationKind::Reparented) == 1);
+        CHECK(countKind(batch, MutationKind::Added) == 0);
+        mirror.apply(batch);
+        CHECK(mirror.matches(&root));
+        moved = target->removeChild(a1);
+        b->addChild(moved.release());
+        mirror.apply(feed.encode());
+    }
+
+    //a node moved into a subtree that is removed in the same frame goes with it
+    {
+        Widget* c = addBox(&root);
+        mirror.apply(feed.encode());
+        MyUniquePtr<Widget> moved = b->removeChild(a1);
+        c->addChild(moved.release());
+        MyUniquePtr<Widget> gone = root.removeChild(c);
+        std::vector<uint8_t> batch = feed.encode();
+        CHECK(countKind(batch, MutationKind::Removed) == 2);
+        CHECK(countKind(batch, MutationKind::Reparented) == 0);
+        mirror.apply(batch);
+        CHECK(mirror.matches(&root));
+    }
+
+    //worker threads create, change and destroy detached widgets while the UI thread edits the tree
+    //and encodes; their records never reach a batch and the mirror stays in step
+    {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; ++t) {
+            workers.emplace_back([] {
+                WidgetProperties properties;
+                for (int i = 0; i < 2000; ++i) {
+                    MyUniquePtr<Widget> detached(new Box());
+                    addBox(detached.get());
+                    properties.flags = static_cast<uint32_t>(i);
+                    detached->setProperties(properties);
+                }
+            });
+        }
+        for (int i = 0; i < 200; ++i) {
+            Widget* added = addBox(b);
+            std::vector<uint8_t> batch = feed.encode();
+            CHECK(countKind(batch, MutationKind::Property) == 0);
+            mirror.apply(batch);
+            b->removeChild(added);
+            mirror.apply(feed.encode());
+        }
+        for (std::thread& worker : workers)
+            worker.join();
+        mirror.apply(feed.encode());
+        CHECK(mirror.matches(&root));
+        CHECK(feed.pendingRecords() == 0);
+    }
+
+    MutationFeed::install(nullptr);
+    CHECK(MutationFeed::active() == nullptr);
+    return check_failures();
+}
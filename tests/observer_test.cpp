@@ -0,0 +1,115 @@
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "observer.h"
+#include "Widget.h"
+#include "check.h"
+
+struct Document : MyObservable
+{
+    int value;
+    explicit Document(int value) : value(value) {};
+};
+
+//checks from its destructor what its observers see while it is torn down
+struct Panel : MyObservable
+{
+    MyUniqueObserver<Panel>* watcher = nullptr;
+    bool* watcherExpired = nullptr;
+    bool* lateExpired = nullptr;
+    ~Panel() {
+        expireObservers();
+        *watcherExpired = watcher->expired();
+        MyUniqueObserver<Panel> late(this);
+        *lateExpired = late.expired();
+    }
+};
+
+struct Box : Widget
+{
+    std::string getType() const override {
+        return "Box";
+    }
+};
+
+int main() {
+    //observers follow the owner and never keep the object alive
+    {
+        MyUniquePtr<Document> owner(new Document(7));
+        CHECK(!owner->isObserved());
+        MyUniqueObserver<Document> observer(owner);
+        CHECK(owner->isObserved());
+        CHECK(observer.get() == owner.get() && observer->value == 7);
+        MyUniqueObserver<Document> copy = observer;
+        MyUniqueObserver<Document> moved = std::move(copy);
+        CHECK(!copy && moved);
+        owner.reset();
+        CHECK(observer.expired() && moved.expired());
+        CHECK(observer.get() == nullptr);
+        CHECK(!observer);
+    }
+
+    //an empty observer is expired, a copied object has observers of its own
+    {
+        MyUniqueObserver<Document> empty;
+        CHECK(empty.expired());
+        Document original(1);
+        MyUniqueObserver<Document> observer(&original);
+        Document copy(original);
+        CHECK(!copy.isObserved());
+        copy = original;
+        CHECK(!copy.isObserved());
+        CHECK(observer.get() == &original);
+    }
+
+    //derived destructors expire observers first, and later observers start out expired
+    {
+        bool watcherExpired = false;
+        bool lateExpired = false;
+        MyUniquePtr<Panel> owner(new Panel());
+        MyUniqueObserver<Panel> watcher(owner);
+        owner->watcher = &watcher;
+        owner->watcherExpired = &watcherExpired;
+        owner->lateExpired = &lateExpired;
+        owner.reset();
+        CHECK(watcherExpired && lateExpired);
+        CHECK(watcher.expired());
+    }
+
+    //observers are copied and dropped on other threads while the owner stays put
+    {
+        MyUniquePtr<Document> owner(new Document(3));
+        MyUniqueObserver<Document> observer(owner);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([observer] {
+                for (int i = 0; i < 10000; ++i) {
+                    MyUniqueObserver<Document> copy(observer);
+                    copy.reset();
+                }
+            });
+        }
+        for (std::thread& thread : threads)
+            thread.join();
+        CHECK(observer.get() == owner.get());
+        owner.reset();
+        CHECK(observer.expired());
+    }
+
+    //widgets are observable: a child observer expires when the subtree holding it is destroyed
+    {
+        Box root;
+        Widget* parent = new Box();
+        root.addChild(parent);
+        Widget* child = new Box();
+        parent->addChild(child);
+        MyUniqueObserver<Widget> observer(child);
+        CHECK(observer.get() == child);
+        MyUniquePtr<Widget> detached = root.removeChild(parent);
+        CHECK(observer.get() == child);
+        detached.reset();
+        CHECK(observer.expired());
+    }
+    return check_failures();
+}
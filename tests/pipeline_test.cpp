@@ -0,0 +1,140 @@
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pipeline.h"
+#include "check.h"
+
+struct Box : Widget
+{
+    std::string getType() const override {
+        return "Box";
+    }
+};
+
+struct Paint
+{
+    uint64_t frame;
+    size_t nodes;
+};
+
+using Pipeline = FramePipeline<WidgetFrame, Paint>;
+
+//collects until the paint list of frame last arrives, false if it never does
+static bool collectUntil(Pipeline& pipeline, uint64_t last, std::vector<uint64_t>& collected) {
+    for (int i = 0; i < 5000; ++i) {
+        uint64_t id;
+        if (MyUniquePtr<Paint> paint = pipeline.collect(&id)) {
+            CHECK(paint->frame == id);
+            collected.push_back(id);
+            if (id == last)
+                return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+int main() {
+    Box root;
+    for (int i = 0; i < 3; ++i) {
+        Widget* child = new Box();
+        root.addChild(child);
+        child->addChild(new Box());
+    }
+    WidgetProperties properties;
+    properties.width = 640.0f;
+    root.setProperties(properties);
+
+    //a tree snapshot lists the widgets parents first, with their properties at capture time
+    {
+        MyUniquePtr<const WidgetFrame> frame = WidgetFrame::capture(root);
+        CHECK(frame->nodes.size() == 7);
+        CHECK(frame->nodes[0].parent == WidgetFrame::NO_PARENT && frame->nodes[0].properties.width == 640.0f);
+        CHECK(frame->nodes[1].parent == 0 && frame->nodes[2].parent == 1 && frame->nodes[2].depth == 2);
+        CHECK(frame->nodes[1].id == reinterpret_cast<uintptr_t>(root.getChildren()[0].get()));
+        CHECK(frame->nodes[6].type == "Box");
+        properties.width = 1.0f;
+        root.setProperties(properties);
+        CHECK(frame->nodes[0].properties.width == 640.0f);
+    }
+
+    //frames are painted in submit order and collect only ever moves forward
+    {
+        std::vector<uint64_t> painted;      //worker thread only until the pipeline is gone
+        uint64_t count = 0;
+        {
+            Pipeline pipeline([&](const WidgetFrame& frame) {
+                painted.push_back(count++);
+                return MyUniquePtr<Paint>(new Paint{ painted.back(), frame.nodes.size() });
+            });
+            std::vector<uint64_t> collected;
+            uint64_t last = 0;
+            for (int i = 0; i < 200; ++i) {
+                pipeline.beginFrame();
+                last = pipeline.submit(WidgetFrame::capture(root));
+                if (MyUniquePtr<Paint> paint = pipeline.collect()) {
+                    CHECK(paint->nodes == 7);
+                    collected.push_back(paint->frame);
+                }
+            }
+            CHECK(collectUntil(pipeline, last, collected));
+            bool increasing = true;
+            for (size_t i = 1; i < collected.size(); ++i)
+                increasing = increasing && collected[i] > collected[i - 1];
+            CHECK(increasing);
+            CHECK(pipeline.metrics().paint.count == 200);
+        }
+        CHECK(painted.size() == 200 && painted.back() == 199);
+    }
+
+    //the destructor waits for the frame being painted and the ones queued behind it
+    {
+        std::atomic<int> painted{ 0 };
+        {
+            Pipeline pipeline([&](const WidgetFrame&) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                ++painted;
+                return MyUniquePtr<Paint>(new Paint{ 0, 0 });
+            }, 2);
+            for (int i = 0; i < 3; ++i)
+                pipeline.submit(WidgetFrame::capture(root));
+        }
+        CHECK(painted == 3);
+    }
+
+    //a painter that throws reaches the UI thread through collect, later frames still arrive
+    {
+        Pipeline pipeline([](const WidgetFrame& frame) {
+            if (frame.nodes[0].properties.flags == 1)
+                throw std::runtime_error("paint failed");
+            return MyUniquePtr<Paint>(new Paint{ frame.nodes[0].properties.flags, 0 });
+        });
+        Box single;
+        for (uint32_t flags : { 0u, 1u, 2u }) {
+            properties.flags = flags;
+            single.setProperties(properties);
+            pipeline.submit(WidgetFrame::capture(single));
+        }
+        bool threw = false;
+        uint64_t id = 0;
+        std::vector<uint64_t> collected;
+        for (int i = 0; i < 5000 && !threw; ++i) {
+            try {
+                if (MyUniquePtr<Paint> paint = pipeline.collect(&id))
+                    collected.push_back(paint->frame);
+            }
+            catch (const std::runtime_error& error) {
+                threw = std::string(error.what()) == "paint failed";
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        CHECK(threw && id == 1);
+        CHECK(collectUntil(pipeline, 2, collected));
+        CHECK(collected.back() == 2);
+    }
+    return check_failures();
+}
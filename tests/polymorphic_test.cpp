@@ -0,0 +1,131 @@
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "polymorphic.h"
+#include "check.h"
+
+static int live = 0;
+
+//no virtual destructor and no clone method, the holder handles both; final derived types keep
+//-Wdelete-non-virtual-dtor quiet about heap stored ones
+struct Shape
+{
+    virtual double area() const = 0;
+};
+
+struct Square final : Shape
+{
+    double side;
+    explicit Square(double side) : side(side) { ++live; }
+    Square(const Square& other) : side(other.side) { ++live; }
+    Square(Square&& other) noexcept : side(other.side) { ++live; }
+    ~Square() { --live; }
+    double area() const override {
+        return side * side;
+    }
+};
+
+//too large for the buffer
+struct Polygon final : Shape
+{
+    double points[32] = {};
+    std::string name;
+    explicit Polygon(std::string name) : name(std::move(name)) { ++live; }
+    Polygon(const Polygon& other) : name(other.name) { ++live; }
+    ~Polygon() { --live; }
+    double area() const override {
+        return static_cast<double>(name.size());
+    }
+};
+
+//small but move only
+struct Handle final : Shape
+{
+    std::unique_ptr<double> value;
+    explicit Handle(double value) : value(new double(value)) { ++live; }
+    Handle(Handle&& other) noexcept : value(std::move(other.value)) { ++live; }
+    ~Handle() { --live; }
+    double area() const override {
+        return value ? *value : -1.0;
+    }
+};
+
+using Value = MyPolymorphicValue<Shape>;
+
+int main() {
+    CHECK(Value::storesInline<Square>());
+    CHECK(!Value::storesInline<Polygon>());
+
+    //copies are deep, inline or not
+    {
+        Value square = make_my_polymorphic<Shape, Square>(3.0);
+        Value polygon = make_my_polymorphic<Shape, Polygon>("hexagon");
+        CHECK(square.isInline() && !polygon.isInline());
+        CHECK(live == 2);
+        Value squareCopy = square;
+        Value polygonCopy(polygon);
+        CHECK(live == 4);
+        CHECK(squareCopy.get() != square.get() && polygonCopy.get() != polygon.get());
+        static_cast<Square*>(squareCopy.get())->side = 4.0;
+        CHECK(square->area() == 9.0 && squareCopy->area() == 16.0);
+        CHECK(polygonCopy->area() == 7.0);
+    }
+    CHECK(live == 0);
+
+    //moves relocate inline objects and steal heap ones
+    {
+        Value square(Square(2.0));
+        Value polygon = make_my_polymorphic<Shape, Polygon>("pentagon");
+        Shape* heap = polygon.get();
+        Value movedPolygon(std::move(polygon));
+        CHECK(!polygon && movedPolygon.get() == heap);
+        Value movedSquare = std::move(square);
+        CHECK(!square && movedSquare.isInline() && movedSquare->area() == 4.0);
+        CHECK(live == 2);
+
+        movedSquare.swap(movedPolygon);
+        CHECK(movedSquare.get() == heap && movedPolygon.isInline());
+        CHECK(movedPolygon->area() == 4.0);
+        CHECK(live == 2);
+    }
+    CHECK(live == 0);
+
+    //emplace and assignment destroy the previous object
+    {
+        Value value;
+        CHECK(!value && !value.isInline());
+        value.emplace<Square>(1.0);
+        value.emplace<Polygon>("triangle");
+        CHECK(live == 1 && value->area() == 8.0);
+        Value other = make_my_polymorphic<Shape, Square>(5.0);
+        value = other;
+        CHECK(live == 2 && value->area() == 25.0);
+        value = Value();
+        CHECK(live == 1);
+        value.reset();
+        CHECK(live == 1);
+    }
+    CHECK(live == 0);
+
+    //move only types can be moved but copying them throws and leaves the target as it was
+    {
+        Value handle = make_my_polymorphic<Shape, Handle>(6.0);
+        CHECK(handle.isInline());
+        Value moved = std::move(handle);
+        CHECK(moved->area() == 6.0);
+        Value target = make_my_polymorphic<Shape, Square>(1.0);
+        bool threw = false;
+        try {
+            target = moved;
+        }
+        catch (const std::logic_error&) {
+            threw = true;
+        }
+        CHECK(threw);
+        CHECK(target->area() == 1.0);
+        CHECK(live == 2);
+    }
+    CHECK(live == 0);
+    return check_failures();
+}
@@ -0,0 +1,114 @@
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pressure.h"
+#include "check.h"
+
+//content large enough that building it shows in the resident set
+struct Page : Widget
+{
+    std::vector<char> pixels;
+    Page() : pixels(size_t(4) << 20) {
+        std::memset(pixels.data(), 1, pixels.size());
+    }
+    std::string getType() const override {
+        return "Page";
+    }
+};
+
+static MyUniquePtr<Widget> buildPage() {
+    return MyUniquePtr<Widget>(new Page());
+}
+
+int main() {
+    MemoryPressureMonitor monitor;
+
+    TextShapingCache cache;
+    FontKey font;
+    for (int i = 0; i < 200; ++i)
+        cache.measure(cache.intern("label " + std::to_string(i)), font);
+    TextCacheConsumer textConsumer(cache);
+    CHECK(textConsumer.reclaimableBytes() == cache.memoryBytes());
+
+    TabWidget tabs;
+    for (int i = 0; i < 3; ++i)
+        tabs.addTab("tab " + std::to_string(i), buildPage);
+    tabs.activate(0);
+    tabs.activate(1);
+    tabs.activate(2);
+    TabContentConsumer tabConsumer(tabs);
+    CHECK(tabs.inactiveBytes() > 0);
+    CHECK(tabConsumer.reclaimableBytes() == tabs.inactiveBytes());
+
+    monitor.addConsumer(tabConsumer, EvictionPriority::InactiveSubtree);
+    monitor.addConsumer(textConsumer, EvictionPriority::RenderCache);
+
+    //the render cache goes first, from another thread the bytes are only booked and reported apart
+    //from what was freed
+    {
+        size_t small = cache.memoryBytes() / 2;
+        EvictionReport report;
+        std::thread other([&] { report = monitor.relieve(small); });
+        other.join();
+        CHECK(report.evicted == 0);
+        CHECK(report.scheduled >= small);
+        CHECK(monitor.evictedBytes() == 0);
+        CHECK(cache.size() == 200);
+        CHECK(textConsumer.pendingBytes() == report.scheduled);
+        CHECK(tabConsumer.pendingBytes() == 0);
+        size_t freedElsewhere = 1;
+        std::thread([&] { freedElsewhere = textConsumer.evict(SIZE_MAX); }).join();
+        CHECK(freedElsewhere == 0);
+        size_t before = cache.memoryBytes();
+        CHECK(textConsumer.service() > 0);
+        CHECK(cache.memoryBytes() < before);
+        CHECK(cache.size() < 200);
+        CHECK(textConsumer.pendingBytes() == 0);
+    }
+
+    //on the owner thread eviction reaches the inactive tabs, least recently active first
+    {
+        EvictionReport report = monitor.relieve(cache.memoryBytes() + 1);
+        CHECK(report.evicted > 0);
+        CHECK(cache.size() == 0);
+        CHECK(!tabs.isBuilt(0));
+        CHECK(tabs.isBuilt(1));
+        CHECK(tabs.isBuilt(2));
+        CHECK(tabs.activate(0) != nullptr);
+        CHECK(tabs.isBuilt(0));
+    }
+
+    //the active tab is never unloaded
+    {
+        CHECK(tabs.unloadInactive(SIZE_MAX) > 0);
+        CHECK(tabs.isBuilt(0));
+        CHECK(!tabs.isBuilt(1));
+        CHECK(!tabs.isBuilt(2));
+        CHECK(tabs.inactiveBytes() == 0);
+    }
+
+    //warm builds can be shed from any thread; one candidate, so the pool is settled once it is warm
+    {
+        TabWarmer warmer(tabs, 1);
+        WarmTabConsumer warmConsumer(warmer);
+        warmer.activate(1);
+        warmer.activate(2);
+        tabs.unloadInactive(SIZE_MAX);
+        warmer.idle();
+        for (int i = 0; i < 1000 && warmer.warmBytes() == 0; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        size_t warm = warmConsumer.reclaimableBytes();
+        CHECK(warm > 0);
+        size_t freed = 0;
+        std::thread other([&] { freed = warmConsumer.evict(SIZE_MAX); });
+        other.join();
+        CHECK(freed == warm);
+        CHECK(warmer.warmBytes() == 0);
+    }
+
+    monitor.removeConsumer(textConsumer);
+    monitor.removeConsumer(tabConsumer);
+    return check_failures();
+}
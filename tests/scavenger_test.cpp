@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "scavenger.h"
+#include "check.h"
+
+static constexpr size_t REGION = HugePageArena::HUGE_PAGE_SIZE;
+
+//fills three regions with touched blocks and frees them again, leaving them resident and empty
+static void churn(HugePageArena& arena) {
+    std::vector<std::pair<void*, size_t>> blocks;
+    for (int i = 0; i < 3; ++i) {
+        size_t size = REGION - 4096;
+        void* block = arena.allocate(size);
+        std::memset(block, 1, size);
+        blocks.emplace_back(block, size);
+    }
+    for (auto& block : blocks)
+        arena.deallocate(ArenaPageMap::instance().find(block.first), block.second);
+}
+
+template<typename F>
+static bool waitFor(F&& done) {
+    for (int i = 0; i < 2000; ++i) {
+        if (done())
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return false;
+}
+
+int main() {
+    //regions that were not idle for minIdle are left alone
+    {
+        HugePageArena arena;
+        churn(arena);
+        CHECK(arena.trimmableBytes() == 3 * REGION);
+        Scavenger scavenger(std::chrono::milliseconds(2), size_t(64) << 20, std::chrono::hours(1));
+        scavenger.addArena(arena);
+        scavenger.start();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        scavenger.stop();
+        CHECK(scavenger.releasedBytes() == 0);
+        CHECK(arena.trimmableBytes() == 3 * REGION);
+    }
+
+    //the background passes release idle regions, at most bytesPerPass at a time
+    {
+        HugePageArena arena;
+        churn(arena);
+        Scavenger scavenger(std::chrono::milliseconds(2), REGION, std::chrono::milliseconds(0));
+        scavenger.addArena(arena);
+        scavenger.start();
+        CHECK(waitFor([&] { return scavenger.releasedBytes() == 3 * REGION; }));
+        scavenger.stop();
+        CHECK(arena.trimmableBytes() == 0);
+        CHECK(arena.liveBytes() == 0);
+
+        //a trimmed region is reused and counts again once it is free
+        churn(arena);
+        CHECK(arena.reservedBytes() == 3 * REGION);
+        CHECK(arena.trimmableBytes() == 3 * REGION);
+        scavenger.removeArena(arena);
+        CHECK(scavenger.trim().released == 0);
+    }
+
+    //trim() releases every free region of every arena at once and the resident set shrinks
+    {
+        HugePageArena first;
+        HugePageArena second;
+        churn(first);
+        churn(second);
+        Scavenger scavenger;
+        scavenger.addArena(first);
+        scavenger.addArena(second);
+        TrimReport report = scavenger.trim();
+        CHECK(report.released == 6 * REGION);
+        CHECK(report.rssBefore > report.rssAfter);
+        CHECK(scavenger.releasedBytes() == 6 * REGION);
+        CHECK(first.trimmableBytes() == 0 && second.trimmableBytes() == 0);
+    }
+    return check_failures();
+}
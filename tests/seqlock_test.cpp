@@ -0,0 +1,65 @@
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "seqlock.h"
+#include "check.h"
+
+//spans several words and ends in a partial one, every field holds the same value
+struct Frame
+{
+    uint64_t a, b, c, d;
+    uint32_t e;
+};
+
+static bool consistent(const Frame& frame) {
+    return frame.a == frame.b && frame.b == frame.c && frame.c == frame.d && frame.d == frame.e;
+}
+
+int main() {
+    //single threaded round trip, each write moves the version by two
+    {
+        SeqLocked<Frame> locked;
+        Frame frame = locked.load();
+        CHECK(consistent(frame) && frame.a == 0);
+        CHECK(locked.version() == 0);
+        locked.store(Frame{ 7, 7, 7, 7, 7 });
+        CHECK(locked.version() == 2);
+        CHECK(locked.tryLoad(frame));
+        CHECK(consistent(frame) && frame.a == 7);
+    }
+
+    //readers racing one writer only ever see whole frames, and never an older one than before
+    {
+        const uint32_t writes = 200000;
+        SeqLocked<Frame> locked;
+        std::atomic<bool> done{ false };
+        std::atomic<bool> torn{ false };
+        std::atomic<bool> backwards{ false };
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 3; ++r) {
+            readers.emplace_back([&] {
+                uint64_t last = 0;
+                while (!done.load(std::memory_order_acquire)) {
+                    Frame frame = locked.load();
+                    if (!consistent(frame))
+                        torn.store(true);
+                    if (frame.a < last)
+                        backwards.store(true);
+                    last = frame.a;
+                }
+            });
+        }
+        for (uint32_t i = 1; i <= writes; ++i)
+            locked.store(Frame{ i, i, i, i, i });
+        done.store(true, std::memory_order_release);
+        for (std::thread& reader : readers)
+            reader.join();
+        CHECK(!torn.load());
+        CHECK(!backwards.load());
+        CHECK(locked.load().a == writes);
+        CHECK(locked.version() == 2 * writes);
+    }
+    return check_failures();
+}
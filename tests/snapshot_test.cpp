@@ -0,0 +1,174 @@
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "snapshot.h"
+#include "check.h"
+
+static int live = 0;
+
+//carries a value through the snapshot, fails to load values marked bad
+struct Node : Widget
+{
+    int32_t value = 0;
+    Node() { ++live; }
+    explicit Node(int32_t value) : value(value) { ++live; }
+    ~Node() { --live; }
+    std::string getType() const override {
+        return "Node";
+    }
+    void writeState(std::vector<char>& out) const override {
+        detail::put<int32_t>(out, value);
+    }
+    void readState(const char* data, size_t size) override {
+        if (size != sizeof(value))
+            throw std::runtime_error("node: bad state");
+        std::memcpy(&value, data, sizeof(value));
+        if (value < 0)
+            throw std::runtime_error("node: bad value");
+    }
+};
+
+static Widget* addNode(Widget* parent, int32_t value) {
+    Widget* node = new Node(value);
+    parent->addChild(node);
+    return node;
+}
+
+static bool sameTree(const Widget* a, const Widget* b) {
+    std::vector<std::pair<const Widget*, const Widget*>> stack{ { a, b } };
+    while (!stack.empty()) {
+        auto top = stack.back();
+        stack.pop_back();
+        if (static_cast<const Node*>(top.first)->value != static_cast<const Node*>(top.second)->value)
+            return false;
+        const auto& left = top.first->getChildren();
+        const auto& right = top.second->getChildren();
+        if (left.size() != right.size())
+            return false;
+        for (size_t i = 0; i < left.size(); ++i)
+            stack.emplace_back(left[i].get(), right[i].get());
+    }
+    return true;
+}
+
+static uint32_t runCount(const std::vector<char>& snapshot) {
+    uint32_t count;
+    std::memcpy(&count, snapshot.data() + 12, sizeof(count));
+    return count;
+}
+
+template<typename F>
+static bool throwsRuntimeError(F&& f) {
+    try {
+        f();
+    }
+    catch (const std::runtime_error&) {
+        return true;
+    }
+    catch (...) {
+    }
+    return false;
+}
+
+int main() {
+    WidgetFactory factory;
+    factory.registerType<Node>("Node");
+
+    //one large subtree deep under the root is split into many runs
+    {
+        Node root(0);
+        Widget* chain = &root;
+        for (int32_t depth = 1; depth <= 20; ++depth)
+            chain = addNode(chain, depth);
+        int32_t value = 100;
+        for (int i = 0; i < 40; ++i) {
+            Widget* group = addNode(chain, value++);
+            for (int k = 0; k < 50; ++k) {
+                Widget* item = addNode(group, value++);
+                addNode(item, value++);
+            }
+        }
+        addNode(&root, value++);
+        std::vector<char> snapshot = save_snapshot(root, 64);
+        CHECK(runCount(snapshot) >= 40);
+        WidgetDocument document = load_snapshot(snapshot, 4, factory);
+        CHECK(sameTree(&root, document.root.get()));
+        CHECK(document.arenas.size() == 4);
+
+        //the same bytes written straight into caller memory
+        std::vector<char> direct;
+        size_t size = save_snapshot_into(root, [&direct](size_t bytes) {
+            direct.resize(bytes);
+            return direct.data();
+        }, 64);
+        CHECK(size == snapshot.size() && direct == snapshot);
+    }
+
+    //small siblings share runs instead of taking one directory entry each
+    {
+        Node root(0);
+        for (int32_t i = 1; i <= 5000; ++i)
+            addNode(&root, i);
+        std::vector<char> snapshot = save_snapshot(root);
+        CHECK(runCount(snapshot) > 1);
+        CHECK(runCount(snapshot) <= 20);
+        WidgetDocument document = load_snapshot(snapshot, 3, factory);
+        CHECK(sameTree(&root, document.root.get()));
+    }
+
+    //failures destroy everything decoded so far, in a run and in the skeleton
+    {
+        Node root(0);
+        Widget* big = addNode(&root, 1);
+        for (int32_t i = 2; i < 2000; ++i)
+            addNode(big, i);
+        addNode(&root, 5000);
+        static_cast<Node*>(big->getChildren()[1500].get())->value = -1;
+        int before = live;
+        std::vector<char> snapshot = save_snapshot(root, 100);
+        CHECK(throwsRuntimeError([&] { load_snapshot(snapshot, 2, factory); }));
+        CHECK(live == before);
+
+        static_cast<Node*>(big->getChildren()[1500].get())->value = 1500;
+        static_cast<Node*>(big)->value = -1;
+        snapshot = save_snapshot(root, 100);
+        CHECK(throwsRuntimeError([&] { load_snapshot(snapshot, 2, factory); }));
+        CHECK(live == before);
+
+        static_cast<Node*>(big)->value = 1;
+        root.value = -1;
+        snapshot = save_snapshot(root, 100);
+        CHECK(throwsRuntimeError([&] { load_snapshot(snapshot, 2, factory); }));
+        CHECK(live == before);
+        root.value = 0;
+    }
+
+    //node counts larger than their run can hold are rejected before anything is reserved
+    {
+        Node root(0);
+        for (int32_t i = 1; i <= 10; ++i)
+            addNode(&root, i);
+        std::vector<char> snapshot = save_snapshot(root);
+        CHECK(runCount(snapshot) == 1);
+        size_t countAt = snapshot.size() - 10 * (detail::snapshot_record_bytes + sizeof(int32_t)) - sizeof(uint64_t);
+        uint64_t huge = uint64_t(1) << 60;
+        std::memcpy(snapshot.data() + countAt, &huge, sizeof(huge));
+        int before = live;
+        CHECK(throwsRuntimeError([&] { load_snapshot(snapshot, 1, factory); }));
+        CHECK(live == before);
+    }
+
+    //only the current version loads, version 1 never shipped
+    {
+        Node root(7);
+        addNode(&root, 1);
+        std::vector<char> snapshot = save_snapshot(root);
+        uint32_t version = 1;
+        std::memcpy(snapshot.data() + 4, &version, sizeof(version));
+        CHECK(throwsRuntimeError([&] { load_snapshot(snapshot, 1, factory); }));
+    }
+
+    return check_failures();
+}
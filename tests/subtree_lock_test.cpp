@@ -0,0 +1,149 @@
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "Widget.h"
+#include "check.h"
+
+struct Box : Widget
+{
+    std::string getType() const override {
+        return "Box";
+    }
+};
+
+static Widget* addBox(Widget* parent) {
+    Widget* box = new Box();
+    parent->addChild(box);
+    return box;
+}
+
+int main() {
+    SubtreeLockManager locks;
+    Box root;
+    Widget* a = addBox(&root);
+    Widget* b = addBox(&root);
+    Widget* a1 = addBox(a);
+
+    //writers on disjoint subtrees do not wait for each other
+    {
+        SubtreeLockManager::Guard first = locks.lockWrite(a1);
+        std::atomic<bool> done{ false };
+        std::thread other([&] {
+            SubtreeLockManager::Guard second = locks.lockWrite(b);
+            done = true;
+        });
+        other.join();
+        CHECK(done);
+    }
+
+    //a writer on an ancestor waits for the guard below it
+    {
+        std::atomic<bool> acquired{ false };
+        std::thread writer;
+        {
+            SubtreeLockManager::Guard below = locks.lockRead(a1);
+            writer = std::thread([&] {
+                SubtreeLockManager::Guard above = locks.lockWrite(&root);
+                acquired = true;
+            });
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            CHECK(!acquired);
+        }
+        writer.join();
+        CHECK(acquired);
+    }
+
+    //optimistic reads see no writer and run once
+    {
+        int runs = 0;
+        locks.readOptimistic(a1, [&] { ++runs; });
+        CHECK(runs == 1);
+    }
+
+    //readers walk owner chains while the tree is restructured under a write guard
+    {
+        std::atomic<bool> stop{ false };
+        std::thread reader([&] {
+            while (!stop) {
+                SubtreeLockManager::Guard guard = locks.lockRead(a1);
+                CHECK(a1->getOwner() == a || a1->getOwner() == b);
+            }
+        });
+        for (int i = 0; i < 2000; ++i) {
+            SubtreeLockManager::Guard guard = locks.lockWrite(&root);
+            Widget* from = a1->getOwner();
+            Widget* to = from == a ? b : a;
+            MyUniquePtr<Widget> moved = from->removeChild(a1);
+            to->addChild(moved.release());
+        }
+        stop = true;
+        reader.join();
+    }
+
+    //an optimistic read of widgets nobody locked creates no lock state
+    {
+        Widget* fresh = addBox(addBox(b));
+        size_t before = locks.trackedWidgets();
+        int runs = 0;
+        locks.readOptimistic(fresh, [&] { ++runs; });
+        CHECK(runs == 1);
+        CHECK(locks.trackedWidgets() == before);
+    }
+
+    //validated optimistic reads never see half of a write below or on an ancestor
+    {
+        std::atomic<int> first{ 0 }, second{ 0 };
+        std::atomic<bool> stop{ false };
+        bool torn = false;
+        std::thread writer([&] {
+            for (int i = 1; !stop; ++i) {
+                SubtreeLockManager::Guard guard = locks.lockWrite(i % 2 ? a1 : static_cast<const Widget*>(&root));
+                first.store(i, std::memory_order_relaxed);
+                std::this_thread::yield();
+                second.store(i, std::memory_order_relaxed);
+            }
+        });
+        for (int i = 0; i < 20000; ++i) {
+            //only the last run counts, the ones before it failed validation
+            int seenFirst = 0, seenSecond = 0;
+            locks.readOptimistic(a1, [&] {
+                seenFirst = first.load(std::memory_order_relaxed);
+                seenSecond = second.load(std::memory_order_relaxed);
+            }, 1000000);
+            if (seenFirst != seenSecond)
+                torn = true;
+        }
+        stop = true;
+        writer.join();
+        CHECK(!torn);
+    }
+
+    //a second manager keeps its own lock state on the same widgets and hands it on when it goes
+    {
+        SubtreeLockManager::Guard held = locks.lockWrite(a1);
+        size_t before = locks.trackedWidgets();
+        {
+            SubtreeLockManager other;
+            SubtreeLockManager::Guard guard = other.lockWrite(a1);
+            CHECK(other.trackedWidgets() == 3);
+        }
+        SubtreeLockManager later;
+        { SubtreeLockManager::Guard guard = later.lockRead(a1); }
+        CHECK(later.trackedWidgets() == 3);
+        CHECK(locks.trackedWidgets() == before);
+    }
+
+    //destroyed widgets take their lock state with them
+    {
+        size_t before = locks.trackedWidgets();
+        Widget* gone = addBox(b);
+        addBox(gone);
+        { SubtreeLockManager::Guard guard = locks.lockWrite(gone->getChildren().front().get()); }
+        CHECK(locks.trackedWidgets() == before + 2);
+        b->removeChild(gone);
+        CHECK(locks.trackedWidgets() == before);
+    }
+
+    return check_failures();
+}
@@ -0,0 +1,152 @@
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tab_warmup.h"
+#include "check.h"
+
+//content whose memory is almost all in a container outside the arena
+struct Page : Widget
+{
+    std::vector<char> pixels;
+    Page() : pixels(size_t(4) << 20) {
+        std::memset(pixels.data(), 1, pixels.size());
+    }
+    std::string getType() const override {
+        return "Page";
+    }
+    size_t heapBytes() const noexcept override {
+        return Widget::heapBytes() + pixels.capacity();
+    }
+};
+
+struct Box : Widget
+{
+    std::string getType() const override {
+        return "Box";
+    }
+};
+
+static MyUniquePtr<Widget> buildPage() {
+    MyUniquePtr<Widget> page(new Page());
+    for (int i = 0; i < 8; ++i)
+        page->addChild(new Box());
+    return page;
+}
+
+template<typename F>
+static bool waitFor(F&& done) {
+    for (int i = 0; i < 2000; ++i) {
+        if (done())
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    return false;
+}
+
+int main() {
+    //a measured build counts the containers of its widgets, not only the widget objects
+    {
+        size_t bytes = 0;
+        MyUniquePtr<Widget> page = Widget::buildMeasured(buildPage, bytes);
+        CHECK(page);
+        CHECK(bytes >= page->subtreeHeapBytes());
+        CHECK(bytes >= (size_t(4) << 20));
+        MyUniquePtr<Widget> none = Widget::buildMeasured([] { return MyUniquePtr<Widget>(); }, bytes);
+        CHECK(!none);
+        CHECK(bytes == 0);
+    }
+
+    //memory another thread takes during a build is not charged to it, and destroying the result
+    //gives back every widget byte it counted, also for children held through compressed pointers
+    {
+        size_t before = detail::widget_object_bytes();
+        size_t bytes = 0;
+        std::vector<char> other;
+        MyUniquePtr<Widget> page = Widget::buildMeasured([&] {
+            std::thread([&] {
+                other.resize(size_t(64) << 20);
+                std::memset(other.data(), 1, other.size());
+            }).join();
+            return buildPage();
+        }, bytes);
+        CHECK(bytes >= (size_t(4) << 20) && bytes < (size_t(8) << 20));
+        CHECK(detail::widget_object_bytes() > before);
+        page.reset();
+        CHECK(detail::widget_object_bytes() == before);
+    }
+
+    //warm builds are charged their real size and installed on activation
+    {
+        TabWidget tabs;
+        for (int i = 0; i < 3; ++i)
+            tabs.addTab("tab " + std::to_string(i), buildPage);
+        TabWarmer warmer(tabs, 1);
+        warmer.activate(0);
+        warmer.idle();
+        CHECK(waitFor([&] { return warmer.warmBytes() != 0; }));
+        CHECK(warmer.warmBytes() >= (size_t(4) << 20));
+        size_t next = warmer.getPredictor().predict(0, tabs.tabCount(), 1).front();
+        CHECK(warmer.activate(next) != nullptr);
+        CHECK(warmer.metrics().hits == 1);
+        CHECK(warmer.warmBytes() == 0);
+    }
+
+    //a cap below one page keeps nothing warm
+    {
+        TabWidget tabs;
+        for (int i = 0; i < 3; ++i)
+            tabs.addTab("tab " + std::to_string(i), buildPage);
+        TabWarmer warmer(tabs, 2, size_t(1) << 20);
+        warmer.activate(0);
+        warmer.idle();
+        CHECK(waitFor([&] { return warmer.metrics().discarded == 2; }));
+        CHECK(warmer.warmBytes() == 0);
+    }
+
+    //content taken out of a TabWidget keeps its arena after the TabWidget is gone
+    {
+        MyUniquePtr<Widget> kept;
+        {
+            TabWidget tabs;
+            tabs.addTab("first", buildPage);
+            tabs.addTab("second", buildPage);
+            tabs.activate(0);
+            TabWarmer warmer(tabs, 1);
+            warmer.idle();
+            CHECK(waitFor([&] { return warmer.warmBytes() != 0; }));
+            Widget* content = warmer.activate(1);
+            CHECK(warmer.metrics().hits == 1);
+            kept = tabs.removeChild(content);
+            CHECK(kept.get() == content);
+            CHECK(!tabs.isBuilt(1));
+            CHECK(tabs.activate(1) != nullptr);
+        }
+        CHECK(kept->getType() == "Page");
+        CHECK(kept->getChildren().size() == 8);
+        kept->addChild(new Box());
+        CHECK(kept->getChildren().back()->getType() == "Box");
+        kept.reset();
+    }
+
+    //unloading a warm installed tab frees its arena with the content
+    {
+        TabWidget tabs;
+        tabs.addTab("first", buildPage);
+        tabs.addTab("second", buildPage);
+        tabs.activate(0);
+        TabWarmer warmer(tabs, 1);
+        warmer.idle();
+        CHECK(waitFor([&] { return warmer.warmBytes() != 0; }));
+        size_t warm = warmer.warmBytes();
+        warmer.activate(1);
+        tabs.activate(0);
+        CHECK(tabs.inactiveBytes() == warm);
+        CHECK(tabs.unload(1) == warm);
+        CHECK(!tabs.isBuilt(1));
+        CHECK(tabs.inactiveBytes() == 0);
+    }
+    return check_failures();
+}
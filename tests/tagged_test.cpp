@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "tagged.h"
+#include "check.h"
+
+//built once per instruction set (see CMakeLists.txt) so the SSE2 and AVX2 paths of filter_by_tag
+//are each compared with a plain loop, for every length up to a few vectors so the scalar tails run
+#if defined(__AVX2__)
+static bool supported() { return __builtin_cpu_supports("avx2"); }
+#else
+static bool supported() { return true; }
+#endif
+
+constexpr int SKIPPED = 77;
+
+struct alignas(16) Node
+{
+    uint32_t value = 0;
+};
+
+struct Box : Widget
+{
+    std::string getType() const override {
+        return "Box";
+    }
+};
+
+template<typename Ptr>
+static std::vector<uint32_t> expected(const std::vector<Ptr>& slots, unsigned tag) {
+    std::vector<uint32_t> indices;
+    for (size_t i = 0; i < slots.size(); ++i) {
+        if (slots[i].tag() == (tag & Ptr::MAX_TAG))
+            indices.push_back(static_cast<uint32_t>(i));
+    }
+    return indices;
+}
+
+//every prefix length and every tag, including tags wider than the tag bits
+template<unsigned Bits>
+static bool matchesScalar(size_t maxCount) {
+    using Ptr = MyTaggedUniquePtr<Node, Bits>;
+    std::vector<Ptr> slots;
+    uint32_t state = 2463534242u;
+    for (size_t i = 0; i < maxCount; ++i) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        //some empty slots, their tag still counts
+        slots.emplace_back(state % 5 ? new Node() : nullptr, state >> 8);
+    }
+    std::vector<uint32_t> out(maxCount);
+    bool same = true;
+    for (size_t count = 0; count <= maxCount; ++count) {
+        std::vector<Ptr> prefix;
+        for (size_t i = 0; i < count; ++i)
+            prefix.emplace_back(nullptr, slots[i].tag());
+        for (unsigned tag = 0; tag <= 2 * Ptr::MAX_TAG + 1; ++tag) {
+            std::vector<uint32_t> want = expected(prefix, tag);
+            size_t found = filter_by_tag(slots.data(), count, tag, out.data());
+            same = same && found == want.size() && std::equal(want.begin(), want.end(), out.begin());
+        }
+    }
+    return same;
+}
+
+int main() {
+    if (!supported())
+        return SKIPPED;
+
+    CHECK(matchesScalar<1>(37));
+    CHECK(matchesScalar<3>(37));
+    CHECK(matchesScalar<4>(37));
+    CHECK(matchesScalar<3>(1001));
+
+    //the pointer survives tag changes and release keeps the tag
+    {
+        Node* node = new Node();
+        MyTaggedUniquePtr<Node> ptr(node, 5);
+        CHECK(ptr.get() == node && ptr.tag() == 5);
+        ptr.setTag(2);
+        CHECK(ptr.get() == node && ptr.tag() == 2);
+        MyTaggedUniquePtr<Node> moved(std::move(ptr));
+        CHECK(!ptr && moved.get() == node);
+        Node* released = moved.release();
+        CHECK(released == node && !moved && moved.tag() == 2);
+        delete released;
+    }
+
+    //widget children tagged by type at construction or looked up afterwards
+    {
+        TaggedChildren children;
+        children.push_back(make_tagged_widget<Box>());
+        children.push_back(make_tagged_widget<TabWidget>());
+        children.push_back(make_tagged_widget<CalendarWidget>());
+        children.push_back(make_tagged_widget<TabWidget>());
+        Widget* built = new CalendarWidget();
+        children.emplace_back(built, static_cast<unsigned>(widget_tag_of(built)));
+        std::vector<uint32_t> out(children.size());
+        CHECK(filter_children(children, WidgetTag::Tab, out.data()) == 2);
+        CHECK(out[0] == 1 && out[1] == 3);
+        CHECK(filter_children(children, WidgetTag::Calendar, out.data()) == 2);
+        CHECK(out[0] == 2 && out[1] == 4);
+        CHECK(filter_children(children, WidgetTag::Other, out.data()) == 1);
+    }
+    return check_failures();
+}
@@ -0,0 +1,143 @@
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Widget.h"
+#include "check.h"
+
+int main() {
+    StringInterner& interner = StringInterner::instance();
+
+    //interning is stable, dense and shared between threads, clear() keeps only ""
+    {
+        CHECK(interner.intern("") == 0);
+        uint32_t ok = interner.intern("OK");
+        CHECK(interner.intern(std::string("OK")) == ok);
+        CHECK(interner.lookup(ok) == "OK");
+        CHECK(interner.lookup(0xffffffu).empty());
+        std::vector<uint32_t> ids[2];
+        std::thread other([&] {
+            for (int i = 0; i < 500; ++i)
+                ids[1].push_back(interner.intern("shared " + std::to_string(i)));
+        });
+        for (int i = 0; i < 500; ++i)
+            ids[0].push_back(interner.intern("shared " + std::to_string(i)));
+        other.join();
+        CHECK(ids[0] == ids[1]);
+
+        StringInterner scoped;
+        size_t empty = scoped.memoryBytes();
+        for (int i = 0; i < 100; ++i)
+            scoped.intern("a label long enough to live on the heap " + std::to_string(i));
+        CHECK(scoped.size() == 101);
+        CHECK(scoped.memoryBytes() > empty + 100 * 40);
+        scoped.clear();
+        CHECK(scoped.size() == 1);
+        CHECK(scoped.memoryBytes() == empty);
+        CHECK(scoped.intern("") == 0 && scoped.intern("OK") == 1);
+    }
+
+    size_t shaped = 0;
+    TextShapingCache cache([&](std::string_view text, const FontKey& font, ShapedText& out) {
+        ++shaped;
+        TextShapingCache::approximateShaper(text, font, out);
+    }, 4);
+    FontKey regular;
+    FontKey bold;
+    bold.weight = 700;
+
+    //a string is shaped once per font, utf-8 code points become one glyph each
+    {
+        uint32_t text = cache.intern("h\xc3\xa9llo");
+        TextMetrics metrics = cache.measure(text, regular);
+        CHECK(metrics.glyphCount == 5);
+        CHECK(cache.shape(text, regular).glyphs[1] == 0xe9);
+        CHECK(cache.measure(text, regular).width == metrics.width);
+        CHECK(shaped == 1);
+        CHECK(cache.measure(text, bold).width > metrics.width);
+        CHECK(shaped == 2);
+        CHECK(cache.hits() == 2 && cache.misses() == 2);
+    }
+
+    //the batch path probes first, shapes duplicates once and fills every slot
+    {
+        std::vector<uint32_t> labels;
+        for (const char* label : { "File", "Edit", "File", "View" })
+            labels.push_back(cache.intern(label));
+        std::vector<TextMetrics> out(labels.size());
+        size_t before = shaped;
+        cache.measure(labels.data(), labels.size(), regular, out.data());
+        CHECK(shaped - before == 3);
+        CHECK(out[0].glyphCount == 4 && out[2].width == out[0].width);
+        CHECK(cache.size() == 4);
+    }
+
+    //an entry moves in the LRU at most once per frame, the least recently used one goes first
+    {
+        cache.beginFrame();
+        CHECK(cache.touchedThisFrame() == 0);
+        uint32_t file = cache.intern("File");
+        cache.measure(file, regular);
+        cache.measure(file, regular);
+        CHECK(cache.touchedThisFrame() == 1);
+        cache.measure(cache.intern("Help"), regular);
+        CHECK(cache.size() == 4);
+        size_t before = shaped;
+        cache.measure(file, regular);
+        CHECK(shaped == before);
+    }
+
+    //trim frees what it reports, strings included, and an empty cache gives its tables back
+    {
+        size_t total = cache.memoryBytes();
+        uint64_t generation = cache.generation();
+        CHECK(cache.internedStrings() == 6);
+        size_t freed = cache.trim(1);
+        CHECK(freed > 0);
+        CHECK(cache.memoryBytes() == total - freed);
+        CHECK(cache.size() == 3);
+        CHECK(cache.internedStrings() == 4);    //"", View, File and Help; Edit went
+        CHECK(cache.generation() != generation);
+        uint32_t help = cache.intern("Help");
+        size_t before = shaped;
+        CHECK(cache.measure(help, regular).glyphCount == 4);
+        CHECK(shaped == before);
+        cache.trim(SIZE_MAX);
+        CHECK(cache.size() == 0);
+        CHECK(cache.internedStrings() == 1);
+        CHECK(cache.memoryBytes() == TextShapingCache().memoryBytes());
+        CHECK(cache.measure(cache.intern("File"), regular).glyphCount == 4);
+    }
+
+    //strings that change every frame do not pile up in the interner
+    {
+        TextShapingCache counter(TextShapingCache::approximateShaper, 8);
+        for (int frame = 0; frame < 1000; ++frame) {
+            counter.beginFrame();
+            counter.measure(counter.intern(std::to_string(frame) + " fps"), regular);
+        }
+        CHECK(counter.size() == 8);
+        CHECK(counter.internedStrings() <= 2 * 8 + 1);
+    }
+
+    //tab titles are interned again after the cache starts a new generation or a title changes
+    {
+        TabWidget tabs;
+        tabs.addTab("File", [] { return MyUniquePtr<Widget>(); });
+        tabs.addTab("Edit", [] { return MyUniquePtr<Widget>(); });
+        TextShapingCache titles(TextShapingCache::approximateShaper, 8);
+        std::vector<TextMetrics> out;
+        tabs.measureTitles(titles, regular, out);
+        CHECK(titles.misses() == 2);
+        tabs.measureTitles(titles, regular, out);
+        CHECK(titles.misses() == 2 && titles.hits() == 2);
+        titles.trim(SIZE_MAX);
+        titles.measure(titles.intern("View"), regular);
+        tabs.setTabTitle(1, "Window");
+        tabs.measureTitles(titles, regular, out);
+        CHECK(out[0].glyphCount == 4 && out[1].glyphCount == 6);
+        CHECK(titles.misses() == 5);
+    }
+    return check_failures();
+}
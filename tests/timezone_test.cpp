@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "timezone.h"
+#include "check.h"
+
+//local offset types and transitions of a zone, written out as TZif data
+struct ZoneSpec
+{
+    char version = '2';     //0 for a version 1 file without the 64 bit block and footer
+    std::vector<std::pair<int32_t, bool>> types;        //offset, is dst
+    std::vector<std::pair<int64_t, uint8_t>> transitions;       //time, type index
+    std::string footer;
+};
+
+static void put32(std::vector<unsigned char>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(static_cast<unsigned char>(value >> shift));
+}
+
+static void putBlock(std::vector<unsigned char>& out, const ZoneSpec& spec, bool wide) {
+    out.insert(out.end(), { 'T', 'Z', 'i', 'f', static_cast<unsigned char>(spec.version) });
+    out.insert(out.end(), 15, 0);
+    put32(out, 0);      //isutcnt
+    put32(out, 0);      //isstdcnt
+    put32(out, 0);      //leapcnt
+    put32(out, static_cast<uint32_t>(spec.transitions.size()));
+    put32(out, static_cast<uint32_t>(spec.types.size()));
+    put32(out, 4);      //charcnt
+    for (const auto& transition : spec.transitions) {
+        if (wide)
+            put32(out, static_cast<uint32_t>(static_cast<uint64_t>(transition.first) >> 32));
+        put32(out, static_cast<uint32_t>(transition.first));
+    }
+    for (const auto& transition : spec.transitions)
+        out.push_back(transition.second);
+    for (const auto& type : spec.types) {
+        put32(out, static_cast<uint32_t>(type.first));
+        out.push_back(type.second);
+        out.push_back(0);
+    }
+    out.insert(out.end(), { 'A', 'B', 'C', 0 });
+}
+
+static std::vector<unsigned char> tzif(const ZoneSpec& spec) {
+    std::vector<unsigned char> out;
+    putBlock(out, spec, false);
+    if (spec.version == 0)
+        return out;
+    putBlock(out, spec, true);
+    out.push_back('\n');
+    out.insert(out.end(), spec.footer.begin(), spec.footer.end());
+    out.push_back('\n');
+    return out;
+}
+
+static bool parse(TimeZone& zone, const std::vector<unsigned char>& data, size_t size) {
+    return zone.parse("Test/Zone", data.data(), size);
+}
+
+static int64_t utc(int32_t y, int m, int d, int h, int mi = 0) {
+    return int64_t(days_from_civil(y, m, d)) * 86400 + h * 3600 + mi * 60;
+}
+
+int main() {
+    const int32_t EST = -5 * 3600, EDT = -4 * 3600;
+
+    //a version 1 file: explicit transitions only
+    {
+        ZoneSpec spec;
+        spec.version = 0;
+        spec.types = { { EST, false }, { EDT, true } };
+        spec.transitions = { { utc(2000, 4, 2, 7), 1 }, { utc(2000, 10, 29, 6), 0 } };
+        std::vector<unsigned char> data = tzif(spec);
+        TimeZone zone;
+        CHECK(parse(zone, data, data.size()));
+        CHECK(zone.getName() == "Test/Zone");
+        CHECK(zone.transitionCount() == 2);
+        CHECK(zone.offsetAt(utc(1900, 1, 1, 0)) == EST);
+        CHECK(zone.offsetAt(utc(2000, 4, 2, 7) - 1) == EST);
+        CHECK(zone.offsetAt(utc(2000, 4, 2, 7)) == EDT);
+        CHECK(zone.offsetAt(utc(2000, 10, 29, 6) - 1) == EDT);
+        CHECK(zone.offsetAt(utc(2000, 10, 29, 6)) == EST);
+        CHECK(zone.offsetAt(utc(2030, 7, 1, 0)) == EST);
+    }
+
+    //a version 2 file whose footer rule takes over after the explicit transitions
+    ZoneSpec newYork;
+    newYork.types = { { EST, false }, { EDT, true } };
+    newYork.transitions = { { utc(2005, 4, 3, 7), 1 }, { utc(2005, 10, 30, 6), 0 } };
+    newYork.footer = "EST5EDT,M3.2.0,M11.1.0";
+    std::vector<unsigned char> newYorkData = tzif(newYork);
+    TimeZone zone;
+    CHECK(parse(zone, newYorkData, newYorkData.size()));
+    {
+        CHECK(zone.transitionCount() > 2 * (TimeZone::LAST_YEAR - 2006));
+        CHECK(zone.offsetAt(utc(2005, 4, 3, 7)) == EDT);
+        //second Sunday in March at 02:00 standard, first Sunday in November at 02:00 daylight
+        const int64_t on = utc(2024, 3, 10, 7), off = utc(2024, 11, 3, 6);
+        CHECK(zone.offsetAt(on - 1) == EST && zone.offsetAt(on) == EDT);
+        CHECK(zone.offsetAt(off - 1) == EDT && zone.offsetAt(off) == EST);
+        CHECK(zone.offsetAt(utc(2006, 3, 12, 7)) == EDT);
+        CHECK(zone.offsetAt(utc(TimeZone::LAST_YEAR, 7, 1, 0)) == EDT);
+        CHECK(zone.offsetAt(utc(TimeZone::LAST_YEAR + 1, 7, 1, 0)) == EST);
+
+        //a skipped local time maps past the jump, a repeated one to its first occurrence
+        CHECK(zone.toLocal(on) == utc(2024, 3, 10, 3));
+        CHECK(zone.toUtc(utc(2024, 3, 10, 2, 30)) == on + 1800);
+        CHECK(zone.toUtc(utc(2024, 11, 3, 1, 30)) == off - 1800);
+        CHECK(zone.toUtc(utc(2024, 7, 1, 12)) == utc(2024, 7, 1, 16));
+        CHECK(zone.toUtc(zone.toLocal(off + 1800)) == off - 1800);
+    }
+
+    //the batch conversion agrees with the scalar one, sorted or not
+    {
+        std::vector<int64_t> times(10000), batch(times.size());
+        uint32_t state = 2463534242u;
+        for (int64_t& t : times) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            t = utc(1990, 1, 1, 0) + int64_t(state % 44000) * 86400 + state % 86400;
+        }
+        for (int pass = 0; pass < 2; ++pass) {
+            zone.toLocal(times.data(), batch.data(), times.size());
+            bool same = true;
+            for (size_t i = 0; i < times.size(); ++i)
+                same = same && batch[i] == zone.toLocal(times[i]);
+            CHECK(same);
+            std::sort(times.begin(), times.end());
+        }
+    }
+
+    //footer-only zones: a southern rule that ends daylight time before it starts it in the year,
+    //a julian day rule on a leap year, and a fixed offset that differs from the only type
+    {
+        ZoneSpec sydney;
+        sydney.types = { { 10 * 3600, false } };
+        sydney.footer = "AEST-10AEDT,M10.1.0,M4.1.0/3";
+        std::vector<unsigned char> data = tzif(sydney);
+        TimeZone south;
+        CHECK(parse(south, data, data.size()));
+        CHECK(south.offsetAt(utc(2024, 1, 15, 0)) == 11 * 3600);
+        CHECK(south.offsetAt(utc(2024, 7, 15, 0)) == 10 * 3600);
+        const int64_t off = utc(2024, 4, 6, 16), on = utc(2024, 10, 5, 16);
+        CHECK(south.offsetAt(off - 1) == 11 * 3600 && south.offsetAt(off) == 10 * 3600);
+        CHECK(south.offsetAt(on - 1) == 10 * 3600 && south.offsetAt(on) == 11 * 3600);
+
+        ZoneSpec julian;
+        julian.types = { { 0, false } };
+        julian.footer = "XXX0YYY,J60/0,J300/0";
+        data = tzif(julian);
+        TimeZone days;
+        CHECK(parse(days, data, data.size()));
+        const int64_t march1 = utc(2024, 3, 1, 0);
+        CHECK(days.offsetAt(march1 - 1) == 0 && days.offsetAt(march1) == 3600);
+        const int64_t end = (int64_t(days_from_civil(2024, 1, 1)) + 300) * 86400 - 3600;
+        CHECK(days.offsetAt(end - 1) == 3600 && days.offsetAt(end) == 0);
+
+        ZoneSpec fixed;
+        fixed.types = { { 0, false } };
+        fixed.footer = "<+0330>-3:30";
+        data = tzif(fixed);
+        TimeZone tehran;
+        CHECK(parse(tehran, data, data.size()));
+        CHECK(tehran.transitionCount() == 1);
+        CHECK(tehran.offsetAt(utc(1800, 1, 1, 0)) == 12600 && tehran.offsetAt(utc(2200, 1, 1, 0)) == 12600);
+    }
+
+    //malformed and truncated data is rejected without reading past the end
+    {
+        TimeZone bad;
+        CHECK(!bad.parse("Bad", nullptr, 0));
+        std::vector<unsigned char> data = newYorkData;
+        data[0] = 'X';
+        CHECK(!parse(bad, data, data.size()));
+        CHECK(bad.offsetAt(0) == 0);
+
+        size_t footer = newYorkData.size() - newYork.footer.size() - 2;
+        bool rejected = true;
+        for (size_t size = 0; size < footer; ++size) {
+            std::vector<unsigned char> prefix(newYorkData.begin(), newYorkData.begin() + size);
+            rejected = rejected && !parse(bad, prefix, prefix.size());
+        }
+        CHECK(rejected);
+        //a cut footer is ignored, the explicit transitions still load
+        std::vector<unsigned char> cut(newYorkData.begin(), newYorkData.end() - 5);
+        CHECK(parse(bad, cut, cut.size()));
+        CHECK(bad.transitionCount() == 2);
+
+        ZoneSpec spec = newYork;
+        spec.footer = "EST5EDT,M13.2.0,M11.1.0";
+        data = tzif(spec);
+        CHECK(parse(bad, data, data.size()));
+        CHECK(bad.transitionCount() == 2);
+
+        spec.transitions[1].second = 2;
+        data = tzif(spec);
+        CHECK(!parse(bad, data, data.size()));
+
+        spec = newYork;
+        spec.types.clear();
+        spec.transitions.clear();
+        data = tzif(spec);
+        CHECK(!parse(bad, data, data.size()));
+    }
+
+    //the database loads a zone file once and refuses names outside its root
+    {
+        char pattern[] = "/tmp/timezone_testXXXXXX";
+        char* dir = mkdtemp(pattern);
+        CHECK(dir != nullptr);
+        if (!dir)
+            return check_failures();
+        std::string path = std::string(dir) + "/Test";
+        FILE* file = std::fopen(path.c_str(), "wb");
+        CHECK(file && std::fwrite(newYorkData.data(), 1, newYorkData.size(), file) == newYorkData.size());
+        if (file)
+            std::fclose(file);
+        std::string junkPath = std::string(dir) + "/Junk";
+        file = std::fopen(junkPath.c_str(), "wb");
+        if (file) {
+            std::fputs("not a zone", file);
+            std::fclose(file);
+        }
+
+        {
+            TimeZoneDb db(dir);
+            const TimeZone* loaded = db.get("Test");
+            CHECK(loaded && loaded->getName() == "Test");
+            CHECK(db.get("Test") == loaded);
+            CHECK(loaded && loaded->offsetAt(utc(2024, 7, 1, 0)) == EDT);
+            CHECK(db.get("Missing") == nullptr);
+            CHECK(db.get("Junk") == nullptr);
+            CHECK(db.get("../Test") == nullptr);
+            CHECK(db.get("") == nullptr);
+        }
+        unlink(path.c_str());
+        unlink(junkPath.c_str());
+        rmdir(dir);
+    }
+    return check_failures();
+}
@@ -0,0 +1,403 @@
+#ifndef _TEXT_CACHE_H_
+#define _TEXT_CACHE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "fork_locks.h"
+
+//string interning; ids are dense and 0 is "". instance() is the process wide interner, whose ids
+//stay valid for the process lifetime and which never frees, so it is meant for a fixed vocabulary.
+//strings that come and go belong in an interner whose owner can clear() it, like the one each
+//TextShapingCache keeps
+class StringInterner
+{
+private:
+    mutable std::mutex mutex;
+    std::deque<std::string> strings;        //never moves its elements, views into it stay valid
+    std::unordered_map<std::string_view, uint32_t> ids;
+    size_t textBytes = 0;                   //string objects and their heap buffers
+    uint64_t forkHook;
+
+    uint32_t add(std::string_view text) {
+        strings.emplace_back(text);
+        uint32_t id = static_cast<uint32_t>(strings.size() - 1);
+        ids.emplace(std::string_view(strings.back()), id);
+        textBytes += sizeof(std::string) + (strings.back().capacity() > std::string().capacity() ? strings.back().capacity() + 1 : 0);
+        return id;
+    }
+
+public:
+    StringInterner() {
+        add(std::string_view());
+        forkHook = ForkLocks::instance().add(mutex);
+    }
+    StringInterner(const StringInterner& other) = delete;
+    StringInterner& operator=(const StringInterner& other) = delete;
+
+    ~StringInterner() {
+        ForkLocks::instance().remove(forkHook);
+    }
+
+    static StringInterner& instance() {
+        static StringInterner interner;
+        return interner;
+    }
+
+    uint32_t intern(std::string_view text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = ids.find(text);
+        if (it != ids.end())
+            return it->second;
+        return add(text);
+    }
+
+    std::string_view lookup(uint32_t id) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return id < strings.size() ? std::string_view(strings[id]) : std::string_view();
+    }
+
+    //forgets every string but "" and gives the memory back; ids and views handed out before are invalid
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unordered_map<std::string_view, uint32_t>().swap(ids);
+        std::deque<std::string>().swap(strings);
+        textBytes = 0;
+        add(std::string_view());
+    }
+
+    //statistics
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return strings.size();
+    }
+    //heap bytes of the strings and the map, hash nodes estimated at two pointers of overhead each
+    size_t memoryBytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return textBytes + ids.bucket_count() * sizeof(void*)
+            + ids.size() * (sizeof(std::pair<const std::string_view, uint32_t>) + 2 * sizeof(void*));
+    }
+};
+
+struct FontKey
+{
+    uint32_t family = 0;        //interned family name
+    float size = 12.0f;
+    uint16_t weight = 400;
+    uint16_t style = 0;         //0 upright, 1 italic, 2 oblique
+
+    bool operator==(const FontKey& other) const noexcept {
+        return family == other.family && size == other.size && weight == other.weight && style == other.style;
+    }
+};
+
+//glyph run of one string in one font
+struct ShapedText
+{
+    float width = 0.0f;
+    float ascent = 0.0f;
+    float descent = 0.0f;
+    std::vector<uint32_t> glyphs;
+    std::vector<float> advances;
+};
+
+struct TextMetrics
+{
+    float width = 0.0f;
+    float ascent = 0.0f;
+    float descent = 0.0f;
+    uint32_t glyphCount = 0;
+};
+
+//shaped text keyed by interned string and font, bounded by an LRU. entries record the frame they
+//were last used in and move to the front of the LRU at most once per frame, so a layout pass over
+//an unchanged tab strip only probes the hash map and never shapes or relinks.
+//strings are interned in the cache's own interner, which trim() shrinks to the strings of the
+//entries it keeps and beginFrame() does the same once it holds twice the capacity; either starts a
+//new generation, and ids from an older generation have to be interned again
+class TextShapingCache
+{
+public:
+    using Shaper = std::function<void(std::string_view text, const FontKey& font, ShapedText& out)>;
+
+private:
+    static constexpr uint32_t NONE = 0xffffffffu;
+
+    struct Entry
+    {
+        uint64_t key;
+        uint64_t frame;
+        uint32_t prev;
+        uint32_t next;
+        ShapedText shaped;
+    };
+
+    Shaper shaper;
+    size_t capacity;
+    StringInterner strings;
+    uint64_t generationId = nextGeneration();
+    std::vector<Entry> entries;
+    std::vector<uint32_t> freeEntries;
+    std::unordered_map<uint64_t, uint32_t> index;
+    std::vector<FontKey> fonts;             //font ids are positions, an application uses a handful
+    uint32_t head = NONE;                   //most recently used
+    uint32_t tail = NONE;
+    uint64_t frame = 1;
+    size_t touched = 0;
+    size_t shapedBytes = 0;                 //glyph arrays of the cached entries
+    uint64_t hitCount = 0;
+    uint64_t missCount = 0;
+
+    uint32_t fontId(const FontKey& font) {
+        for (size_t i = 0; i < fonts.size(); ++i) {
+            if (fonts[i] == font)
+                return static_cast<uint32_t>(i);
+        }
+        fonts.push_back(font);
+        return static_cast<uint32_t>(fonts.size() - 1);
+    }
+
+    void unlink(uint32_t i) noexcept {
+        Entry& entry = entries[i];
+        if (entry.prev != NONE)
+            entries[entry.prev].next = entry.next;
+        else
+            head = entry.next;
+        if (entry.next != NONE)
+            entries[entry.next].prev = entry.prev;
+        else
+            tail = entry.prev;
+    }
+    void pushFront(uint32_t i) noexcept {
+        entries[i].prev = NONE;
+        entries[i].next = head;
+        if (head != NONE)
+            entries[head].prev = i;
+        head = i;
+        if (tail == NONE)
+            tail = i;
+    }
+
+    void touch(uint32_t i) noexcept {
+        Entry& entry = entries[i];
+        if (entry.frame == frame)
+            return;
+        entry.frame = frame;
+        ++touched;
+        unlink(i);
+        pushFront(i);
+    }
+
+    void evictLeastRecent() {
+        uint32_t victim = tail;
+        if (victim == NONE)
+            return;
+        if (entries[victim].frame == frame)
+            --touched;
+        unlink(victim);
+        index.erase(entries[victim].key);
+        shapedBytes -= bytesOf(entries[victim].shaped);
+        entries[victim].shaped = ShapedText();
+        freeEntries.push_back(victim);
+    }
+
+    uint32_t insert(uint64_t key, uint32_t text, const FontKey& font) {
+        while (index.size() >= capacity && tail != NONE)
+            evictLeastRecent();
+        uint32_t i;
+        if (!freeEntries.empty()) {
+            i = freeEntries.back();
+            freeEntries.pop_back();
+        }
+        else {
+            i = static_cast<uint32_t>(entries.size());
+            entries.emplace_back();
+        }
+        Entry& entry = entries[i];
+        entry.key = key;
+        entry.frame = frame;
+        entry.shaped = ShapedText();
+        shaper(strings.lookup(text), font, entry.shaped);
+        shapedBytes += bytesOf(entry.shaped);
+        ++touched;
+        ++missCount;
+        pushFront(i);
+        index.emplace(key, i);
+        return i;
+    }
+
+    //unique across caches, so ids kept for one cache are never taken for another's
+    static uint64_t nextGeneration() noexcept {
+        static std::atomic<uint64_t> next{ 1 };
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //interns the strings of the remaining entries afresh and drops the rest
+    void compact() {
+        std::vector<std::pair<uint32_t, std::string>> kept;
+        kept.reserve(index.size());
+        for (const auto& [key, i] : index)
+            kept.emplace_back(i, std::string(strings.lookup(static_cast<uint32_t>(key))));
+        strings.clear();
+        std::unordered_map<uint64_t, uint32_t> rekeyed;
+        rekeyed.reserve(kept.size());
+        for (const auto& [i, text] : kept) {
+            Entry& entry = entries[i];
+            entry.key = (entry.key & 0xffffffff00000000ull) | strings.intern(text);
+            rekeyed.emplace(entry.key, i);
+        }
+        index.swap(rekeyed);
+        generationId = nextGeneration();
+    }
+
+    static size_t bytesOf(const ShapedText& shaped) noexcept {
+        return shaped.glyphs.capacity() * sizeof(uint32_t) + shaped.advances.capacity() * sizeof(float);
+    }
+
+    static TextMetrics metricsOf(const ShapedText& shaped) noexcept {
+        return TextMetrics{ shaped.width, shaped.ascent, shaped.descent, static_cast<uint32_t>(shaped.glyphs.size()) };
+    }
+
+public:
+    //constructor, capacity is the number of shaped strings kept
+    explicit TextShapingCache(Shaper shaper = approximateShaper, size_t capacity = 4096)
+        : shaper(std::move(shaper)), capacity(capacity ? capacity : 1) {};
+
+    TextShapingCache(const TextShapingCache& other) = delete;
+    TextShapingCache& operator=(const TextShapingCache& other) = delete;
+
+    //starts a new frame for touch tracking, and a new generation if the interner outgrew the entries
+    void beginFrame() {
+        ++frame;
+        touched = 0;
+        if (strings.size() > 2 * capacity)
+            compact();
+    }
+
+    //id of text in this cache's interner, valid while generation() stays the same
+    uint32_t intern(std::string_view text) {
+        return strings.intern(text);
+    }
+    std::string_view lookup(uint32_t text) const {
+        return strings.lookup(text);
+    }
+    uint64_t generation() const noexcept {
+        return generationId;
+    }
+
+    //shaped text of an interned string; the reference is valid until the next call that may insert
+    const ShapedText& shape(uint32_t text, const FontKey& font) {
+        uint64_t key = (static_cast<uint64_t>(fontId(font)) << 32) | text;
+        auto it = index.find(key);
+        if (it != index.end()) {
+            ++hitCount;
+            touch(it->second);
+            return entries[it->second].shaped;
+        }
+        return entries[insert(key, text, font)].shaped;
+    }
+    TextMetrics measure(uint32_t text, const FontKey& font) {
+        return metricsOf(shape(text, font));
+    }
+
+    //metrics of count interned strings in one font: one probe pass over the map, then the misses
+    //are shaped together, so unchanged labels cost a single lookup each
+    void measure(const uint32_t* texts, size_t count, const FontKey& font, TextMetrics* out) {
+        uint64_t fontBits = static_cast<uint64_t>(fontId(font)) << 32;
+        std::vector<size_t> misses;
+        for (size_t i = 0; i < count; ++i) {
+            auto it = index.find(fontBits | texts[i]);
+            if (it == index.end()) {
+                misses.push_back(i);
+                continue;
+            }
+            ++hitCount;
+            touch(it->second);
+            out[i] = metricsOf(entries[it->second].shaped);
+        }
+        for (size_t i : misses) {
+            uint64_t key = fontBits | texts[i];
+            auto it = index.find(key);      //repeated within the batch
+            if (it != index.end()) {
+                ++hitCount;
+                touch(it->second);
+                out[i] = metricsOf(entries[it->second].shaped);
+            }
+            else {
+                out[i] = metricsOf(entries[insert(key, texts[i], font)].shaped);
+            }
+        }
+    }
+
+    //drops least recently used entries until about bytes were freed, then the strings only they
+    //used, and returns the bytes freed; references returned by shape() are invalid afterwards and
+    //if anything was dropped so are the interned ids
+    size_t trim(size_t bytes) {
+        size_t before = memoryBytes();
+        size_t count = index.size();
+        while (tail != NONE && before - memoryBytes() < bytes)
+            evictLeastRecent();
+        if (index.size() != count || strings.size() > index.size() + 1)
+            compact();
+        if (index.empty()) {
+            std::vector<Entry>().swap(entries);
+            std::vector<uint32_t>().swap(freeEntries);
+            std::unordered_map<uint64_t, uint32_t>().swap(index);
+        }
+        size_t after = memoryBytes();
+        return before > after ? before - after : 0;
+    }
+
+    //statistics
+    size_t size() const noexcept {
+        return index.size();
+    }
+    //heap bytes held by the cache, hash nodes estimated at two pointers of overhead each
+    size_t memoryBytes() const {
+        return entries.capacity() * sizeof(Entry) + freeEntries.capacity() * sizeof(uint32_t)
+            + index.bucket_count() * sizeof(void*) + index.size() * (sizeof(std::pair<const uint64_t, uint32_t>) + 2 * sizeof(void*))
+            + shapedBytes + strings.memoryBytes();
+    }
+    size_t internedStrings() const {
+        return strings.size();
+    }
+    size_t touchedThisFrame() const noexcept {
+        return touched;
+    }
+    uint64_t hits() const noexcept {
+        return hitCount;
+    }
+    //every miss is one shaper call
+    uint64_t misses() const noexcept {
+        return missCount;
+    }
+
+    //fallback shaper without a font backend: one glyph per code point of UTF-8 text with
+    //fixed advances proportional to the font size
+    static void approximateShaper(std::string_view text, const FontKey& font, ShapedText& out) {
+        float advance = font.size * (font.weight >= 600 ? 0.62f : 0.56f);
+        for (size_t i = 0; i < text.size();) {
+            unsigned char lead = static_cast<unsigned char>(text[i]);
+            size_t length = lead < 0x80 ? 1 : lead < 0xe0 ? 2 : lead < 0xf0 ? 3 : 4;
+            uint32_t codepoint = length == 1 ? lead : lead & (0x7f >> length);
+            for (size_t k = 1; k < length && i + k < text.size(); ++k)
+                codepoint = (codepoint << 6) | (static_cast<unsigned char>(text[i + k]) & 0x3f);
+            out.glyphs.push_back(codepoint);
+            out.advances.push_back(advance);
+            out.width += advance;
+            i += length;
+        }
+        out.ascent = font.size * 0.8f;
+        out.descent = font.size * 0.2f;
+    }
+};
+
+#endif
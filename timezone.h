@@ -0,0 +1,372 @@
+#ifndef _TIMEZONE_H_
+#define _TIMEZONE_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "civil.h"
+#include "fork_locks.h"
+#include "memory.h"
+
+namespace detail
+{
+    inline bool tz_is_leap(int64_t y) noexcept {
+        return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    }
+
+    //one end of a POSIX TZ daylight rule
+    struct TzRule
+    {
+        char kind = 'M';            //'M' month.week.day, 'J' julian without leap day, 'N' zero based day
+        int month = 0, week = 0, weekday = 0, day = 0;
+        int32_t time = 7200;        //seconds after local midnight
+
+        //seconds since the epoch of local midnight plus time, in the rule's local time
+        int64_t localInstant(int64_t year) const noexcept {
+            int64_t days;
+            if (kind == 'J') {
+                days = days_from_civil(static_cast<int32_t>(year), 1, 1) + day - 1;
+                if (tz_is_leap(year) && day >= 60)
+                    ++days;
+            }
+            else if (kind == 'N') {
+                days = days_from_civil(static_cast<int32_t>(year), 1, 1) + day;
+            }
+            else {
+                int64_t first = days_from_civil(static_cast<int32_t>(year), month, 1);
+                int firstWeekday = static_cast<int>(((first % 7) + 11) % 7);     //1970-01-01 was a Thursday
+                int offset = (weekday - firstWeekday + 7) % 7 + (week - 1) * 7;
+                static const int lengths[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+                int length = lengths[month - 1] + (month == 2 && tz_is_leap(year));
+                while (offset >= length)
+                    offset -= 7;        //week 5 means the last such weekday
+                days = first + offset;
+            }
+            return days * 86400 + time;
+        }
+    };
+
+    //parser for the POSIX TZ string in the TZif footer, e.g. "EST5EDT,M3.2.0,M11.1.0"
+    class TzStringParser
+    {
+    private:
+        const char* p;
+        const char* end;
+
+        bool name() noexcept {
+            if (p < end && *p == '<') {
+                while (p < end && *p != '>')
+                    ++p;
+                if (p == end)
+                    return false;
+                ++p;
+                return true;
+            }
+            const char* start = p;
+            while (p < end && ((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z')))
+                ++p;
+            return p - start >= 3;
+        }
+        bool number(int& value) noexcept {
+            if (p == end || *p < '0' || *p > '9')
+                return false;
+            value = 0;
+            while (p < end && *p >= '0' && *p <= '9')
+                value = value * 10 + (*p++ - '0');
+            return true;
+        }
+        //[+-]hh[:mm[:ss]]
+        bool seconds(int32_t& value) noexcept {
+            int sign = 1;
+            if (p < end && (*p == '+' || *p == '-'))
+                sign = *p++ == '-' ? -1 : 1;
+            int h = 0, m = 0, s = 0;
+            if (!number(h))
+                return false;
+            if (p < end && *p == ':') {
+                ++p;
+                if (!number(m))
+                    return false;
+                if (p < end && *p == ':') {
+                    ++p;
+                    if (!number(s))
+                        return false;
+                }
+            }
+            value = sign * (h * 3600 + m * 60 + s);
+            return true;
+        }
+        bool rule(TzRule& r) noexcept {
+            if (p < end && *p == 'M') {
+                ++p;
+                r.kind = 'M';
+                if (!number(r.month) || p == end || *p++ != '.' || !number(r.week) || p == end || *p++ != '.' || !number(r.weekday))
+                    return false;
+                if (r.month < 1 || r.month > 12 || r.week < 1 || r.week > 5 || r.weekday > 6)
+                    return false;
+            }
+            else if (p < end && *p == 'J') {
+                ++p;
+                r.kind = 'J';
+                if (!number(r.day) || r.day < 1 || r.day > 365)
+                    return false;
+            }
+            else {
+                r.kind = 'N';
+                if (!number(r.day) || r.day > 365)
+                    return false;
+            }
+            if (p < end && *p == '/') {
+                ++p;
+                return seconds(r.time);
+            }
+            return true;
+        }
+
+    public:
+        int32_t stdOffset = 0;      //seconds east of UTC
+        int32_t dstOffset = 0;
+        bool hasDst = false;
+        TzRule start, finish;
+
+        bool parse(const std::string& text) noexcept {
+            p = text.data();
+            end = p + text.size();
+            int32_t posix;
+            if (!name() || !seconds(posix))
+                return false;
+            stdOffset = -posix;
+            if (p == end)
+                return true;
+            if (!name())
+                return false;
+            hasDst = true;
+            dstOffset = stdOffset + 3600;
+            if (p < end && *p != ',') {
+                if (!seconds(posix))
+                    return false;
+                dstOffset = -posix;
+            }
+            if (p == end || *p++ != ',' || !rule(start) || p == end || *p++ != ',' || !rule(finish))
+                return false;
+            return p == end;
+        }
+    };
+} // namespace detail
+
+//UTC offsets of one zone as a flat sorted transition table: offsets[i] applies from transitions[i - 1]
+//up to transitions[i], offsets[0] before the first transition and offsets.back() after the last one.
+//the footer rule is expanded into explicit transitions up to LAST_YEAR so lookups never evaluate rules
+class TimeZone
+{
+public:
+    static constexpr int64_t LAST_YEAR = 2100;
+
+private:
+    std::string name;
+    std::vector<int64_t> transitions;
+    std::vector<int32_t> offsets;
+
+    static uint32_t be32(const unsigned char* p) noexcept {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    }
+    static int64_t be64(const unsigned char* p) noexcept {
+        return static_cast<int64_t>((uint64_t(be32(p)) << 32) | be32(p + 4));
+    }
+
+    void expandRule(const detail::TzStringParser& rule) {
+        if (!rule.hasDst) {
+            if (offsets.back() != rule.stdOffset) {
+                //the footer only takes over after the last transition
+                int64_t at = transitions.empty() ? INT64_MIN / 2 : transitions.back() + 1;
+                transitions.push_back(at);
+                offsets.push_back(rule.stdOffset);
+            }
+            return;
+        }
+        int64_t from = transitions.empty() ? 1970 : 1970 + transitions.back() / (365 * 86400LL) - 1;
+        for (int64_t year = from; year <= LAST_YEAR; ++year) {
+            int64_t on = rule.start.localInstant(year) - rule.stdOffset;
+            int64_t off = rule.finish.localInstant(year) - rule.dstOffset;
+            std::pair<int64_t, int32_t> changes[2] = { { on, rule.dstOffset }, { off, rule.stdOffset } };
+            if (off < on)
+                std::swap(changes[0], changes[1]);
+            for (const auto& change : changes) {
+                if (!transitions.empty() && change.first <= transitions.back())
+                    continue;
+                transitions.push_back(change.first);
+                offsets.push_back(change.second);
+            }
+        }
+    }
+
+public:
+    TimeZone() : offsets(1, 0) {};
+
+    //parses TZif data (versions 1 to 4), false if it is malformed
+    bool parse(const std::string& zoneName, const unsigned char* data, size_t size) {
+        name = zoneName;
+        transitions.clear();
+        offsets.assign(1, 0);
+        if (size < 44 || data[0] != 'T' || data[1] != 'Z' || data[2] != 'i' || data[3] != 'f')
+            return false;
+        const unsigned char* p = data;
+        const unsigned char* end = data + size;
+        bool wide = false;
+        //a version 2+ file repeats the data with 64 bit times after the version 1 block
+        for (int pass = 0; pass < 2; ++pass) {
+            if (end - p < 44)
+                return false;
+            char version = static_cast<char>(p[4]);
+            uint32_t isutcnt = be32(p + 20), isstdcnt = be32(p + 24), leapcnt = be32(p + 28);
+            uint32_t timecnt = be32(p + 32), typecnt = be32(p + 36), charcnt = be32(p + 40);
+            size_t timeSize = wide ? 8 : 4;
+            size_t length = timecnt * timeSize + timecnt + typecnt * 6 + charcnt + leapcnt * (timeSize + 4) + isstdcnt + isutcnt;
+            p += 44;
+            if (static_cast<size_t>(end - p) < length || typecnt == 0)
+                return false;
+            if (pass == 0 && version >= '2') {
+                p += length;
+                wide = true;
+                continue;
+            }
+            const unsigned char* times = p;
+            const unsigned char* indices = times + timecnt * timeSize;
+            const unsigned char* types = indices + timecnt;
+            std::vector<int32_t> typeOffsets(typecnt);
+            std::vector<bool> typeDst(typecnt);
+            for (uint32_t i = 0; i < typecnt; ++i) {
+                typeOffsets[i] = static_cast<int32_t>(be32(types + i * 6));
+                typeDst[i] = types[i * 6 + 4] != 0;
+            }
+            //before the first transition the first standard time type applies
+            uint32_t initial = 0;
+            while (initial < typecnt && typeDst[initial])
+                ++initial;
+            offsets[0] = typeOffsets[initial < typecnt ? initial : 0];
+            for (uint32_t i = 0; i < timecnt; ++i) {
+                if (indices[i] >= typecnt)
+                    return false;
+                int64_t at = wide ? be64(times + i * 8) : static_cast<int32_t>(be32(times + i * 4));
+                if (!transitions.empty() && at <= transitions.back())
+                    continue;
+                transitions.push_back(at);
+                offsets.push_back(typeOffsets[indices[i]]);
+            }
+            p += length;
+            break;
+        }
+        //footer: newline, POSIX TZ string, newline
+        if (wide && p < end && *p == '\n') {
+            const unsigned char* close = std::find(p + 1, end, '\n');
+            if (close != end) {
+                detail::TzStringParser rule;
+                if (rule.parse(std::string(reinterpret_cast<const char*>(p + 1), reinterpret_cast<const char*>(close))))
+                    expandRule(rule);
+            }
+        }
+        return true;
+    }
+
+    const std::string& getName() const noexcept {
+        return name;
+    }
+    size_t transitionCount() const noexcept {
+        return transitions.size();
+    }
+
+    //seconds east of UTC in effect at utc
+    int32_t offsetAt(int64_t utc) const noexcept {
+        size_t index = static_cast<size_t>(std::upper_bound(transitions.begin(), transitions.end(), utc) - transitions.begin());
+        return offsets[index];
+    }
+    int64_t toLocal(int64_t utc) const noexcept {
+        return utc + offsetAt(utc);
+    }
+    //inverse of toLocal; a local time skipped by a forward jump maps past the jump and one
+    //repeated by a backward jump maps to its first occurrence
+    int64_t toUtc(int64_t local) const noexcept {
+        int64_t before = local - offsetAt(local - 86400);
+        int64_t after = local - offsetAt(local + 86400);
+        bool beforeValid = toLocal(before) == local;
+        bool afterValid = toLocal(after) == local;
+        if (beforeValid && afterValid)
+            return std::min(before, after);
+        return afterValid ? after : before;
+    }
+
+    //batched conversion; consecutive timestamps in the same transition window reuse the last
+    //lookup, so sorted or clustered input costs one binary search per window instead of per event
+    void toLocal(const int64_t* utc, int64_t* local, size_t count) const noexcept {
+        int64_t low = INT64_MAX, high = INT64_MIN;      //current window [low, high)
+        int32_t offset = 0;
+        for (size_t i = 0; i < count; ++i) {
+            int64_t t = utc[i];
+            if (t < low || t >= high) {
+                size_t index = static_cast<size_t>(std::upper_bound(transitions.begin(), transitions.end(), t) - transitions.begin());
+                low = index ? transitions[index - 1] : INT64_MIN;
+                high = index < transitions.size() ? transitions[index] : INT64_MAX;
+                offset = offsets[index];
+            }
+            local[i] = t + offset;
+        }
+    }
+};
+
+//loads zones from the system zoneinfo directory once and keeps them for the process lifetime
+class TimeZoneDb
+{
+private:
+    std::string root;
+    std::unordered_map<std::string, MyUniquePtr<TimeZone>> zones;
+    std::mutex mutex;
+    uint64_t forkHook;
+
+public:
+    explicit TimeZoneDb(std::string root = "/usr/share/zoneinfo") : root(std::move(root)) {
+        forkHook = ForkLocks::instance().add(mutex);
+    }
+
+    TimeZoneDb(const TimeZoneDb& other) = delete;
+    TimeZoneDb& operator=(const TimeZoneDb& other) = delete;
+
+    ~TimeZoneDb() {
+        ForkLocks::instance().remove(forkHook);
+    }
+
+    //zone by IANA name such as "Europe/Berlin", nullptr if it is missing or unreadable;
+    //returned zones stay valid as long as the database
+    const TimeZone* get(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = zones.find(name);
+        if (it != zones.end())
+            return it->second.get();
+        if (name.empty() || name.find("..") != std::string::npos)
+            return nullptr;
+        std::ifstream file(root + "/" + name, std::ios::binary);
+        if (!file)
+            return nullptr;
+        std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        MyUniquePtr<TimeZone> zone(new TimeZone());
+        if (!zone->parse(name, reinterpret_cast<const unsigned char*>(data.data()), data.size()))
+            return nullptr;
+        const TimeZone* result = zone.get();
+        zones.emplace(name, std::move(zone));
+        return result;
+    }
+
+    //process wide database on the system zoneinfo directory
+    static TimeZoneDb& system() {
+        static TimeZoneDb db;
+        return db;
+    }
+};
+
+#endif